@@ -2,31 +2,39 @@
 A Python and C++ sample project
 """
 
-import platform
+import os
 from setuptools import setup, Extension
 from pybind11.setup_helpers import Pybind11Extension
 
-if platform.processor().lower().startswith(('x86', 'amd')):
-    CPU_ARCH_FLAGS = ['-msse4.2']
-else:
-    CPU_ARCH_FLAGS = []
+# PY_CPP_SAMPLE_NO_STATS=1 compiles out metrics which stats() returns
+STATS_MACROS = [('POPCOUNT_NO_STATS', None)] \
+    if os.environ.get('PY_CPP_SAMPLE_NO_STATS') == '1' else []
 
+# Kernels select SIMD instructions at runtime and we do not pass
+# any -m or -march flags to share a binary across CPUs.
 setup(
     ext_modules=[Pybind11Extension(
         'py_cpp_sample.py_cpp_sample_cpp_impl',
         sources=['src/cpp_impl/popcount.cpp',
-                 'src/cpp_impl/popcount_impl.cpp'],
-        extra_compile_args=CPU_ARCH_FLAGS,
+                 'src/cpp_impl/popcount_file.cpp',
+                 'src/cpp_impl/popcount_impl.cpp',
+                 'src/cpp_impl/popcount_kernel.cpp',
+                 'src/cpp_impl/popcount_stream.cpp',
+                 'src/cpp_impl/rank_select.cpp',
+                 'src/cpp_impl/thread_pool.cpp'],
+        define_macros=STATS_MACROS,
     ),
         Extension(
         'py_cpp_sample.py_cpp_sample_cpp_impl_boost',
         define_macros=[('BOOST_PYTHON_STATIC_LIB', None)],
         sources=['src/cpp_impl_boost/popcount_boost.cpp',
-                 'src/cpp_impl_boost/popcount_impl_boost.cpp'],
-        include_dirs=['/opt/boost/include'],
+                 'src/cpp_impl_boost/popcount_impl_boost.cpp',
+                 'src/cpp_impl/popcount_kernel.cpp',
+                 'src/cpp_impl/thread_pool.cpp'],
+        include_dirs=['/opt/boost/include', 'src/cpp_impl'],
         library_dirs=['/opt/boost/lib'],
         runtime_library_dirs=[],
         libraries=['boost_python', 'boost_numpy'],
-        extra_compile_args=['-isystem', '/opt/boost/include'] + CPU_ARCH_FLAGS,
+        extra_compile_args=['-isystem', '/opt/boost/include'],
     )]
 )
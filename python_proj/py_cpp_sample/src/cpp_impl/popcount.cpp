@@ -1,7 +1,82 @@
 #include "popcount.h"
+#include "popcount_kernel.h"
+#include <pybind11/stl.h>
 
 PYBIND11_MODULE(py_cpp_sample_cpp_impl, mod) {
     mod.doc() = "C++ implementation of the py_cpp_sample package";
-    mod.def("popcount_cpp_uint8", &py_cpp_sample::popcount_cpp_uint8);
-    mod.def("popcount_cpp_uint64", &py_cpp_sample::popcount_cpp_uint64);
+    mod.def("popcount_cpp", &py_cpp_sample::popcount_cpp, pybind11::arg("xs"),
+            pybind11::arg("threads") = 1,
+            pybind11::arg("out") = pybind11::none());
+    mod.def("popcount_cpp_uint8", &py_cpp_sample::popcount_cpp_uint8,
+            pybind11::arg("xs"), pybind11::arg("threads") = 1,
+            pybind11::arg("out") = pybind11::none());
+    mod.def("popcount_cpp_uint64", &py_cpp_sample::popcount_cpp_uint64,
+            pybind11::arg("xs"), pybind11::arg("threads") = 1,
+            pybind11::arg("out") = pybind11::none());
+    mod.def("popcount_total_cpp", &py_cpp_sample::popcount_total_cpp,
+            pybind11::arg("xs"), pybind11::arg("threads") = 1);
+    mod.def("popcount_total_axis_cpp", &py_cpp_sample::popcount_total_axis_cpp,
+            pybind11::arg("xs"), pybind11::arg("axis"),
+            pybind11::arg("threads") = 1);
+    mod.def("popcount_histogram_cpp", &py_cpp_sample::popcount_histogram_cpp,
+            pybind11::arg("xs"), pybind11::arg("threads") = 1);
+    mod.def("popcount_many_cpp", &py_cpp_sample::popcount_many_cpp,
+            pybind11::arg("xs_list"), pybind11::arg("threads") = 1,
+            pybind11::arg("concatenate") = false);
+    mod.def("hamming_cdist_cpp", &py_cpp_sample::hamming_cdist_cpp,
+            pybind11::arg("xs"), pybind11::arg("ys"),
+            pybind11::arg("metric") = "hamming", pybind11::arg("threads") = 1);
+    mod.def("hamming_pdist_cpp", &py_cpp_sample::hamming_pdist_cpp,
+            pybind11::arg("xs"), pybind11::arg("metric") = "hamming",
+            pybind11::arg("threads") = 1, pybind11::arg("condensed") = true);
+    mod.def("hamming_topk_cpp", &py_cpp_sample::hamming_topk_cpp,
+            pybind11::arg("queries"), pybind11::arg("database"),
+            pybind11::arg("k"), pybind11::arg("threads") = 1);
+    mod.def("popcount_file_cpp", &py_cpp_sample::popcount_file_cpp,
+            pybind11::arg("path"), pybind11::arg("offset"),
+            pybind11::arg("length"), pybind11::arg("dtype"),
+            pybind11::arg("total") = false,
+            pybind11::arg("out") = pybind11::none(),
+            pybind11::arg("threads") = 1);
+    pybind11::class_<py_cpp_sample::RankSelectBitvector>(mod,
+                                                         "RankSelectBitvector")
+        .def(pybind11::init(&py_cpp_sample::make_rank_select_bitvector),
+             pybind11::arg("bits"), pybind11::arg("size") = pybind11::none())
+        .def("__len__", &py_cpp_sample::RankSelectBitvector::size)
+        .def("count", &py_cpp_sample::RankSelectBitvector::count)
+        .def("get", &py_cpp_sample::RankSelectBitvector::get,
+             pybind11::arg("index"))
+        .def("rank", &py_cpp_sample::rank_select_rank_cpp,
+             pybind11::arg("indexes"))
+        .def("select", &py_cpp_sample::rank_select_select_cpp,
+             pybind11::arg("nths"))
+        .def("overhead_bytes",
+             &py_cpp_sample::RankSelectBitvector::overhead_bytes);
+    pybind11::class_<py_cpp_sample::PopcountStream>(mod, "PopcountStream")
+        .def(pybind11::init(&py_cpp_sample::make_popcount_stream),
+             pybind11::arg("dtype") = pybind11::none())
+        .def("update", &py_cpp_sample::popcount_stream_update_cpp,
+             pybind11::arg("data"), pybind11::arg("threads") = 1)
+        .def("total", &py_cpp_sample::PopcountStream::total)
+        .def("histogram", &py_cpp_sample::popcount_stream_histogram_cpp)
+        .def_property_readonly("nbytes", &py_cpp_sample::PopcountStream::size)
+        .def("copy",
+             [](const py_cpp_sample::PopcountStream &stream) {
+                 return py_cpp_sample::PopcountStream(stream);
+             })
+        .def("reset", &py_cpp_sample::PopcountStream::reset);
+    mod.def("popcount_async_cpp", &py_cpp_sample::popcount_async_cpp,
+            pybind11::arg("xs"), pybind11::arg("threads") = 1);
+    mod.def("profile_popcount_cpp", &py_cpp_sample::profile_popcount_cpp,
+            pybind11::arg("xs"), pybind11::arg("repeat") = 1);
+    mod.def("stats_cpp", &py_cpp_sample::stats_cpp);
+    mod.def("reset_stats_cpp", &py_cpp_sample::reset_stats_cpp);
+    mod.def("get_kernel_variant", &py_cpp_sample::get_kernel_variant_name);
+    mod.def("set_kernel_variant", &py_cpp_sample::set_kernel_variant_name);
+    mod.def("supported_kernel_variants",
+            &py_cpp_sample::supported_kernel_variants);
+
+    // Join native workers before the interpreter finalizes
+    pybind11::module_::import("atexit").attr("register")(
+        pybind11::cpp_function(&py_cpp_sample::shutdown_async_executor));
 }
@@ -1,9 +1,13 @@
 #ifndef CPP_IMPL_POPCOUNT_H
 #define CPP_IMPL_POPCOUNT_H
 
+#include "popcount_stream.h"
+#include "rank_select.h"
 #include <cstdint>
+#include <memory>
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
+#include <string>
 
 /**
  C++ implementation
@@ -12,22 +16,258 @@ namespace py_cpp_sample {
 using Count = uint8_t;
 
 /**
- * @param[in] xs A uint8_t array
+ A succinct bitvector which the R package shares
+ */
+using RankSelectBitvector = popcount_core::RankSelectBitvector;
+
+/**
+ * @param[in] xs An object which forcecast converts to a uint8_t array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or a uint8 array as long as xs to write counts
  * @return The number of 1's of each element in xs
  */
 extern pybind11::array_t<uint8_t>
-popcount_cpp_uint8(pybind11::array_t<uint8_t, pybind11::array::c_style |
-                                                  pybind11::array::forcecast>
-                       xs);
+popcount_cpp_uint8(pybind11::object xs, size_t threads = 1,
+                   pybind11::object out = pybind11::none());
 
 /**
- * @param[in] xs A uint64_t array
+ * @param[in] xs An object which forcecast converts to a uint64_t array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or a uint8 array as long as xs to write counts
  * @return The number of 1's of each element in xs
  */
 extern pybind11::array_t<uint8_t>
-popcount_cpp_uint64(pybind11::array_t<uint64_t, pybind11::array::c_style |
-                                                    pybind11::array::forcecast>
-                        xs);
+popcount_cpp_uint64(pybind11::object xs, size_t threads = 1,
+                    pybind11::object out = pybind11::none());
+
+/**
+ * Counts integer arrays in their own buffers and converts others to uint64
+ * @param[in] xs An array or an object convertible to an array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or a uint8 array as long as xs to write counts
+ * @return The number of 1's of each element in xs
+ */
+extern pybind11::array_t<uint8_t>
+popcount_cpp(pybind11::object xs, size_t threads = 1,
+             pybind11::object out = pybind11::none());
+
+/**
+ * @param[in] xs An array or an object convertible to an array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's of elements in xs
+ */
+extern uint64_t popcount_total_cpp(pybind11::object xs, size_t threads = 1);
+
+/**
+ * Sums the numbers of 1's along an axis in one pass
+ * @param[in] xs An array of one or more dimensions or an object
+ *               convertible to it
+ * @param[in] axis An axis of xs which can be negative as NumPy accepts
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's in each line along the axis
+ */
+extern pybind11::array_t<uint64_t>
+popcount_total_axis_cpp(pybind11::object xs, pybind11::ssize_t axis,
+                        size_t threads = 1);
+
+/**
+ * Counts elements by their numbers of 1's in one pass without making an
+ * array of counts
+ * @param[in] xs An array of one or more dimensions or an object
+ *               convertible to it
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The numbers of elements which have 0, 1, ... 1's as a uint64
+ *         array of 9 bins for 8-bit unsigned integers up to 65 bins
+ */
+extern pybind11::array_t<uint64_t> popcount_histogram_cpp(pybind11::object xs,
+                                                          size_t threads = 1);
+
+/**
+ * Counts many 1-D arrays in one call as popcount_cpp counts each of them
+ * @param[in] xs_list An iterable of arrays or objects convertible to them
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] concatenate Whether to write counts of all arrays to one array
+ * @return A list of counts of each array, or a tuple of counts of all
+ *         arrays and uint64 offsets of the counts of each array in them
+ */
+extern pybind11::object popcount_many_cpp(pybind11::object xs_list,
+                                          size_t threads = 1,
+                                          bool concatenate = false);
+
+/**
+ * Computes distances between all pairs of rows of packed binary codes
+ * @param[in] xs A 2-D integer array of codes or an object convertible to it
+ * @param[in] ys A 2-D integer array of codes as long as rows of xs
+ * @param[in] metric "hamming" or "jaccard"
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return A uint32 array of the numbers of different bits or a float64
+ *         array of Jaccard distances for xs.shape[0] x ys.shape[0] pairs
+ */
+extern pybind11::array hamming_cdist_cpp(pybind11::object xs,
+                                         pybind11::object ys,
+                                         const std::string &metric,
+                                         size_t threads = 1);
+
+/**
+ * Computes distances between pairs of rows of packed binary codes
+ * @param[in] xs A 2-D integer array of codes or an object convertible to it
+ * @param[in] metric "hamming" or "jaccard"
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] condensed Whether to return the upper triangle as
+ *                      scipy.spatial.distance.pdist does or a square matrix
+ * @return Distances as hamming_cdist_cpp() returns
+ */
+extern pybind11::array hamming_pdist_cpp(pybind11::object xs,
+                                         const std::string &metric,
+                                         size_t threads = 1,
+                                         bool condensed = true);
+
+/**
+ * Finds the k nearest rows of a database for each query by Hamming
+ * distances in O(queries x k) memory
+ * @param[in] queries A 2-D integer array of codes or an object
+ *                    convertible to it
+ * @param[in] database A 2-D integer array of codes as long as rows of
+ *                     queries
+ * @param[in] k The number of neighbours
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return A tuple of a uint32 array of distances and an int64 array of
+ *         indexes of rows of the database, both in queries.shape[0] x
+ *         min(k, database.shape[0]) and nearest first
+ */
+extern pybind11::tuple hamming_topk_cpp(pybind11::object queries,
+                                        pybind11::object database, size_t k,
+                                        size_t threads = 1);
+
+/**
+ * Counts elements in a file through windows of memory mapping without
+ * the GIL and without reading the whole file into memory
+ * @param[in] path The path of a file
+ * @param[in] offset The offset of the first element in bytes
+ * @param[in] length The number of elements
+ * @param[in] dtype An integer type of elements or an object convertible
+ *                  to numpy.dtype
+ * @param[in] total Whether to return the total number of 1's
+ * @param[in] out None or the path of a file to write counts as uint8
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's if total is true, the number of 1's of
+ *         each element as a uint8 array if out is None or None after
+ *         writing counts to out
+ */
+extern pybind11::object popcount_file_cpp(
+    const std::string &path, uint64_t offset, uint64_t length,
+    pybind11::object dtype, bool total = false,
+    pybind11::object out = pybind11::none(), size_t threads = 1);
+
+/**
+ * Builds a rank/select index of bits without the GIL
+ * @param[in] bits A bool array of bits or an integer array whose bytes
+ *                 hold bit i in bit (i % 8) of byte (i / 8)
+ * @param[in] size None for all bits or the number of leading bits
+ * @return A new bitvector which copies the bits
+ */
+extern std::unique_ptr<RankSelectBitvector>
+make_rank_select_bitvector(pybind11::object bits,
+                           pybind11::object size = pybind11::none());
+
+/**
+ * @param[in] bitvector A bitvector
+ * @param[in] indexes An integer or an array of positions up to its size
+ * @return The number of 1's before each position as an int or a uint64
+ *         array as large as indexes
+ */
+extern pybind11::object rank_select_rank_cpp(
+    const RankSelectBitvector &bitvector, pybind11::object indexes);
+
+/**
+ * @param[in] bitvector A bitvector
+ * @param[in] nths An integer or an array of 0-based ordinals of 1's
+ * @return The position of each nth 1 as an int or a uint64 array as large
+ *         as nths
+ */
+extern pybind11::object rank_select_select_cpp(
+    const RankSelectBitvector &bitvector, pybind11::object nths);
+
+/**
+ * @param[in] dtype None to count totals only or an integer type to count a
+ *                  histogram of its elements as popcount_histogram_cpp()
+ *                  does as well
+ * @return A new empty stream
+ */
+extern std::unique_ptr<PopcountStream>
+make_popcount_stream(pybind11::object dtype = pybind11::none());
+
+/**
+ * Counts a chunk without the GIL
+ * @param[in] stream A stream
+ * @param[in] data A bytes-like object or an array which is read as the
+ *                 bytes of its elements in the C order
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void popcount_stream_update_cpp(PopcountStream &stream,
+                                       pybind11::object data,
+                                       size_t threads = 1);
+
+/**
+ * @param[in] stream A stream which has a dtype
+ * @return The numbers of elements which have 0 to the number of bits of
+ *         elements 1's as a uint64 array
+ */
+extern pybind11::array_t<uint64_t>
+popcount_stream_histogram_cpp(const PopcountStream &stream);
+
+/**
+ * Counts on a native worker thread without the GIL
+ * @param[in] xs An array or an object convertible to an array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return A concurrent.futures.Future which holds the number of 1's of
+ *         each element in xs
+ */
+extern pybind11::object popcount_async_cpp(pybind11::object xs,
+                                           size_t threads = 1);
+
+/**
+ * Counts an array with the current kernel variant on one thread under
+ * hardware performance counters
+ * @param[in] xs A 1-D array or an object convertible to it
+ * @param[in] repeat The number of times to count xs
+ * @return A dict of the variant, bytes, seconds, counts of events and
+ *         cycles per byte and IPC which are None if the host does not
+ *         count them
+ */
+extern pybind11::dict profile_popcount_cpp(pybind11::object xs,
+                                           size_t repeat = 1);
+
+/**
+ * Sums metrics of calls of native functions which count 1's or distances
+ * in all threads. Asynchronous calls record their metrics when they run.
+ * @return A dict of whether recording is compiled in, calls, bytes which
+ *         they read, calls which copied inputs to convert them, calls
+ *         which read Stats_Timed_Bytes or more and seconds which they
+ *         spent, calls of each kernel variant and a list of timed calls
+ *         in [2^i, 2^(i+1)) nanoseconds
+ */
+extern pybind11::dict stats_cpp();
+
+/**
+ * Clears metrics in all threads
+ */
+extern void reset_stats_cpp();
+
+/**
+ * Finishes queued asynchronous tasks at exit
+ */
+extern void shutdown_async_executor();
+
+/**
+ * @return The name of the kernel variant which popcount_cpp_* run
+ */
+extern std::string get_kernel_variant_name();
+
+/**
+ * @param[in] name The name of a kernel variant or "auto"
+ */
+extern void set_kernel_variant_name(const std::string &name);
 } // namespace py_cpp_sample
 
 #endif // CPP_IMPL_POPCOUNT_H
@@ -0,0 +1,259 @@
+#include "popcount_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+
+namespace py_cpp_sample {
+namespace {
+// Resident pages of a file are bounded to a window and windows are large
+// enough to amortize mmap and page faults. This is a multiple of pages
+// and elements.
+constexpr uint64_t Map_Window_Bytes = uint64_t{1} << 26;
+
+/**
+ * @param[in] what A description of a failed system call
+ * @throw std::system_error with errno
+ */
+[[noreturn]] void throw_system_error(const std::string &what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+/**
+ A file descriptor which closes at the end of its scope
+ */
+class FileDescriptor {
+  public:
+    /**
+     * @param[in] path The path of a file
+     * @param[in] flags Flags of open(2)
+     */
+    FileDescriptor(const std::string &path, int flags)
+        : fd_(::open(path.c_str(), flags | O_CLOEXEC, 0666)) {
+        if (fd_ < 0) {
+            throw_system_error("cannot open " + path);
+        }
+    }
+
+    ~FileDescriptor() {
+        ::close(fd_);
+    }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    /**
+     * @return The file descriptor
+     */
+    int get() const {
+        return fd_;
+    }
+
+    /**
+     * @return The size of the file in bytes
+     */
+    uint64_t size() const {
+        return static_cast<uint64_t>(status().st_size);
+    }
+
+    /**
+     * @param[in] other Another file
+     * @return Whether both descriptors refer to the same file
+     */
+    bool same_file(const FileDescriptor &other) const {
+        const auto lhs = status();
+        const auto rhs = other.status();
+        return (lhs.st_dev == rhs.st_dev) && (lhs.st_ino == rhs.st_ino);
+    }
+
+  private:
+    /**
+     * @return The status of the file
+     */
+    struct stat status() const {
+        struct stat status {};
+        if (::fstat(fd_, &status) != 0) {
+            throw_system_error("cannot stat a file");
+        }
+        return status;
+    }
+
+    int fd_{-1};
+};
+
+/**
+ A mapped window of a file which is unmapped at the end of its scope
+ */
+class MappedWindow {
+  public:
+    /**
+     * @param[in] fd A file to map
+     * @param[in] offset The offset of the window in the file
+     * @param[in] size The size of the window in bytes which is not 0
+     * @param[in] writable Whether to write to the window
+     */
+    MappedWindow(const FileDescriptor &fd, uint64_t offset, size_t size,
+                 bool writable) {
+        // mmap takes offsets aligned to pages
+        const auto page_size = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        const auto page_offset = offset % page_size;
+        length_ = size + static_cast<size_t>(page_offset);
+        const int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+        base_ = ::mmap(nullptr, length_, protection, MAP_SHARED, fd.get(),
+                       static_cast<off_t>(offset - page_offset));
+        if (base_ == MAP_FAILED) {
+            throw_system_error("cannot map a file");
+        }
+
+        // Hints only and failures are harmless
+        ::madvise(base_, length_, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        ::madvise(base_, length_, MADV_HUGEPAGE);
+#endif
+        data_ = static_cast<uint8_t *>(base_) + page_offset;
+    }
+
+    ~MappedWindow() {
+        ::munmap(base_, length_);
+    }
+
+    MappedWindow(const MappedWindow &) = delete;
+    MappedWindow &operator=(const MappedWindow &) = delete;
+
+    /**
+     * @return The first byte at the offset
+     */
+    uint8_t *data() const {
+        return data_;
+    }
+
+  private:
+    void *base_{nullptr};
+    size_t length_{0};
+    uint8_t *data_{nullptr};
+};
+
+/**
+ * @tparam SourceType The type of elements
+ * @param[in] fd A file to read
+ * @param[in] src Elements in the file
+ * @throw std::invalid_argument if the offset is not aligned to elements
+ * @throw std::out_of_range if src exceeds the file
+ */
+template <typename SourceType>
+void check_file_range(const FileDescriptor &fd, const FileRange &src) {
+    if ((src.offset % sizeof(SourceType)) != 0) {
+        throw std::invalid_argument(
+            "offset must be a multiple of the size of elements");
+    }
+
+    const auto file_size = fd.size();
+    if ((src.offset > file_size) ||
+        (src.size > (file_size - src.offset) / sizeof(SourceType))) {
+        throw std::out_of_range("elements are out of the file");
+    }
+}
+
+/**
+ * Maps windows of elements in a file one by one
+ * @tparam SourceType The type of elements
+ * @tparam Function A type of functions
+ * @param[in] fd A file to read
+ * @param[in] src Elements in the file which check_file_range() accepts
+ * @param[in] function A function which takes a pointer to the first
+ *                     element of a window, its index and the number of
+ *                     elements in the window
+ */
+template <typename SourceType, typename Function>
+void for_each_window(const FileDescriptor &fd, const FileRange &src,
+                     Function function) {
+    constexpr uint64_t window_elements = Map_Window_Bytes / sizeof(SourceType);
+    for (uint64_t index = 0; index < src.size; index += window_elements) {
+        const auto n_elements =
+            static_cast<size_t>(std::min(window_elements, src.size - index));
+        const MappedWindow window(fd, src.offset + index * sizeof(SourceType),
+                                  n_elements * sizeof(SourceType), false);
+        function(reinterpret_cast<const SourceType *>(window.data()),
+                 static_cast<size_t>(index), n_elements);
+    }
+}
+} // namespace
+
+template <typename SourceType>
+uint64_t popcount_file_total_kernel(const FileRange &src, size_t threads) {
+    const FileDescriptor fd(src.path, O_RDONLY);
+    check_file_range<SourceType>(fd, src);
+    uint64_t total{0};
+    for_each_window<SourceType>(
+        fd, src, [&](const SourceType *window, size_t, size_t size) {
+            // Zero extension keeps the number of 1's of bytes
+            if (std::is_unsigned<SourceType>::value) {
+                total += popcount_total_kernel(
+                    window, size * sizeof(SourceType), threads);
+            } else {
+                total += popcount_total_strided_kernel<SourceType>(
+                    window, sizeof(SourceType), size, threads);
+            }
+        });
+    return total;
+}
+
+template <typename SourceType>
+void popcount_file_kernel(const FileRange &src, Count *dst, size_t threads) {
+    const FileDescriptor fd(src.path, O_RDONLY);
+    check_file_range<SourceType>(fd, src);
+    for_each_window<SourceType>(
+        fd, src, [&](const SourceType *window, size_t index, size_t size) {
+            popcount_kernel(window, size, dst + index, threads);
+        });
+}
+
+template <typename SourceType>
+void popcount_file_kernel(const FileRange &src, const std::string &dst_path,
+                          size_t threads) {
+    const FileDescriptor fd(src.path, O_RDONLY);
+    check_file_range<SourceType>(fd, src);
+
+    // Truncating the input would lose it and fault on its mapped windows
+    const FileDescriptor dst_fd(dst_path, O_RDWR | O_CREAT);
+    if (dst_fd.same_file(fd)) {
+        throw std::invalid_argument("out must not be the input file");
+    }
+
+    // Sparse pages of the output file are allocated as they are written
+    const auto dst_size = static_cast<off_t>(src.size * sizeof(Count));
+    if (::ftruncate(dst_fd.get(), dst_size) != 0) {
+        throw_system_error("cannot resize " + dst_path);
+    }
+
+    for_each_window<SourceType>(
+        fd, src, [&](const SourceType *window, size_t index, size_t size) {
+            const MappedWindow dst(dst_fd, index * sizeof(Count),
+                                   size * sizeof(Count), true);
+            popcount_kernel(window, size, dst.data(), threads);
+        });
+}
+
+#define POPCOUNT_INSTANTIATE_FILE_KERNEL(type)                                 \
+    template uint64_t popcount_file_total_kernel<type>(const FileRange &,      \
+                                                       size_t);                \
+    template void popcount_file_kernel<type>(const FileRange &, Count *,       \
+                                             size_t);                          \
+    template void popcount_file_kernel<type>(const FileRange &,                \
+                                             const std::string &, size_t);
+
+POPCOUNT_INSTANTIATE_FILE_KERNEL(int8_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(uint8_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(int16_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(uint16_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(int32_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(uint32_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(int64_t)
+POPCOUNT_INSTANTIATE_FILE_KERNEL(uint64_t)
+#undef POPCOUNT_INSTANTIATE_FILE_KERNEL
+} // namespace py_cpp_sample
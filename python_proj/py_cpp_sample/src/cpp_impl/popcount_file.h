@@ -0,0 +1,69 @@
+#ifndef CPP_IMPL_POPCOUNT_FILE_H
+#define CPP_IMPL_POPCOUNT_FILE_H
+
+#include "popcount_kernel.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ C++ implementation
+ */
+namespace py_cpp_sample {
+/**
+ Elements in a file
+ */
+struct FileRange {
+    std::string path; ///< The path of a file
+    uint64_t offset;  ///< The offset of the first element in bytes
+    uint64_t size;    ///< The number of elements
+};
+
+/**
+ * Maps windows of a file one by one and counts them as
+ * popcount_total_kernel() does. Only a window stays resident and files
+ * can be larger than memory.
+ * @tparam SourceType The type of elements as popcount_kernel() takes
+ * @param[in] src Elements to count
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's in src
+ * @throw std::invalid_argument if the offset is not aligned to elements
+ * @throw std::out_of_range if src exceeds the file
+ * @throw std::system_error if the file cannot be read
+ */
+template <typename SourceType>
+uint64_t popcount_file_total_kernel(const FileRange &src, size_t threads);
+
+/**
+ * Maps windows of a file one by one and counts each element
+ * @tparam SourceType The type of elements as popcount_kernel() takes
+ * @param[in] src Elements to count
+ * @param[out] dst A pointer to an array to write the counts of src
+ * @param[in] threads The number of threads or 0 for all cores
+ * @throw std::invalid_argument if the offset is not aligned to elements
+ * @throw std::out_of_range if src exceeds the file
+ * @throw std::system_error if the file cannot be read
+ */
+template <typename SourceType>
+void popcount_file_kernel(const FileRange &src, Count *dst, size_t threads);
+
+/**
+ * Maps windows of a file and an output file one by one and writes the
+ * count of each element. Written pages go to the page cache and peak
+ * memory does not depend on sizes of files.
+ * @tparam SourceType The type of elements as popcount_kernel() takes
+ * @param[in] src Elements to count
+ * @param[in] dst_path The path of a file to create or truncate and write
+ *                     the counts of src
+ * @param[in] threads The number of threads or 0 for all cores
+ * @throw std::invalid_argument if the offset is not aligned to elements
+ *                               or dst_path is the file of src
+ * @throw std::out_of_range if src exceeds the file
+ * @throw std::system_error if a file cannot be read or written
+ */
+template <typename SourceType>
+void popcount_file_kernel(const FileRange &src, const std::string &dst_path,
+                          size_t threads);
+} // namespace py_cpp_sample
+
+#endif // CPP_IMPL_POPCOUNT_FILE_H
@@ -1,66 +1,1280 @@
 #include "popcount.h"
+#include "popcount_file.h"
+#include "popcount_kernel.h"
+#include "popcount_perf.h"
+#include "popcount_stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace py_cpp_sample {
+namespace {
+constexpr const char *Type_Error_Message =
+    "xs must be a 1-D np.ndarray(np.uint8|np.uint64)";
+
+using DenseUint64Array =
+    pybind11::array_t<uint64_t,
+                      pybind11::array::c_style | pybind11::array::forcecast>;
+
 /**
- * @tparam SourceType The type of xs elements
- * @param[in] xs An integer array
- * @return The number of 1's of each element in xs
+ A kernel instance for an element type of NumPy arrays
  */
-template <typename SourceType>
-pybind11::array_t<Count> popcount_cpp_impl(
-    pybind11::array_t<SourceType, pybind11::array::c_style |
-                                      pybind11::array::forcecast> &xs) {
-    if (!xs.dtype().is(pybind11::dtype::of<SourceType>())) {
-        throw std::runtime_error("Unsupported array element types");
+template <typename Function> struct ElementType {
+    char kind;                  ///< numpy.dtype.kind
+    pybind11::ssize_t itemsize; ///< numpy.dtype.itemsize
+    Function function;          ///< An instance for the type
+};
+
+/**
+ * @param[in] table Instances for element types
+ * @param[in] kind numpy.dtype.kind of elements
+ * @param[in] itemsize The size of elements in bytes
+ * @return An instance for the type or nullptr
+ */
+template <typename Function, size_t N>
+Function find_function(const std::array<ElementType<Function>, N> &table,
+                       char kind, pybind11::ssize_t itemsize) {
+    for (const auto &entry : table) {
+        if ((entry.kind == kind) && (entry.itemsize == itemsize)) {
+            return entry.function;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @param[in] table Instances for element types
+ * @param[in] dtype The element type of an array
+ * @return An instance which counts the array in its own buffer or nullptr
+ */
+template <typename Function, size_t N>
+Function find_function(const std::array<ElementType<Function>, N> &table,
+                       const pybind11::dtype &dtype) {
+    // Kernels read integers in the native byte order
+    if (!dtype.attr("isnative").cast<bool>()) {
+        return nullptr;
+    }
+    return find_function(table, dtype.kind(), dtype.itemsize());
+}
+
+/**
+ * @param[in] format A format string of the buffer protocol
+ * @return numpy.dtype.kind of integers in the native byte order or 0 for
+ *         other formats
+ */
+char buffer_kind(const char *format) {
+    // No format means unsigned bytes
+    if (format == nullptr) {
+        return 'u';
+    }
+    // Other prefixes are byte orders which may not be native
+    if ((format[0] == '@') || (format[0] == '=')) {
+        ++format;
+    }
+    if ((format[0] == '\0') || (format[1] != '\0')) {
+        return 0;
+    }
+    if (format[0] == '?') {
+        return 'b';
+    }
+    if (std::strchr("bhilq", format[0]) != nullptr) {
+        return 'i';
+    }
+    if (std::strchr("BHILQ", format[0]) != nullptr) {
+        return 'u';
+    }
+    return 0;
+}
+
+/**
+ Borrows the buffer of an object until the end of a scope
+ */
+class BufferView {
+  public:
+    explicit BufferView(const pybind11::object &xs)
+        : valid_(PyObject_GetBuffer(xs.ptr(), &view_, PyBUF_RECORDS_RO) ==
+                 0) {
+        if (!valid_) {
+            // Callers take the usual path for such objects
+            PyErr_Clear();
+        }
     }
+    ~BufferView() {
+        if (valid_) {
+            PyBuffer_Release(&view_);
+        }
+    }
+    BufferView(const BufferView &) = delete;
+    BufferView &operator=(const BufferView &) = delete;
+
+    /**
+     * @return Whether the object exports a buffer
+     */
+    bool valid() const {
+        return valid_;
+    }
+
+    /**
+     * @return The buffer which is valid only if valid() is true
+     */
+    const Py_buffer &view() const {
+        return view_;
+    }
+
+  private:
+    Py_buffer view_;
+    bool valid_;
+};
 
-    const auto buffer_xs = xs.request();
-    if (buffer_xs.ndim == 0) {
+/**
+ * @param[in] xs An array or an object convertible to an array
+ * @return xs as an array
+ */
+pybind11::array to_array(const pybind11::object &xs) {
+    auto array = pybind11::array::ensure(xs);
+    if (!array) {
+        throw pybind11::type_error("xs must be convertible to a numpy.ndarray");
+    }
+    return array;
+}
+
+/**
+ * @param[in] xs An array
+ * @return xs converted to uint64 as forcecast does
+ */
+pybind11::array to_uint64_array(const pybind11::array &xs) {
+    auto source = DenseUint64Array::ensure(xs);
+    if (!source) {
+        throw pybind11::type_error("xs must be convertible to uint64");
+    }
+    return source;
+}
+
+/**
+ * @param[in] codes An object convertible to a 2-D array of packed codes
+ * @return codes as an integer array whose rows are contiguous
+ */
+pybind11::array to_code_array(const pybind11::object &codes) {
+    auto array = to_array(codes);
+    const auto kind = array.dtype().kind();
+    if ((kind != 'u') && (kind != 'i') && (kind != 'b')) {
+        // Convert others as popcount_cpp does
+        array = to_uint64_array(array);
+    }
+    if (array.ndim() != 2) {
+        throw pybind11::value_error("codes must be 2-D arrays");
+    }
+
+    // Read rows of views such as xs[::2] in place and copy others
+    if ((array.shape(1) > 1) && (array.strides(1) != array.itemsize())) {
+        array = pybind11::module_::import("numpy").attr("ascontiguousarray")(
+            array);
+    }
+    return array;
+}
+
+/**
+ * @param[in] codes A 2-D array whose rows are contiguous
+ * @return Rows of codes which kernels read
+ */
+CodeMatrix to_code_matrix(const pybind11::array &codes) {
+    return CodeMatrix{codes.data(), static_cast<size_t>(codes.shape(0)),
+                      static_cast<size_t>(codes.shape(1) * codes.itemsize()),
+                      static_cast<ptrdiff_t>(codes.strides(0))};
+}
+
+/**
+ * @param[in] metric The name of a metric
+ * @return Whether metric is Jaccard and not Hamming
+ * @throw pybind11::value_error if metric is unknown
+ */
+bool is_jaccard(const std::string &metric) {
+    if (metric == "hamming") {
+        return false;
+    }
+    if (metric == "jaccard") {
+        return true;
+    }
+    throw pybind11::value_error("metric must be hamming or jaccard");
+}
+
+/**
+ * @param[in] xs An array
+ * @throw std::runtime_error if xs is 0-D
+ */
+void check_not_scalar(const pybind11::array &xs) {
+    if (xs.ndim() == 0) {
+        throw std::runtime_error(
+            "xs must be a uint array (a scalar variable passed?)");
+    }
+}
+
+/**
+ * @param[in] xs An array
+ * @throw std::runtime_error if xs is not 1-D
+ */
+void check_dimension(const pybind11::array &xs) {
+    if (xs.ndim() == 0) {
         throw std::runtime_error(
             "xs must be a 1-D uint array (a scalar variable passed?)");
     }
-    if (buffer_xs.ndim != 1) {
+    if (xs.ndim() != 1) {
         throw std::runtime_error("xs must be a 1-D uint array");
     }
+}
+
+/**
+ * @param[in] queries_object An integer or an array of queries
+ * @param[in] query A function which answers a query
+ * @return The answer of each query as an int or a uint64 array as large
+ *         as queries
+ */
+template <typename Query>
+pybind11::object answer_queries(const pybind11::object &queries_object,
+                                Query query) {
+    const auto queries = DenseUint64Array::ensure(queries_object);
+    if (!queries) {
+        throw pybind11::type_error("queries must be convertible to uint64");
+    }
+
+    const std::vector<pybind11::ssize_t> shape(
+        queries.shape(), queries.shape() + queries.ndim());
+    pybind11::array_t<uint64_t, pybind11::array::c_style> answers{shape};
+    const auto *src = queries.data();
+    auto *dst = answers.mutable_data();
+    const auto size = static_cast<size_t>(queries.size());
+    {
+        pybind11::gil_scoped_release release;
+        for (size_t i = 0; i < size; ++i) {
+            dst[i] = query(src[i]);
+        }
+    }
+
+    if (queries.ndim() == 0) {
+        return pybind11::int_(dst[0]);
+    }
+    return answers;
+}
 
-    // Assuming NumPy arrays have C-like dense memory layout
-    if (buffer_xs.strides.at(0) != sizeof(SourceType)) {
-        throw std::runtime_error("Unexpected array layout");
+/**
+ * Needs the GIL
+ * @param[in] error An exception which C++ code threw
+ * @return A Python exception of the type which pybind11 translates the
+ *         standard exception to
+ */
+pybind11::object to_python_exception(const std::exception_ptr &error) {
+    PyObject *type = PyExc_RuntimeError;
+    std::string message{"Unknown exception"};
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::bad_alloc &e) {
+        type = PyExc_MemoryError;
+        message = e.what();
+    } catch (const std::invalid_argument &e) {
+        type = PyExc_ValueError;
+        message = e.what();
+    } catch (const std::out_of_range &e) {
+        type = PyExc_IndexError;
+        message = e.what();
+    } catch (const std::exception &e) {
+        message = e.what();
+    } catch (...) {
+        // Report others as RuntimeError as pybind11 does
     }
+    return pybind11::reinterpret_borrow<pybind11::object>(type)(message);
+}
+} // namespace
 
-    pybind11::array_t<Count, pybind11::array::c_style> counts{buffer_xs.shape};
-    auto buffer_counts = counts.request();
-    if (buffer_counts.strides.at(0) != sizeof(Count)) {
-        throw std::runtime_error("Unexpected array layout");
+/**
+ * @param[in] out None or an array to write counts
+ * @param[in] shape The shape of an input array
+ * @return out or a new array
+ */
+pybind11::array_t<Count>
+prepare_counts(const pybind11::object &out,
+               const std::vector<pybind11::ssize_t> &shape) {
+    if (out.is_none()) {
+        return pybind11::array_t<Count, pybind11::array::c_style>{shape};
     }
 
-    auto size = buffer_xs.shape.at(0);
-    const SourceType *src = static_cast<const SourceType *>(buffer_xs.ptr);
-    Count *dst = static_cast<Count *>(buffer_counts.ptr);
-    for (decltype(size) i{0}; i < size; ++i) {
-        const auto value = src[i];
-#ifdef __GNUC__
-        const auto count = static_cast<Count>(__builtin_popcountll(value));
-#else
-#error Use an alternative of __builtin_popcountll
-#endif
-        dst[i] = count;
+    // Do not convert out because we must write to the array itself.
+    // Kernels write to views at strides.
+    if (!pybind11::isinstance<pybind11::array>(out)) {
+        throw pybind11::type_error("out must be a numpy.ndarray");
+    }
+    const auto counts = pybind11::reinterpret_borrow<pybind11::array>(out);
+    if (!counts.dtype().is(pybind11::dtype::of<Count>()) ||
+        (counts.ndim() != 1) || (counts.shape(0) != shape.at(0)) ||
+        !counts.writeable()) {
+        throw pybind11::value_error(
+            "out must be a writable 1-D uint8 array as long as xs");
+    }
+    return pybind11::reinterpret_borrow<pybind11::array_t<Count>>(out);
+}
+
+/**
+ * @tparam SourceType The type of xs elements
+ * @param[in] xs An integer array which can be a view at any strides
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or an array to write counts
+ * @return The number of 1's of each element in xs
+ */
+template <typename SourceType>
+pybind11::array_t<Count> popcount_cpp_impl(const pybind11::array &xs,
+                                           size_t threads,
+                                           const pybind11::object &out) {
+    if (xs.itemsize() != sizeof(SourceType)) {
+        throw std::runtime_error("Unsupported array element types");
+    }
+    check_dimension(xs);
+
+    // Read views such as xs[::2] and columns of structured arrays in place
+    auto counts = prepare_counts(out, {xs.shape(0)});
+    const auto size = static_cast<size_t>(xs.shape(0));
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const auto dst_stride = static_cast<ptrdiff_t>(counts.strides(0));
+    const void *src = xs.data();
+    Count *dst = counts.mutable_data();
+    if (size < Small_Array_Size) {
+        popcount_strided_kernel<SourceType>(src, src_stride, size, dst,
+                                            dst_stride);
+        return counts;
+    }
+    {
+        // Other Python threads run while counting
+        pybind11::gil_scoped_release release;
+        popcount_strided_kernel<SourceType>(src, src_stride, size, dst,
+                                            dst_stride, threads);
+    }
+    return counts;
+}
+
+/**
+ * Converts xs as forcecast does and counts it
+ * @tparam SourceType The type to convert xs elements to
+ * @param[in] xs_object An object convertible to a 1-D array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or an array to write counts
+ * @return The number of 1's of each element in xs_object
+ */
+template <typename SourceType>
+pybind11::array_t<Count>
+popcount_cpp_forcecast(const pybind11::object &xs_object, size_t threads,
+                       const pybind11::object &out) {
+    using DenseArray =
+        pybind11::array_t<SourceType, pybind11::array::c_style |
+                                          pybind11::array::forcecast>;
+    const auto xs = DenseArray::ensure(xs_object);
+    if (!xs) {
+        throw pybind11::type_error(Type_Error_Message);
     }
+    const popcount_core::StatsScope stats(get_kernel_variant(),
+                                          static_cast<size_t>(xs.nbytes()),
+                                          !xs.is(xs_object));
+    return popcount_cpp_impl<SourceType>(xs, threads, out);
+}
+
+pybind11::array_t<uint8_t> popcount_cpp_uint8(pybind11::object xs,
+                                              size_t threads,
+                                              pybind11::object out) {
+    return popcount_cpp_forcecast<uint8_t>(xs, threads, out);
+}
+
+pybind11::array_t<uint8_t> popcount_cpp_uint64(pybind11::object xs,
+                                               size_t threads,
+                                               pybind11::object out) {
+    return popcount_cpp_forcecast<uint64_t>(xs, threads, out);
+}
+
+using PopcountFunction = pybind11::array_t<Count> (*)(
+    const pybind11::array &, size_t, const pybind11::object &);
+
+// Integers of the same width share kernels and bool is stored in a byte
+constexpr std::array<ElementType<PopcountFunction>, 9> Popcount_Functions{{
+    {'b', 1, &popcount_cpp_impl<bool>},
+    {'i', 1, &popcount_cpp_impl<int8_t>},
+    {'u', 1, &popcount_cpp_impl<uint8_t>},
+    {'i', 2, &popcount_cpp_impl<int16_t>},
+    {'u', 2, &popcount_cpp_impl<uint16_t>},
+    {'i', 4, &popcount_cpp_impl<int32_t>},
+    {'u', 4, &popcount_cpp_impl<uint32_t>},
+    {'i', 8, &popcount_cpp_impl<int64_t>},
+    {'u', 8, &popcount_cpp_impl<uint64_t>},
+}};
+
+/**
+ * Counts a short 1-D buffer without dtype objects and the GIL release
+ * @tparam SourceType The type of elements in view
+ * @param[in] view A 1-D buffer shorter than Small_Array_Size
+ * @return The number of 1's of each element in view
+ */
+template <typename SourceType>
+pybind11::array_t<Count> popcount_small_impl(const Py_buffer &view) {
+    const auto size = view.shape[0];
+    pybind11::array_t<Count> counts(size);
+    popcount_strided_kernel<SourceType>(
+        view.buf, static_cast<ptrdiff_t>(view.strides[0]),
+        static_cast<size_t>(size), counts.mutable_data(), 1);
     return counts;
 }
 
-pybind11::array_t<uint8_t>
-popcount_cpp_uint8(pybind11::array_t<uint8_t, pybind11::array::c_style |
-                                                  pybind11::array::forcecast>
-                       xs) {
-    return popcount_cpp_impl<uint8_t>(xs);
+using SmallPopcountFunction = pybind11::array_t<Count> (*)(const Py_buffer &);
+
+constexpr std::array<ElementType<SmallPopcountFunction>, 9>
+    Small_Popcount_Functions{{
+        {'b', 1, &popcount_small_impl<bool>},
+        {'i', 1, &popcount_small_impl<int8_t>},
+        {'u', 1, &popcount_small_impl<uint8_t>},
+        {'i', 2, &popcount_small_impl<int16_t>},
+        {'u', 2, &popcount_small_impl<uint16_t>},
+        {'i', 4, &popcount_small_impl<int32_t>},
+        {'u', 4, &popcount_small_impl<uint32_t>},
+        {'i', 8, &popcount_small_impl<int64_t>},
+        {'u', 8, &popcount_small_impl<uint64_t>},
+    }};
+
+pybind11::array_t<uint8_t> popcount_cpp(pybind11::object xs, size_t threads,
+                                        pybind11::object out) {
+    // Short buffers skip conversion to arrays and dtype objects. NumPy
+    // converts bytes to a string scalar and not to an array of its buffer.
+    if (out.is_none() && pybind11::isinstance<pybind11::buffer>(xs) &&
+        !pybind11::isinstance<pybind11::bytes>(xs)) {
+        const BufferView buffer(xs);
+        const auto &view = buffer.view();
+        if (buffer.valid() && (view.ndim == 1) &&
+            (static_cast<size_t>(view.shape[0]) < Small_Array_Size)) {
+            const auto function =
+                find_function(Small_Popcount_Functions,
+                              buffer_kind(view.format), view.itemsize);
+            if (function) {
+                const popcount_core::StatsScope stats(
+                    get_kernel_variant(), static_cast<size_t>(view.len),
+                    false);
+                return function(view);
+            }
+        }
+    }
+
+    if (pybind11::isinstance<pybind11::array>(xs)) {
+        const auto array = pybind11::reinterpret_borrow<pybind11::array>(xs);
+        if (array.ndim() != 1) {
+            throw pybind11::value_error(Type_Error_Message);
+        }
+        if (array.shape(0) == 0) {
+            // Any element types are acceptable for empty 1-D arrays
+            const popcount_core::StatsScope stats(get_kernel_variant(), 0,
+                                                  false);
+            return prepare_counts(out, {0});
+        }
+    }
+
+    const auto array = to_array(xs);
+    const auto function = find_function(Popcount_Functions, array.dtype());
+    if (function) {
+        const popcount_core::StatsScope stats(
+            get_kernel_variant(), static_cast<size_t>(array.nbytes()),
+            !array.is(xs));
+        return function(array, threads, out);
+    }
+    // Convert others such as floating point numbers
+    const auto converted = to_uint64_array(array);
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(), static_cast<size_t>(converted.nbytes()), true);
+    return popcount_cpp_impl<uint64_t>(converted, threads, out);
+}
+
+/**
+ * @tparam SourceType The type of xs elements
+ * @param[in] xs An integer array of any dimensions and strides
+ * @param[in] axis An axis of xs to sum along
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The number of 1's in each line along the axis
+ */
+template <typename SourceType>
+pybind11::array_t<uint64_t> popcount_total_axis_impl(const pybind11::array &xs,
+                                                     size_t axis,
+                                                     size_t threads) {
+    if (xs.itemsize() != sizeof(SourceType)) {
+        throw std::runtime_error("Unsupported array element types");
+    }
+
+    // Read lines in place and sum counts without writing them
+    LineView view{xs.data(), {}, {}, static_cast<size_t>(xs.shape(axis)),
+                  static_cast<ptrdiff_t>(xs.strides(axis))};
+    std::vector<pybind11::ssize_t> shape;
+    const auto ndim = static_cast<size_t>(xs.ndim());
+    for (size_t dim{0}; dim < ndim; ++dim) {
+        if (dim != axis) {
+            shape.push_back(xs.shape(dim));
+            view.outer_shape.push_back(static_cast<size_t>(xs.shape(dim)));
+            view.outer_strides.push_back(
+                static_cast<ptrdiff_t>(xs.strides(dim)));
+        }
+    }
+
+    pybind11::array_t<uint64_t, pybind11::array::c_style> totals{shape};
+    uint64_t *dst = totals.mutable_data();
+    {
+        // Other Python threads run while counting
+        pybind11::gil_scoped_release release;
+        popcount_total_lines_kernel<SourceType>(view, dst, threads);
+    }
+    return totals;
+}
+
+using PopcountTotalAxisFunction =
+    pybind11::array_t<uint64_t> (*)(const pybind11::array &, size_t, size_t);
+
+// Choose element types as popcount_cpp does
+constexpr std::array<ElementType<PopcountTotalAxisFunction>, 9>
+    Popcount_Total_Axis_Functions{{
+        {'b', 1, &popcount_total_axis_impl<bool>},
+        {'i', 1, &popcount_total_axis_impl<int8_t>},
+        {'u', 1, &popcount_total_axis_impl<uint8_t>},
+        {'i', 2, &popcount_total_axis_impl<int16_t>},
+        {'u', 2, &popcount_total_axis_impl<uint16_t>},
+        {'i', 4, &popcount_total_axis_impl<int32_t>},
+        {'u', 4, &popcount_total_axis_impl<uint32_t>},
+        {'i', 8, &popcount_total_axis_impl<int64_t>},
+        {'u', 8, &popcount_total_axis_impl<uint64_t>},
+    }};
+
+/**
+ * @param[in] xs An array of one or more dimensions
+ * @param[in] axis An axis of xs to sum along
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The number of 1's in each line along the axis
+ */
+pybind11::array_t<uint64_t> popcount_total_axis(const pybind11::array &xs,
+                                                size_t axis, size_t threads) {
+    const auto function =
+        find_function(Popcount_Total_Axis_Functions, xs.dtype());
+    if (function) {
+        return function(xs, axis, threads);
+    }
+    return popcount_total_axis_impl<uint64_t>(to_uint64_array(xs), axis,
+                                              threads);
+}
+
+uint64_t popcount_total_cpp(pybind11::object xs_object, size_t threads) {
+    const auto xs = to_array(xs_object);
+    check_not_scalar(xs);
+    // popcount_total_axis() converts arrays which it has no kernels for
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(), static_cast<size_t>(xs.nbytes()),
+        !xs.is(xs_object) ||
+            !find_function(Popcount_Total_Axis_Functions, xs.dtype()));
+
+    // Zero extension to uint64_t keeps the number of 1's of unsigned
+    // integers and we count them in their own buffer
+    const auto kind = xs.dtype().kind();
+    const bool is_unsigned = (kind == 'u') || (kind == 'b');
+    if (is_unsigned && (xs.flags() & pybind11::array::c_style)) {
+        const auto size = static_cast<size_t>(xs.nbytes());
+        const void *src = xs.data();
+        // Other Python threads run while counting
+        pybind11::gil_scoped_release release;
+        return popcount_total_kernel(src, size, threads);
+    }
+
+    // Sum lines along the last axis of others in place
+    const auto totals = popcount_total_axis(
+        xs, static_cast<size_t>(xs.ndim() - 1), threads);
+    const auto *partials = totals.data();
+    uint64_t total{0};
+    for (pybind11::ssize_t index{0}; index < totals.size(); ++index) {
+        total += partials[index];
+    }
+    return total;
+}
+
+pybind11::array_t<uint64_t> popcount_total_axis_cpp(pybind11::object xs_object,
+                                                    pybind11::ssize_t axis,
+                                                    size_t threads) {
+    const auto xs = to_array(xs_object);
+    check_not_scalar(xs);
+
+    // Negative axes count from the last as NumPy does
+    const auto ndim = xs.ndim();
+    if ((axis < -ndim) || (axis >= ndim)) {
+        throw pybind11::value_error("axis is out of range");
+    }
+    const auto normalized = static_cast<size_t>((axis < 0) ? (axis + ndim)
+                                                           : axis);
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(), static_cast<size_t>(xs.nbytes()),
+        !xs.is(xs_object) ||
+            !find_function(Popcount_Total_Axis_Functions, xs.dtype()));
+    return popcount_total_axis(xs, normalized, threads);
+}
+
+/**
+ * @tparam SourceType The type of xs elements
+ * @param[in] xs A 1-D integer array which can be a view at any strides
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The numbers of elements which have 0, 1, ... 1's
+ */
+template <typename SourceType>
+pybind11::array_t<uint64_t> popcount_histogram_impl(const pybind11::array &xs,
+                                                    size_t threads) {
+    if (xs.itemsize() != sizeof(SourceType)) {
+        throw std::runtime_error("Unsupported array element types");
+    }
+
+    constexpr auto n_bins =
+        static_cast<pybind11::ssize_t>(popcount_histogram_bins<SourceType>());
+    pybind11::array_t<uint64_t, pybind11::array::c_style> bins{n_bins};
+    uint64_t *dst = bins.mutable_data();
+    std::fill(dst, dst + n_bins, 0);
+    const auto size = static_cast<size_t>(xs.shape(0));
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const void *src = xs.data();
+    {
+        // Other Python threads run while counting
+        pybind11::gil_scoped_release release;
+        popcount_histogram_kernel<SourceType>(src, src_stride, size, dst,
+                                              threads);
+    }
+    return bins;
+}
+
+using PopcountHistogramFunction =
+    pybind11::array_t<uint64_t> (*)(const pybind11::array &, size_t);
+
+// Choose element types as popcount_cpp does
+constexpr std::array<ElementType<PopcountHistogramFunction>, 9>
+    Popcount_Histogram_Functions{{
+        {'b', 1, &popcount_histogram_impl<bool>},
+        {'i', 1, &popcount_histogram_impl<int8_t>},
+        {'u', 1, &popcount_histogram_impl<uint8_t>},
+        {'i', 2, &popcount_histogram_impl<int16_t>},
+        {'u', 2, &popcount_histogram_impl<uint16_t>},
+        {'i', 4, &popcount_histogram_impl<int32_t>},
+        {'u', 4, &popcount_histogram_impl<uint32_t>},
+        {'i', 8, &popcount_histogram_impl<int64_t>},
+        {'u', 8, &popcount_histogram_impl<uint64_t>},
+    }};
+
+pybind11::array_t<uint64_t> popcount_histogram_cpp(pybind11::object xs_object,
+                                                   size_t threads) {
+    auto xs = to_array(xs_object);
+    check_not_scalar(xs);
+    bool copied = !xs.is(xs_object);
+
+    // Read 1-D views in place and flatten others as views if possible
+    if (xs.ndim() != 1) {
+        const pybind11::array flat =
+            pybind11::module_::import("numpy").attr("ravel")(xs);
+        copied = copied || (flat.data() != xs.data());
+        xs = flat;
+    }
+    const auto function = find_function(Popcount_Histogram_Functions,
+                                        xs.dtype());
+    const popcount_core::StatsScope stats(get_kernel_variant(),
+                                          static_cast<size_t>(xs.nbytes()),
+                                          copied || !function);
+    if (function) {
+        return function(xs, threads);
+    }
+    return popcount_histogram_impl<uint64_t>(to_uint64_array(xs), threads);
+}
+
+// Choose element types as popcount_cpp does
+constexpr std::array<ElementType<ViewKernel>, 9> Popcount_Many_Kernels{{
+    {'b', 1, &popcount_strided_kernel<bool>},
+    {'i', 1, &popcount_strided_kernel<int8_t>},
+    {'u', 1, &popcount_strided_kernel<uint8_t>},
+    {'i', 2, &popcount_strided_kernel<int16_t>},
+    {'u', 2, &popcount_strided_kernel<uint16_t>},
+    {'i', 4, &popcount_strided_kernel<int32_t>},
+    {'u', 4, &popcount_strided_kernel<uint32_t>},
+    {'i', 8, &popcount_strided_kernel<int64_t>},
+    {'u', 8, &popcount_strided_kernel<uint64_t>},
+}};
+
+pybind11::object popcount_many_cpp(pybind11::object xs_list, size_t threads,
+                                   bool concatenate) {
+    // Keep converted arrays until counting ends
+    std::vector<pybind11::array> arrays;
+    std::vector<ManyView> views;
+    size_t total{0};
+    size_t n_bytes{0};
+    bool copied{false};
+    for (const auto item : xs_list) {
+        auto array =
+            to_array(pybind11::reinterpret_borrow<pybind11::object>(item));
+        if (array.ndim() != 1) {
+            throw pybind11::value_error("xs_list must contain 1-D arrays");
+        }
+        auto kernel = find_function(Popcount_Many_Kernels, array.dtype());
+        if (!kernel) {
+            // Convert others such as floating point numbers
+            array = to_uint64_array(array);
+            kernel = &popcount_strided_kernel<uint64_t>;
+        }
+        copied = copied || !array.is(item);
+        n_bytes += static_cast<size_t>(array.nbytes());
+
+        const auto size = static_cast<size_t>(array.shape(0));
+        views.push_back(ManyView{kernel, array.data(),
+                                 static_cast<ptrdiff_t>(array.strides(0)),
+                                 size, static_cast<size_t>(array.itemsize()),
+                                 nullptr});
+        arrays.push_back(std::move(array));
+        total += size;
+    }
+
+    pybind11::object result;
+    if (concatenate) {
+        pybind11::array_t<Count> counts(static_cast<pybind11::ssize_t>(total));
+        pybind11::array_t<uint64_t> offsets(
+            static_cast<pybind11::ssize_t>(views.size() + 1));
+        auto *dst = counts.mutable_data();
+        auto *offset_data = offsets.mutable_data();
+        size_t offset{0};
+        for (size_t index{0}; index < views.size(); ++index) {
+            offset_data[index] = offset;
+            views[index].dst = dst + offset;
+            offset += views[index].size;
+        }
+        offset_data[views.size()] = offset;
+        result = pybind11::make_tuple(counts, offsets);
+    } else {
+        pybind11::list counts_list(views.size());
+        for (size_t index{0}; index < views.size(); ++index) {
+            pybind11::array_t<Count> counts(
+                static_cast<pybind11::ssize_t>(views[index].size));
+            views[index].dst = counts.mutable_data();
+            counts_list[index] = counts;
+        }
+        result = counts_list;
+    }
+
+    // Record a batch as a call
+    const popcount_core::StatsScope stats(get_kernel_variant(), n_bytes,
+                                          copied);
+    // Releasing the GIL once per batch costs less than once per array
+    if (total < Small_Array_Size) {
+        popcount_many_kernel(views, 1);
+    } else {
+        pybind11::gil_scoped_release release;
+        popcount_many_kernel(views, threads);
+    }
+    return result;
+}
+
+pybind11::array hamming_cdist_cpp(pybind11::object xs_object,
+                                  pybind11::object ys_object,
+                                  const std::string &metric, size_t threads) {
+    const bool jaccard = is_jaccard(metric);
+    const auto xs_codes = to_code_array(xs_object);
+    const auto ys_codes = to_code_array(ys_object);
+    const auto xs = to_code_matrix(xs_codes);
+    const auto ys = to_code_matrix(ys_codes);
+    if (xs.row_bytes != ys.row_bytes) {
+        throw pybind11::value_error("rows of xs and ys must be as long");
+    }
+
+    const std::vector<pybind11::ssize_t> shape{xs_codes.shape(0),
+                                               ys_codes.shape(0)};
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(),
+        static_cast<size_t>(xs_codes.nbytes() + ys_codes.nbytes()),
+        !xs_codes.is(xs_object) || !ys_codes.is(ys_object));
+    if (jaccard) {
+        pybind11::array_t<double, pybind11::array::c_style> distances{shape};
+        auto *dst = distances.mutable_data();
+        {
+            // Other Python threads run while computing
+            pybind11::gil_scoped_release release;
+            jaccard_cdist_kernel(xs, ys, dst, threads);
+        }
+        return distances;
+    }
+
+    pybind11::array_t<uint32_t, pybind11::array::c_style> distances{shape};
+    auto *dst = distances.mutable_data();
+    {
+        pybind11::gil_scoped_release release;
+        hamming_cdist_kernel(xs, ys, dst, threads);
+    }
+    return distances;
+}
+
+pybind11::array hamming_pdist_cpp(pybind11::object xs_object,
+                                  const std::string &metric, size_t threads,
+                                  bool condensed) {
+    const bool jaccard = is_jaccard(metric);
+    const auto xs_codes = to_code_array(xs_object);
+    const auto xs = to_code_matrix(xs_codes);
+
+    // The shape of scipy.spatial.distance.pdist or squareform
+    const auto n = xs_codes.shape(0);
+    const auto shape =
+        condensed ? std::vector<pybind11::ssize_t>{n * (n - 1) / 2}
+                  : std::vector<pybind11::ssize_t>{n, n};
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(), static_cast<size_t>(xs_codes.nbytes()),
+        !xs_codes.is(xs_object));
+    if (jaccard) {
+        pybind11::array_t<double, pybind11::array::c_style> distances{shape};
+        auto *dst = distances.mutable_data();
+        {
+            // Other Python threads run while computing
+            pybind11::gil_scoped_release release;
+            jaccard_pdist_kernel(xs, condensed, dst, threads);
+        }
+        return distances;
+    }
+
+    pybind11::array_t<uint32_t, pybind11::array::c_style> distances{shape};
+    auto *dst = distances.mutable_data();
+    {
+        pybind11::gil_scoped_release release;
+        hamming_pdist_kernel(xs, condensed, dst, threads);
+    }
+    return distances;
+}
+
+pybind11::tuple hamming_topk_cpp(pybind11::object queries_object,
+                                 pybind11::object database_object, size_t k,
+                                 size_t threads) {
+    const auto queries_codes = to_code_array(queries_object);
+    const auto database_codes = to_code_array(database_object);
+    const auto queries = to_code_matrix(queries_codes);
+    const auto database = to_code_matrix(database_codes);
+    if (queries.row_bytes != database.row_bytes) {
+        throw pybind11::value_error(
+            "rows of queries and database must be as long");
+    }
+
+    // Return all rows of a small database
+    const auto n_neighbours = std::min(k, database.rows);
+    const std::vector<pybind11::ssize_t> shape{
+        queries_codes.shape(0),
+        static_cast<pybind11::ssize_t>(n_neighbours)};
+    pybind11::array_t<uint32_t, pybind11::array::c_style> distances{shape};
+    pybind11::array_t<int64_t, pybind11::array::c_style> indexes{shape};
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(),
+        static_cast<size_t>(queries_codes.nbytes() + database_codes.nbytes()),
+        !queries_codes.is(queries_object) ||
+            !database_codes.is(database_object));
+    auto *distances_dst = distances.mutable_data();
+    auto *indexes_dst = indexes.mutable_data();
+    {
+        // Other Python threads run while searching
+        pybind11::gil_scoped_release release;
+        hamming_topk_kernel(queries, database, n_neighbours, distances_dst,
+                            indexes_dst, threads);
+    }
+    return pybind11::make_tuple(distances, indexes);
+}
+
+/**
+ * @tparam SourceType The type of elements in a file
+ * @param[in] src Elements in a file
+ * @param[in] total Whether to return the total number of 1's
+ * @param[in] out None or the path of a file to write counts
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total, an array of counts or None as popcount_file_cpp()
+ */
+template <typename SourceType>
+pybind11::object popcount_file_impl(const FileRange &src, bool total,
+                                    const pybind11::object &out,
+                                    size_t threads) {
+    if (total) {
+        uint64_t count{0};
+        {
+            pybind11::gil_scoped_release release;
+            count = popcount_file_total_kernel<SourceType>(src, threads);
+        }
+        return pybind11::int_(count);
+    }
+
+    if (out.is_none()) {
+        pybind11::array_t<Count> counts(
+            static_cast<pybind11::ssize_t>(src.size));
+        auto *dst = counts.mutable_data();
+        {
+            pybind11::gil_scoped_release release;
+            popcount_file_kernel<SourceType>(src, dst, threads);
+        }
+        return counts;
+    }
+
+    const auto dst_path = out.cast<std::string>();
+    {
+        pybind11::gil_scoped_release release;
+        popcount_file_kernel<SourceType>(src, dst_path, threads);
+    }
+    return pybind11::none();
+}
+
+using PopcountFileFunction = pybind11::object (*)(const FileRange &, bool,
+                                                  const pybind11::object &,
+                                                  size_t);
+
+// Files of bools may hold bytes other than 0 and 1
+constexpr std::array<ElementType<PopcountFileFunction>, 8>
+    Popcount_File_Functions{{
+        {'i', 1, &popcount_file_impl<int8_t>},
+        {'u', 1, &popcount_file_impl<uint8_t>},
+        {'i', 2, &popcount_file_impl<int16_t>},
+        {'u', 2, &popcount_file_impl<uint16_t>},
+        {'i', 4, &popcount_file_impl<int32_t>},
+        {'u', 4, &popcount_file_impl<uint32_t>},
+        {'i', 8, &popcount_file_impl<int64_t>},
+        {'u', 8, &popcount_file_impl<uint64_t>},
+    }};
+
+pybind11::object popcount_file_cpp(const std::string &path, uint64_t offset,
+                                   uint64_t length,
+                                   pybind11::object dtype_object, bool total,
+                                   pybind11::object out, size_t threads) {
+    const auto dtype = pybind11::dtype::from_args(dtype_object);
+    const auto function = find_function(Popcount_File_Functions, dtype);
+    if (!function) {
+        throw pybind11::type_error("dtype must be a native integer type");
+    }
+    // Mapped files are read in place
+    const popcount_core::StatsScope stats(
+        get_kernel_variant(),
+        static_cast<size_t>(length * static_cast<uint64_t>(dtype.itemsize())),
+        false);
+    return function(FileRange{path, offset, length}, total, out, threads);
+}
+
+std::unique_ptr<RankSelectBitvector>
+make_rank_select_bitvector(pybind11::object bits_object,
+                           pybind11::object size_object) {
+    auto bits = to_array(bits_object);
+    pybind11::ssize_t capacity = 0;
+    if (bits.dtype().kind() == 'b') {
+        // Pack bools in the flat order
+        capacity = bits.size();
+        bits = pybind11::module_::import("numpy").attr("packbits")(
+            bits, pybind11::arg("bitorder") = "little");
+    } else if ((bits.dtype().kind() == 'u') || (bits.dtype().kind() == 'i')) {
+        bits = pybind11::module_::import("numpy").attr("ascontiguousarray")(
+            bits);
+        capacity = bits.nbytes() * 8;
+    } else {
+        throw pybind11::type_error("bits must be a bool or integer array");
+    }
+
+    auto size = capacity;
+    if (!size_object.is_none()) {
+        size = size_object.cast<pybind11::ssize_t>();
+        if ((size < 0) || (size > capacity)) {
+            throw pybind11::value_error("size is out of range");
+        }
+    }
+
+    std::unique_ptr<RankSelectBitvector> bitvector;
+    const auto *data = bits.data();
+    {
+        pybind11::gil_scoped_release release;
+        bitvector = std::make_unique<RankSelectBitvector>(
+            data, static_cast<size_t>(size), get_kernel_variant());
+    }
+    return bitvector;
+}
+
+pybind11::object rank_select_rank_cpp(const RankSelectBitvector &bitvector,
+                                      pybind11::object indexes) {
+    return answer_queries(indexes, [&bitvector](uint64_t index) {
+        return bitvector.rank(static_cast<size_t>(index));
+    });
+}
+
+pybind11::object rank_select_select_cpp(const RankSelectBitvector &bitvector,
+                                        pybind11::object nths) {
+    return answer_queries(nths, [&bitvector](uint64_t nth) {
+        return static_cast<uint64_t>(bitvector.select(nth));
+    });
+}
+
+std::unique_ptr<PopcountStream> make_popcount_stream(pybind11::object dtype) {
+    if (dtype.is_none()) {
+        return std::make_unique<PopcountStream>();
+    }
+
+    // Byte orders do not change the numbers of 1's of elements
+    const auto element = pybind11::dtype::from_args(dtype);
+    if ((element.kind() != 'u') && (element.kind() != 'i')) {
+        throw pybind11::type_error("dtype must be None or an integer type");
+    }
+    // Signed elements are binned as popcount_histogram_cpp() bins them
+    return std::make_unique<PopcountStream>(
+        static_cast<size_t>(element.itemsize()), element.kind() == 'i');
+}
+
+void popcount_stream_update_cpp(PopcountStream &stream,
+                                pybind11::object data_object,
+                                size_t threads) {
+    const auto numpy = pybind11::module_::import("numpy");
+    pybind11::array data;
+    bool copied{false};
+    if (pybind11::isinstance<pybind11::array>(data_object)) {
+        // Read elements in the C order as tobytes() does
+        data = numpy.attr("ascontiguousarray")(data_object);
+        if (data.dtype().kind() == 'O') {
+            throw pybind11::type_error("data must not be an object array");
+        }
+        copied = data.data() !=
+                 pybind11::reinterpret_borrow<pybind11::array>(data_object)
+                     .data();
+    } else if (pybind11::isinstance<pybind11::buffer>(data_object)) {
+        data = numpy.attr("frombuffer")(data_object,
+                                        pybind11::arg("dtype") = "uint8");
+    } else {
+        throw pybind11::type_error(
+            "data must be a bytes-like object or a numpy.ndarray");
+    }
+
+    const auto *src = data.data();
+    const auto size = static_cast<size_t>(data.nbytes());
+    // Only arrays which are not C contiguous are copied and
+    // numpy.frombuffer() reads buffers in place
+    const popcount_core::StatsScope stats(get_kernel_variant(), size, copied);
+    {
+        pybind11::gil_scoped_release release;
+        stream.update(src, size, threads);
+    }
+}
+
+pybind11::array_t<uint64_t>
+popcount_stream_histogram_cpp(const PopcountStream &stream) {
+    if (stream.itemsize() == 0) {
+        throw pybind11::value_error(
+            "PopcountStream(dtype) counts histograms of elements");
+    }
+    const auto bins = stream.histogram();
+    pybind11::array_t<uint64_t> histogram{
+        static_cast<pybind11::ssize_t>(bins.size())};
+    std::copy(bins.begin(), bins.end(), histogram.mutable_data());
+    return histogram;
+}
+
+/**
+ Python objects which an asynchronous task holds until it finishes
+ */
+struct AsyncPopcountTask {
+    pybind11::object xs;
+    pybind11::object counts;
+    pybind11::object future;
+    std::function<void()> count;
+};
+
+/**
+ * @tparam SourceType The type of xs elements
+ * @param[in] xs An integer array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] copied Whether xs is a copy of the input to convert it
+ * @return A future which holds the number of 1's of each element in xs
+ */
+template <typename SourceType>
+pybind11::object popcount_async_impl(const pybind11::array &xs,
+                                     size_t threads, bool copied) {
+    pybind11::array_t<Count, pybind11::array::c_style> counts{xs.shape(0)};
+    const auto size = static_cast<size_t>(xs.shape(0));
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const void *src = xs.data();
+    Count *dst = counts.mutable_data();
+
+    auto task = std::make_shared<AsyncPopcountTask>();
+    task->xs = xs;
+    task->counts = counts;
+    task->future =
+        pybind11::module_::import("concurrent.futures").attr("Future")();
+    task->count = [=]() {
+        // Time counting in the executor and not submitting
+        const popcount_core::StatsScope stats(
+            get_kernel_variant(), size * sizeof(SourceType), copied);
+        popcount_strided_kernel<SourceType>(
+            src, src_stride, size, dst, static_cast<ptrdiff_t>(sizeof(Count)),
+            threads);
+    };
+    auto future = task->future;
+
+    popcount_core::AsyncExecutor::instance().submit([task]() {
+        // Count without the GIL and set the result with it. Exceptions
+        // must not escape the worker and go to the future instead.
+        std::exception_ptr error;
+        try {
+            task->count();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        pybind11::gil_scoped_acquire acquire;
+        try {
+            if (task->future.attr("set_running_or_notify_cancel")()
+                    .cast<bool>()) {
+                if (error) {
+                    task->future.attr("set_exception")(
+                        to_python_exception(error));
+                } else {
+                    task->future.attr("set_result")(task->counts);
+                }
+            }
+        } catch (const pybind11::error_already_set &) {
+            // Nobody can receive the error
+        }
+        // Release the objects with the GIL
+        task->xs = pybind11::object();
+        task->counts = pybind11::object();
+        task->future = pybind11::object();
+    });
+    return future;
+}
+
+using PopcountAsyncFunction = pybind11::object (*)(const pybind11::array &,
+                                                   size_t, bool);
+
+// Choose element types as popcount_cpp does
+constexpr std::array<ElementType<PopcountAsyncFunction>, 9>
+    Popcount_Async_Functions{{
+        {'b', 1, &popcount_async_impl<bool>},
+        {'i', 1, &popcount_async_impl<int8_t>},
+        {'u', 1, &popcount_async_impl<uint8_t>},
+        {'i', 2, &popcount_async_impl<int16_t>},
+        {'u', 2, &popcount_async_impl<uint16_t>},
+        {'i', 4, &popcount_async_impl<int32_t>},
+        {'u', 4, &popcount_async_impl<uint32_t>},
+        {'i', 8, &popcount_async_impl<int64_t>},
+        {'u', 8, &popcount_async_impl<uint64_t>},
+    }};
+
+pybind11::object popcount_async_cpp(pybind11::object xs_object,
+                                    size_t threads) {
+    const auto xs = to_array(xs_object);
+    check_dimension(xs);
+
+    const auto function = find_function(Popcount_Async_Functions, xs.dtype());
+    if (function) {
+        return function(xs, threads, !xs.is(xs_object));
+    }
+    return popcount_async_impl<uint64_t>(to_uint64_array(xs), threads, true);
+}
+
+namespace {
+/**
+ * @param[in] value A count or a ratio which can be NaN
+ * @return value or None if the host did not count it
+ */
+pybind11::object to_optional(double value) {
+    if (std::isnan(value)) {
+        return pybind11::none();
+    }
+    return pybind11::float_(value);
+}
+} // namespace
+
+pybind11::dict profile_popcount_cpp(pybind11::object xs_object,
+                                    size_t repeat) {
+    if (repeat == 0) {
+        throw pybind11::value_error("repeat must be a positive integer");
+    }
+    auto xs = to_array(xs_object);
+    check_dimension(xs);
+    auto kernel = find_function(Popcount_Many_Kernels, xs.dtype());
+    if (!kernel) {
+        xs = to_uint64_array(xs);
+        kernel = &popcount_strided_kernel<uint64_t>;
+    }
+
+    const auto size = static_cast<size_t>(xs.shape(0));
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const void *src = xs.data();
+    std::vector<Count> dst(size);
+    popcount_core::PerfSample sample;
+    std::chrono::duration<double> elapsed{0.0};
+    {
+        // Count on this thread which the counters measure
+        pybind11::gil_scoped_release release;
+        popcount_core::PerfCounters counters;
+        // Warm up caches and page tables of dst
+        kernel(src, src_stride, size, dst.data(), sizeof(Count));
+        const auto start = std::chrono::steady_clock::now();
+        counters.start();
+        for (size_t count{0}; count < repeat; ++count) {
+            kernel(src, src_stride, size, dst.data(), sizeof(Count));
+        }
+        sample = counters.stop();
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    const auto n_bytes = size * static_cast<size_t>(xs.itemsize()) * repeat;
+    pybind11::dict profile;
+    profile["variant"] = get_kernel_variant_name();
+    profile["bytes"] = n_bytes;
+    profile["seconds"] = elapsed.count();
+    profile["available"] = sample.available();
+    for (size_t index{0}; index < popcount_core::Number_Of_Perf_Events;
+         ++index) {
+        profile[popcount_core::Perf_Event_Names.at(index)] = to_optional(
+            sample.value(static_cast<popcount_core::PerfEvent>(index)));
+    }
+    profile["cycles_per_byte"] = to_optional(sample.cycles_per_byte(n_bytes));
+    profile["ipc"] = to_optional(sample.ipc());
+    return profile;
+}
+
+pybind11::dict stats_cpp() {
+    const auto snapshot = popcount_core::get_stats();
+    pybind11::dict variants;
+    for (size_t index{0}; index < popcount_core::Number_Of_Variants;
+         ++index) {
+        variants[popcount_core::Kernel_Variant_Names.at(index)] =
+            snapshot.variant_calls.at(index);
+    }
+    pybind11::list histogram;
+    for (const auto count : snapshot.latency_histogram) {
+        histogram.append(count);
+    }
+
+    pybind11::dict stats;
+    stats["enabled"] = popcount_core::Stats_Enabled;
+    stats["calls"] = snapshot.calls;
+    stats["bytes"] = snapshot.bytes;
+    stats["copies"] = snapshot.copies;
+    stats["timed_calls"] = snapshot.timed_calls;
+    stats["seconds"] = static_cast<double>(snapshot.nanoseconds) * 1e-9;
+    stats["variants"] = variants;
+    stats["latency_histogram"] = histogram;
+    return stats;
+}
+
+void reset_stats_cpp() {
+    popcount_core::reset_stats();
+}
+
+void shutdown_async_executor() {
+    // Do not start workers only to join them at exit
+    auto *executor = popcount_core::AsyncExecutor::started();
+    if (executor == nullptr) {
+        return;
+    }
+
+    // Let workers take the GIL to finish queued tasks
+    pybind11::gil_scoped_release release;
+    executor->shutdown();
+}
+
+std::string get_kernel_variant_name() {
+    return kernel_variant_name(get_kernel_variant());
 }
 
-pybind11::array_t<uint8_t>
-popcount_cpp_uint64(pybind11::array_t<uint64_t, pybind11::array::c_style |
-                                                    pybind11::array::forcecast>
-                        xs) {
-    return popcount_cpp_impl<uint64_t>(xs);
+void set_kernel_variant_name(const std::string &name) {
+    set_kernel_variant(parse_kernel_variant(name));
 }
 } // namespace py_cpp_sample
@@ -0,0 +1,1192 @@
+#include "popcount_kernel.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POPCOUNT_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#ifndef __GNUC__
+#error Use alternatives of __attribute__((target)) and __builtin_popcountll
+#endif
+
+namespace py_cpp_sample {
+namespace {
+using popcount_core::KernelDispatch;
+using popcount_core::load_element;
+using popcount_core::load_word;
+using popcount_core::popcount_and_scalar;
+using popcount_core::popcount_elements_scalar;
+using popcount_core::popcount_total_scalar;
+using popcount_core::ThreadPool;
+#ifdef POPCOUNT_KERNEL_X86
+using popcount_core::popcount_and_avx2;
+using popcount_core::popcount_and_avx512;
+using popcount_core::popcount_and_popcnt;
+using popcount_core::popcount_bytes_avx2;
+using popcount_core::popcount_elements_popcnt;
+using popcount_core::popcount_lanes_avx2;
+using popcount_core::popcount_total_avx2;
+using popcount_core::popcount_total_avx512;
+using popcount_core::popcount_total_popcnt;
+using popcount_core::popcount_uint64_avx2;
+using popcount_core::popcount_uint64_avx512;
+using popcount_core::popcount_uint8_avx2;
+using popcount_core::popcount_uint8_avx512;
+#endif // POPCOUNT_KERNEL_X86
+
+// Set this environment variable to force a kernel variant
+constexpr const char *Kernel_Variant_Env = "PY_CPP_SAMPLE_KERNEL";
+
+template <typename SourceType>
+using Kernel = void (*)(const SourceType *, size_t, Count *);
+
+// Reads elements at byte strides
+using StridedKernel = void (*)(const uint8_t *, ptrdiff_t, size_t, Count *,
+                               ptrdiff_t);
+
+/**
+ Kernels of a variant. Others share kernels of the same width.
+ */
+struct KernelSet {
+    Kernel<int8_t> popcount_int8;
+    Kernel<uint8_t> popcount_uint8;
+    Kernel<int16_t> popcount_int16;
+    Kernel<uint16_t> popcount_uint16;
+    Kernel<int32_t> popcount_int32;
+    Kernel<uint32_t> popcount_uint32;
+    Kernel<uint64_t> popcount_uint64;
+    uint64_t (*popcount_total)(const uint8_t *, size_t);
+    uint64_t (*popcount_and)(const uint8_t *, const uint8_t *, size_t);
+    StridedKernel strided_int8;
+    StridedKernel strided_uint8;
+    StridedKernel strided_int16;
+    StridedKernel strided_uint16;
+    StridedKernel strided_int32;
+    StridedKernel strided_uint32;
+    StridedKernel strided_uint64;
+};
+
+template <typename SourceType>
+void popcount_strided_scalar(const uint8_t *src, ptrdiff_t src_stride,
+                             size_t size, Count *dst, ptrdiff_t dst_stride) {
+    for (size_t i{0}; i < size; ++i) {
+        const auto index = static_cast<ptrdiff_t>(i);
+        const auto element = load_element<SourceType>(src + index * src_stride);
+        dst[index * dst_stride] =
+            static_cast<Count>(__builtin_popcountll(element));
+    }
+}
+
+#ifdef POPCOUNT_KERNEL_X86
+template <typename SourceType>
+__attribute__((target("popcnt"))) void
+popcount_strided_popcnt(const uint8_t *src, ptrdiff_t src_stride, size_t size,
+                        Count *dst, ptrdiff_t dst_stride) {
+    for (size_t i{0}; i < size; ++i) {
+        const auto index = static_cast<ptrdiff_t>(i);
+        const auto element = load_element<SourceType>(src + index * src_stride);
+        dst[index * dst_stride] =
+            static_cast<Count>(__builtin_popcountll(element));
+    }
+}
+
+__attribute__((target("avx2,popcnt"))) void
+popcount_avx2_int8(const int8_t *src, size_t size, Count *dst) {
+    constexpr size_t width = sizeof(__m256i);
+    const __m256i zero = _mm256_setzero_si256();
+    // Sign extension to 64 bits adds 56 1's to negative integers
+    const __m256i extension = _mm256_set1_epi8(56);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m256i xs =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i negative = _mm256_cmpgt_epi8(zero, xs);
+        const __m256i counts =
+            _mm256_add_epi8(popcount_bytes_avx2(xs),
+                            _mm256_and_si256(negative, extension));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), counts);
+    }
+    popcount_elements_popcnt(src + i, size - i, dst + i);
+}
+
+/**
+ * @tparam SourceType A 32 or 64-bit integer type
+ * @param[in] src A pointer to a view
+ * @param[in] offsets Offsets of 4 elements in bytes
+ * @return The elements which are sign-extended to 64 bits
+ */
+template <typename SourceType>
+__attribute__((target("avx2"))) inline __m256i
+gather_elements_avx2(const uint8_t *src, __m256i offsets) {
+    static_assert(sizeof(SourceType) >= sizeof(int32_t), "Too narrow");
+    if (sizeof(SourceType) == sizeof(int64_t)) {
+        return _mm256_i64gather_epi64(
+            reinterpret_cast<const long long *>(src), offsets, 1);
+    }
+    const __m128i xs =
+        _mm256_i64gather_epi32(reinterpret_cast<const int *>(src), offsets, 1);
+    return std::is_signed<SourceType>::value ? _mm256_cvtepi32_epi64(xs)
+                                             : _mm256_cvtepu32_epi64(xs);
+}
+
+// Gathers 32 and 64-bit elements which do not share cache lines
+template <typename SourceType>
+__attribute__((target("avx2,popcnt"))) void
+popcount_strided_avx2(const uint8_t *src, ptrdiff_t src_stride, size_t size,
+                      Count *dst, ptrdiff_t dst_stride) {
+    constexpr size_t width = sizeof(__m256i) / sizeof(uint64_t);
+    const __m256i step = _mm256_set1_epi64x(src_stride * width);
+    __m256i offsets = _mm256_setr_epi64x(0, src_stride, src_stride * 2,
+                                         src_stride * 3);
+    alignas(sizeof(__m256i)) uint64_t counts[width];
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m256i xs = gather_elements_avx2<SourceType>(src, offsets);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(counts),
+                           popcount_lanes_avx2(xs));
+        for (size_t lane{0}; lane < width; ++lane) {
+            dst[static_cast<ptrdiff_t>(i + lane) * dst_stride] =
+                static_cast<Count>(counts[lane]);
+        }
+        offsets = _mm256_add_epi64(offsets, step);
+    }
+
+    const auto index = static_cast<ptrdiff_t>(i);
+    popcount_strided_popcnt<SourceType>(src + index * src_stride, src_stride,
+                                        size - i, dst + index * dst_stride,
+                                        dst_stride);
+}
+
+#define POPCOUNT_TARGET_AVX512                                                 \
+    __attribute__((                                                            \
+        target("avx512f,avx512bw,avx512vpopcntdq,avx512bitalg,popcnt")))
+
+POPCOUNT_TARGET_AVX512 void popcount_avx512_int8(const int8_t *src,
+                                                 size_t size, Count *dst) {
+    constexpr size_t width = sizeof(__m512i);
+    const __m512i zero = _mm512_setzero_si512();
+    // Sign extension to 64 bits adds 56 1's to negative integers
+    const __m512i extension = _mm512_set1_epi8(56);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        const __m512i counts = _mm512_popcnt_epi8(xs);
+        _mm512_storeu_si512(
+            dst + i, _mm512_mask_add_epi8(counts,
+                                          _mm512_cmplt_epi8_mask(xs, zero),
+                                          counts, extension));
+    }
+
+    if (i < size) {
+        // Masked elements are 0 and not negative
+        const auto mask = static_cast<__mmask64>((1ull << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi8(mask, src + i);
+        const __m512i counts = _mm512_popcnt_epi8(xs);
+        _mm512_mask_storeu_epi8(
+            dst + i, mask,
+            _mm512_mask_add_epi8(counts, _mm512_cmplt_epi8_mask(xs, zero),
+                                 counts, extension));
+    }
+}
+
+/**
+ * @tparam SourceType int16_t or uint16_t
+ * @param[in] xs 32 integers
+ * @return The number of 1's of each integer after sign extension
+ */
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 inline __m512i popcount_lanes_avx512_16(__m512i xs) {
+    const __m512i counts = _mm512_popcnt_epi16(xs);
+    if (!std::is_signed<SourceType>::value) {
+        return counts;
+    }
+    const auto negative = _mm512_cmplt_epi16_mask(xs, _mm512_setzero_si512());
+    return _mm512_mask_add_epi16(counts, negative, counts,
+                                 _mm512_set1_epi16(48));
+}
+
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 void
+popcount_avx512_16(const SourceType *src, size_t size, Count *dst) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(SourceType);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        _mm512_mask_cvtepi16_storeu_epi8(
+            dst + i, 0xffffffff, popcount_lanes_avx512_16<SourceType>(xs));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask32>((1u << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi16(mask, src + i);
+        _mm512_mask_cvtepi16_storeu_epi8(
+            dst + i, mask, popcount_lanes_avx512_16<SourceType>(xs));
+    }
+}
+
+/**
+ * @tparam SourceType int32_t or uint32_t
+ * @param[in] xs 16 integers
+ * @return The number of 1's of each integer after sign extension
+ */
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 inline __m512i popcount_lanes_avx512_32(__m512i xs) {
+    const __m512i counts = _mm512_popcnt_epi32(xs);
+    if (!std::is_signed<SourceType>::value) {
+        return counts;
+    }
+    const auto negative = _mm512_cmplt_epi32_mask(xs, _mm512_setzero_si512());
+    return _mm512_mask_add_epi32(counts, negative, counts,
+                                 _mm512_set1_epi32(32));
+}
+
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 void
+popcount_avx512_32(const SourceType *src, size_t size, Count *dst) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(SourceType);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        _mm512_mask_cvtepi32_storeu_epi8(
+            dst + i, 0xffff, popcount_lanes_avx512_32<SourceType>(xs));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask16>((1u << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi32(mask, src + i);
+        _mm512_mask_cvtepi32_storeu_epi8(
+            dst + i, mask, popcount_lanes_avx512_32<SourceType>(xs));
+    }
+}
+
+/**
+ * @tparam SourceType A 32 or 64-bit integer type
+ * @param[in] src A pointer to a view
+ * @param[in] offsets Offsets of 8 elements in bytes
+ * @return The elements which are sign-extended to 64 bits
+ */
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 inline __m512i
+gather_elements_avx512(const uint8_t *src, __m512i offsets) {
+    static_assert(sizeof(SourceType) >= sizeof(int32_t), "Too narrow");
+    // Masked intrinsics avoid undefined registers which GCC warns about
+    if (sizeof(SourceType) == sizeof(int64_t)) {
+        return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xff,
+                                           offsets, src, 1);
+    }
+    const __m256i xs = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(),
+                                                   0xff, offsets, src, 1);
+    return std::is_signed<SourceType>::value
+               ? _mm512_maskz_cvtepi32_epi64(0xff, xs)
+               : _mm512_maskz_cvtepu32_epi64(0xff, xs);
+}
+
+template <typename SourceType>
+POPCOUNT_TARGET_AVX512 void
+popcount_strided_avx512(const uint8_t *src, ptrdiff_t src_stride, size_t size,
+                        Count *dst, ptrdiff_t dst_stride) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(uint64_t);
+    const __m512i step = _mm512_set1_epi64(src_stride * width);
+    __m512i offsets = _mm512_setr_epi64(
+        0, src_stride, src_stride * 2, src_stride * 3, src_stride * 4,
+        src_stride * 5, src_stride * 6, src_stride * 7);
+    alignas(sizeof(__m512i)) uint64_t counts[width];
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = gather_elements_avx512<SourceType>(src, offsets);
+        if (dst_stride == 1) {
+            _mm512_mask_cvtepi64_storeu_epi8(dst + i, 0xff,
+                                             _mm512_popcnt_epi64(xs));
+        } else {
+            _mm512_store_si512(counts, _mm512_popcnt_epi64(xs));
+            for (size_t lane{0}; lane < width; ++lane) {
+                dst[static_cast<ptrdiff_t>(i + lane) * dst_stride] =
+                    static_cast<Count>(counts[lane]);
+            }
+        }
+        offsets = _mm512_add_epi64(offsets, step);
+    }
+
+    const auto index = static_cast<ptrdiff_t>(i);
+    popcount_strided_popcnt<SourceType>(src + index * src_stride, src_stride,
+                                        size - i, dst + index * dst_stride,
+                                        dst_stride);
+}
+#undef POPCOUNT_TARGET_AVX512
+#endif // POPCOUNT_KERNEL_X86
+
+KernelDispatch<KernelSet> &kernel_dispatch() {
+    static const KernelDispatch<KernelSet>::Table kernel_sets{
+        KernelSet{popcount_elements_scalar<int8_t, Count>,
+                  popcount_elements_scalar<uint8_t, Count>,
+                  popcount_elements_scalar<int16_t, Count>,
+                  popcount_elements_scalar<uint16_t, Count>,
+                  popcount_elements_scalar<int32_t, Count>,
+                  popcount_elements_scalar<uint32_t, Count>,
+                  popcount_elements_scalar<uint64_t, Count>,
+                  popcount_total_scalar,
+                  popcount_and_scalar,
+                  popcount_strided_scalar<int8_t>,
+                  popcount_strided_scalar<uint8_t>,
+                  popcount_strided_scalar<int16_t>,
+                  popcount_strided_scalar<uint16_t>,
+                  popcount_strided_scalar<int32_t>,
+                  popcount_strided_scalar<uint32_t>,
+                  popcount_strided_scalar<uint64_t>},
+#ifdef POPCOUNT_KERNEL_X86
+        KernelSet{popcount_elements_popcnt<int8_t, Count>,
+                  popcount_elements_popcnt<uint8_t, Count>,
+                  popcount_elements_popcnt<int16_t, Count>,
+                  popcount_elements_popcnt<uint16_t, Count>,
+                  popcount_elements_popcnt<int32_t, Count>,
+                  popcount_elements_popcnt<uint32_t, Count>,
+                  popcount_elements_popcnt<uint64_t, Count>,
+                  popcount_total_popcnt,
+                  popcount_and_popcnt,
+                  popcount_strided_popcnt<int8_t>,
+                  popcount_strided_popcnt<uint8_t>,
+                  popcount_strided_popcnt<int16_t>,
+                  popcount_strided_popcnt<uint16_t>,
+                  popcount_strided_popcnt<int32_t>,
+                  popcount_strided_popcnt<uint32_t>,
+                  popcount_strided_popcnt<uint64_t>},
+        KernelSet{popcount_avx2_int8,
+                  popcount_uint8_avx2<Count>,
+                  popcount_elements_popcnt<int16_t, Count>,
+                  popcount_elements_popcnt<uint16_t, Count>,
+                  popcount_elements_popcnt<int32_t, Count>,
+                  popcount_elements_popcnt<uint32_t, Count>,
+                  popcount_uint64_avx2,
+                  popcount_total_avx2,
+                  popcount_and_avx2,
+                  popcount_strided_popcnt<int8_t>,
+                  popcount_strided_popcnt<uint8_t>,
+                  popcount_strided_popcnt<int16_t>,
+                  popcount_strided_popcnt<uint16_t>,
+                  popcount_strided_avx2<int32_t>,
+                  popcount_strided_avx2<uint32_t>,
+                  popcount_strided_avx2<uint64_t>},
+        KernelSet{popcount_avx512_int8,
+                  popcount_uint8_avx512<Count>,
+                  popcount_avx512_16<int16_t>,
+                  popcount_avx512_16<uint16_t>,
+                  popcount_avx512_32<int32_t>,
+                  popcount_avx512_32<uint32_t>,
+                  popcount_uint64_avx512,
+                  popcount_total_avx512,
+                  popcount_and_avx512,
+                  popcount_strided_popcnt<int8_t>,
+                  popcount_strided_popcnt<uint8_t>,
+                  popcount_strided_popcnt<int16_t>,
+                  popcount_strided_popcnt<uint16_t>,
+                  popcount_strided_avx512<int32_t>,
+                  popcount_strided_avx512<uint32_t>,
+                  popcount_strided_avx512<uint64_t>},
+#endif // POPCOUNT_KERNEL_X86
+    };
+    // Select a variant once at module load
+    static KernelDispatch<KernelSet> dispatch{kernel_sets, Kernel_Variant_Env};
+    return dispatch;
+}
+
+const KernelSet &current_kernel_set() {
+    return kernel_dispatch().current();
+}
+
+// Select a kernel of each element type in a set
+inline void run_kernel(const KernelSet &set, const bool *src, size_t size,
+                       Count *dst) {
+    // bool is stored as a byte of 0 or 1
+    set.popcount_uint8(reinterpret_cast<const uint8_t *>(src), size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const int8_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_int8(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const uint8_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_uint8(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const int16_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_int16(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const uint16_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_uint16(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const int32_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_int32(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const uint32_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_uint32(src, size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const int64_t *src, size_t size,
+                       Count *dst) {
+    // Sign extension does not change 64-bit integers
+    set.popcount_uint64(reinterpret_cast<const uint64_t *>(src), size, dst);
+}
+
+inline void run_kernel(const KernelSet &set, const uint64_t *src, size_t size,
+                       Count *dst) {
+    set.popcount_uint64(src, size, dst);
+}
+
+/**
+ * @tparam SourceType The type of elements
+ * @param[in] set Kernels of a variant
+ * @return A kernel which reads elements at strides
+ */
+template <typename SourceType>
+StridedKernel strided_kernel_of(const KernelSet &set);
+
+// bool is stored as a byte of 0 or 1
+template <> StridedKernel strided_kernel_of<bool>(const KernelSet &set) {
+    return set.strided_uint8;
+}
+
+template <> StridedKernel strided_kernel_of<int8_t>(const KernelSet &set) {
+    return set.strided_int8;
+}
+
+template <> StridedKernel strided_kernel_of<uint8_t>(const KernelSet &set) {
+    return set.strided_uint8;
+}
+
+template <> StridedKernel strided_kernel_of<int16_t>(const KernelSet &set) {
+    return set.strided_int16;
+}
+
+template <> StridedKernel strided_kernel_of<uint16_t>(const KernelSet &set) {
+    return set.strided_uint16;
+}
+
+template <> StridedKernel strided_kernel_of<int32_t>(const KernelSet &set) {
+    return set.strided_int32;
+}
+
+template <> StridedKernel strided_kernel_of<uint32_t>(const KernelSet &set) {
+    return set.strided_uint32;
+}
+
+// Sign extension does not change 64-bit integers
+template <> StridedKernel strided_kernel_of<int64_t>(const KernelSet &set) {
+    return set.strided_uint64;
+}
+
+template <> StridedKernel strided_kernel_of<uint64_t>(const KernelSet &set) {
+    return set.strided_uint64;
+}
+
+// Chunks of inputs and outputs fit in L2 cache
+constexpr size_t Parallel_Chunk_Bytes = 1 << 16;
+// Waking threads costs more than counting smaller inputs
+constexpr size_t Parallel_Min_Bytes = 1 << 20;
+
+/**
+ * @param[in] size_in_bytes The size of an input
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return Whether counting on the thread pool
+ */
+bool is_parallel(size_t size_in_bytes, size_t threads) {
+    return (threads != 1) && (size_in_bytes >= Parallel_Min_Bytes) &&
+           (ThreadPool::instance().threads_to_use(threads) > 1);
+}
+
+/**
+ * @tparam SourceType The type of src elements
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements in bytes
+ * @param[in] dst_stride The distance between counts in bytes
+ * @return Whether dense kernels can count the elements
+ */
+template <typename SourceType>
+bool is_dense(const void *src, ptrdiff_t src_stride, ptrdiff_t dst_stride) {
+    // Dense kernels read aligned elements
+    return (src_stride == static_cast<ptrdiff_t>(sizeof(SourceType))) &&
+           (dst_stride == static_cast<ptrdiff_t>(sizeof(Count))) &&
+           ((reinterpret_cast<uintptr_t>(src) % alignof(SourceType)) == 0);
+}
+
+/**
+ * @tparam T The type of src elements
+ * @param[in] src A pointer to an array
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to an array to write the counts of src
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename T>
+void popcount_parallel(const T *src, size_t size, Count *dst, size_t threads) {
+    if (!is_parallel(size * sizeof(T), threads)) {
+        popcount_kernel(src, size, dst);
+        return;
+    }
+
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(T);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    ThreadPool::instance().run(n_chunks, threads, [=](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        popcount_kernel(src + offset, std::min(chunk_size, size - offset),
+                        dst + offset);
+    });
+}
+
+/**
+ * Adds the numbers of elements of a view by their counts to bins
+ * @tparam SourceType The type of src elements
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements in bytes
+ * @param[in] size The number of elements in src
+ * @param[in,out] bins Bins to add to
+ */
+template <typename SourceType>
+void popcount_histogram_serial(const uint8_t *src, ptrdiff_t src_stride,
+                               size_t size, uint64_t *bins) {
+    // Count blocks of elements on a stack and bin 8 counts in a word to
+    // four sets of bins. Runs of the same count do not wait for the
+    // previous increment of a bin.
+    constexpr size_t n_bins = popcount_histogram_bins<SourceType>();
+    constexpr size_t block_size = 2048;
+    constexpr size_t n_sets = 4;
+    Count counts[block_size];
+    uint64_t partials[n_sets][n_bins] = {};
+    for (size_t offset{0}; offset < size; offset += block_size) {
+        const auto n_elements = std::min(block_size, size - offset);
+        popcount_strided_kernel<SourceType>(
+            src + static_cast<ptrdiff_t>(offset) * src_stride, src_stride,
+            n_elements, counts, 1);
+        size_t index{0};
+        for (; (index + sizeof(uint64_t)) <= n_elements;
+             index += sizeof(uint64_t)) {
+            const auto word = load_word(counts + index);
+            ++partials[0][word & 0xffu];
+            ++partials[1][(word >> 8) & 0xffu];
+            ++partials[2][(word >> 16) & 0xffu];
+            ++partials[3][(word >> 24) & 0xffu];
+            ++partials[0][(word >> 32) & 0xffu];
+            ++partials[1][(word >> 40) & 0xffu];
+            ++partials[2][(word >> 48) & 0xffu];
+            ++partials[3][word >> 56];
+        }
+        for (; index < n_elements; ++index) {
+            ++partials[0][counts[index]];
+        }
+    }
+
+    for (size_t set{0}; set < n_sets; ++set) {
+        for (size_t bin{0}; bin < n_bins; ++bin) {
+            bins[bin] += partials[set][bin];
+        }
+    }
+}
+
+// Rows of xs in a chunk stay in L1 cache and rows of ys in a tile stay in
+// L2 cache while the rows of xs pass over them
+constexpr size_t Distance_Chunk_Bytes = 1 << 13;
+constexpr size_t Distance_Tile_Bytes = 1 << 17;
+
+/**
+ * @param[in] set Kernels to count
+ * @param[in] codes Rows of codes
+ * @return The number of 1's of each row
+ */
+std::vector<uint64_t> popcount_rows(const KernelSet &set,
+                                    const CodeMatrix &codes) {
+    const auto *origin = static_cast<const uint8_t *>(codes.data);
+    std::vector<uint64_t> totals(codes.rows);
+    for (size_t row{0}; row < codes.rows; ++row) {
+        totals.at(row) = set.popcount_total(
+            origin + static_cast<ptrdiff_t>(row) * codes.row_stride,
+            codes.row_bytes);
+    }
+    return totals;
+}
+
+/**
+ Hamming distances |x ^ y| = |x| + |y| - 2|x & y|
+ */
+struct HammingDistance {
+    using type = uint32_t;
+    type operator()(uint64_t x, uint64_t y, uint64_t both) const {
+        return static_cast<type>(x + y - 2 * both);
+    }
+};
+
+/**
+ Jaccard distances 1 - |x & y| / |x | y| where |x | y| = |x| + |y| - |x & y|
+ */
+struct JaccardDistance {
+    using type = double;
+    type operator()(uint64_t x, uint64_t y, uint64_t both) const {
+        const auto either = x + y - both;
+        // Same as scipy.spatial.distance.jaccard for pairs of zeros
+        if (either == 0) {
+            return 0.0;
+        }
+        return static_cast<type>(either - both) / static_cast<type>(either);
+    }
+};
+
+/**
+ * Computes distances of pairs of rows in tiles. Kernels count only
+ * |x & y| for each pair because totals of rows give |x ^ y| and |x | y|.
+ * @param[in] xs Rows of codes
+ * @param[in] ys Rows of codes as long as rows of xs
+ * @param[in] upper Whether xs and ys are the same and to compute only
+ *                  pairs in the upper triangle
+ * @param[in] metric A function of |x|, |y| and |x & y| to a distance
+ * @param[in] write A function which takes indexes of rows and a distance
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename Metric, typename Writer>
+void pairwise_distances(const CodeMatrix &xs, const CodeMatrix &ys, bool upper,
+                        Metric metric, Writer write, size_t threads) {
+    const auto &set = current_kernel_set();
+    const auto x_totals = popcount_rows(set, xs);
+    const auto y_totals = upper ? x_totals : popcount_rows(set, ys);
+    const auto *x_origin = static_cast<const uint8_t *>(xs.data);
+    const auto *y_origin = static_cast<const uint8_t *>(ys.data);
+
+    const auto row_bytes = std::max(xs.row_bytes, size_t{1});
+    const auto chunk_rows = std::max(Distance_Chunk_Bytes / row_bytes,
+                                     size_t{1});
+    const auto tile_rows = std::max(Distance_Tile_Bytes / row_bytes,
+                                    size_t{1});
+    const auto run_chunk = [&](size_t chunk_index) {
+        const auto x_begin = chunk_index * chunk_rows;
+        const auto x_end = std::min(x_begin + chunk_rows, xs.rows);
+        const size_t y_first = upper ? (x_begin + 1) : 0;
+        for (auto y_begin = y_first; y_begin < ys.rows; y_begin += tile_rows) {
+            const auto y_end = std::min(y_begin + tile_rows, ys.rows);
+            for (auto i = x_begin; i < x_end; ++i) {
+                const auto *x =
+                    x_origin + static_cast<ptrdiff_t>(i) * xs.row_stride;
+                for (auto j = upper ? std::max(y_begin, i + 1) : y_begin;
+                     j < y_end; ++j) {
+                    const auto *y =
+                        y_origin + static_cast<ptrdiff_t>(j) * ys.row_stride;
+                    const auto both = set.popcount_and(x, y, xs.row_bytes);
+                    write(i, j, metric(x_totals[i], y_totals[j], both));
+                }
+            }
+        }
+    };
+
+    // Work-stealing balances triangles of pdist
+    const auto n_chunks = (xs.rows + chunk_rows - 1) / chunk_rows;
+    const auto work_bytes = xs.rows * ys.rows * row_bytes / (upper ? 2 : 1);
+    if (!is_parallel(work_bytes, threads)) {
+        for (size_t chunk_index{0}; chunk_index < n_chunks; ++chunk_index) {
+            run_chunk(chunk_index);
+        }
+        return;
+    }
+    ThreadPool::instance().run(n_chunks, threads, run_chunk);
+}
+
+/**
+ * @tparam Metric HammingDistance or JaccardDistance
+ * @param[in] xs Rows of codes
+ * @param[in] ys Rows of codes as long as rows of xs
+ * @param[out] dst An xs.rows x ys.rows array in C order to write distances
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename Metric>
+void cdist(const CodeMatrix &xs, const CodeMatrix &ys,
+           typename Metric::type *dst, size_t threads) {
+    if (xs.row_bytes != ys.row_bytes) {
+        throw std::invalid_argument("Rows of codes differ in length");
+    }
+    const auto columns = ys.rows;
+    pairwise_distances(
+        xs, ys, false, Metric{},
+        [=](size_t i, size_t j, typename Metric::type distance) {
+            dst[i * columns + j] = distance;
+        },
+        threads);
+}
+
+/**
+ * @tparam Metric HammingDistance or JaccardDistance
+ * @param[in] xs Rows of codes
+ * @param[in] condensed Whether to write the upper triangle or a square
+ * @param[out] dst An array to write distances
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename Metric>
+void pdist(const CodeMatrix &xs, bool condensed, typename Metric::type *dst,
+           size_t threads) {
+    const auto n = xs.rows;
+    if (condensed) {
+        // Rows of the upper triangle in order without the diagonal
+        pairwise_distances(
+            xs, xs, true, Metric{},
+            [=](size_t i, size_t j, typename Metric::type distance) {
+                dst[n * i - i * (i + 1) / 2 + (j - i - 1)] = distance;
+            },
+            threads);
+        return;
+    }
+
+    for (size_t i{0}; i < n; ++i) {
+        dst[i * n + i] = 0;
+    }
+    pairwise_distances(
+        xs, xs, true, Metric{},
+        [=](size_t i, size_t j, typename Metric::type distance) {
+            dst[i * n + j] = distance;
+            dst[j * n + i] = distance;
+        },
+        threads);
+}
+} // namespace
+
+template <typename SourceType>
+void popcount_kernel(const SourceType *src, size_t size, Count *dst) {
+    run_kernel(current_kernel_set(), src, size, dst);
+}
+
+uint64_t popcount_total_kernel(const void *src, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    return current_kernel_set().popcount_total(bytes, size);
+}
+
+template <typename SourceType>
+void popcount_kernel(const SourceType *src, size_t size, Count *dst,
+                     size_t threads) {
+    popcount_parallel(src, size, dst, threads);
+}
+
+template <typename SourceType>
+void popcount_strided_kernel(const void *src, ptrdiff_t src_stride,
+                             size_t size, Count *dst, ptrdiff_t dst_stride) {
+    if (is_dense<SourceType>(src, src_stride, dst_stride)) {
+        popcount_kernel(static_cast<const SourceType *>(src), size, dst);
+        return;
+    }
+
+    const auto kernel = strided_kernel_of<SourceType>(current_kernel_set());
+    kernel(static_cast<const uint8_t *>(src), src_stride, size, dst,
+           dst_stride);
+}
+
+template <typename SourceType>
+void popcount_strided_kernel(const void *src, ptrdiff_t src_stride,
+                             size_t size, Count *dst, ptrdiff_t dst_stride,
+                             size_t threads) {
+    if (is_dense<SourceType>(src, src_stride, dst_stride)) {
+        popcount_kernel(static_cast<const SourceType *>(src), size, dst,
+                        threads);
+        return;
+    }
+    if (!is_parallel(size * sizeof(SourceType), threads)) {
+        popcount_strided_kernel<SourceType>(src, src_stride, size, dst,
+                                            dst_stride);
+        return;
+    }
+
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(SourceType);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    ThreadPool::instance().run(n_chunks, threads, [=](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        const auto index = static_cast<ptrdiff_t>(offset);
+        popcount_strided_kernel<SourceType>(
+            bytes + index * src_stride, src_stride,
+            std::min(chunk_size, size - offset), dst + index * dst_stride,
+            dst_stride);
+    });
+}
+
+template <typename SourceType>
+uint64_t popcount_total_strided_kernel(const void *src, ptrdiff_t src_stride,
+                                       size_t size) {
+    // Sign extension adds 1's to narrow signed integers
+    const bool extended =
+        std::is_signed<SourceType>::value && (sizeof(SourceType) < 8);
+    if (!extended &&
+        (src_stride == static_cast<ptrdiff_t>(sizeof(SourceType)))) {
+        return popcount_total_kernel(src, size * sizeof(SourceType));
+    }
+
+    // Count blocks of elements on a stack and sum them
+    constexpr size_t block_size = 256;
+    Count counts[block_size];
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    uint64_t total{0};
+    for (size_t offset{0}; offset < size; offset += block_size) {
+        const auto n_elements = std::min(block_size, size - offset);
+        popcount_strided_kernel<SourceType>(
+            bytes + static_cast<ptrdiff_t>(offset) * src_stride, src_stride,
+            n_elements, counts, 1);
+        for (size_t index{0}; index < n_elements; ++index) {
+            total += counts[index];
+        }
+    }
+    return total;
+}
+
+template <typename SourceType>
+uint64_t popcount_total_strided_kernel(const void *src, ptrdiff_t src_stride,
+                                       size_t size, size_t threads) {
+    if (!is_parallel(size * sizeof(SourceType), threads)) {
+        return popcount_total_strided_kernel<SourceType>(src, src_stride,
+                                                         size);
+    }
+
+    // Sum partial totals in order to get the same result every time
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(SourceType);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> totals(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        totals.at(chunk_index) = popcount_total_strided_kernel<SourceType>(
+            bytes + static_cast<ptrdiff_t>(offset) * src_stride, src_stride,
+            std::min(chunk_size, size - offset));
+    });
+
+    uint64_t total{0};
+    for (const auto partial : totals) {
+        total += partial;
+    }
+    return total;
+}
+
+template <typename SourceType>
+void popcount_total_lines_kernel(const LineView &view, uint64_t *dst,
+                                 size_t threads) {
+    size_t n_lines{1};
+    for (const auto extent : view.outer_shape) {
+        n_lines *= extent;
+    }
+
+    const auto *origin = static_cast<const uint8_t *>(view.origin);
+    const auto sum_lines = [&](size_t begin, size_t end,
+                               size_t line_threads) {
+        for (size_t line = begin; line < end; ++line) {
+            // Offset of a line in C order of outer_shape
+            ptrdiff_t offset{0};
+            auto rest = line;
+            for (auto dim = view.outer_shape.size(); dim > 0; --dim) {
+                const auto extent = view.outer_shape.at(dim - 1);
+                offset += static_cast<ptrdiff_t>(rest % extent) *
+                          view.outer_strides.at(dim - 1);
+                rest /= extent;
+            }
+            dst[line] = popcount_total_strided_kernel<SourceType>(
+                origin + offset, view.stride, view.size, line_threads);
+        }
+    };
+
+    // Split long lines such as rows of a 1-D array instead of lines
+    const auto line_bytes = std::max(view.size * sizeof(SourceType), size_t{1});
+    if (!is_parallel(n_lines * line_bytes, threads) ||
+        (line_bytes >= Parallel_Chunk_Bytes)) {
+        sum_lines(0, n_lines, threads);
+        return;
+    }
+
+    // Keep lines in a chunk as large as chunks of 1-D arrays
+    const auto chunk_size = std::max(Parallel_Chunk_Bytes / line_bytes,
+                                     size_t{1});
+    const auto n_chunks = (n_lines + chunk_size - 1) / chunk_size;
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto begin = chunk_index * chunk_size;
+        sum_lines(begin, std::min(begin + chunk_size, n_lines), 1);
+    });
+}
+
+template <typename SourceType>
+void popcount_histogram_kernel(const void *src, ptrdiff_t src_stride,
+                               size_t size, uint64_t *bins, size_t threads) {
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    if (!is_parallel(size * sizeof(SourceType), threads)) {
+        popcount_histogram_serial<SourceType>(bytes, src_stride, size, bins);
+        return;
+    }
+
+    // A few parts per thread balance loads and each part has private bins
+    // which are merged at the end without contention
+    constexpr size_t n_bins = popcount_histogram_bins<SourceType>();
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(SourceType);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    const auto n_parts =
+        std::min(ThreadPool::instance().threads_to_use(threads) * 4, n_chunks);
+    const auto part_size = (n_chunks + n_parts - 1) / n_parts * chunk_size;
+    std::vector<uint64_t> part_bins(n_parts * n_bins, 0);
+    ThreadPool::instance().run(n_parts, threads, [&](size_t part) {
+        const auto offset = std::min(part * part_size, size);
+        popcount_histogram_serial<SourceType>(
+            bytes + static_cast<ptrdiff_t>(offset) * src_stride, src_stride,
+            std::min(part_size, size - offset),
+            part_bins.data() + part * n_bins);
+    });
+
+    for (size_t part{0}; part < n_parts; ++part) {
+        for (size_t bin{0}; bin < n_bins; ++bin) {
+            bins[bin] += part_bins.at(part * n_bins + bin);
+        }
+    }
+}
+
+#define POPCOUNT_INSTANTIATE_KERNEL(type)                                      \
+    template void popcount_kernel<type>(const type *, size_t, Count *);        \
+    template void popcount_kernel<type>(const type *, size_t, Count *,         \
+                                        size_t);                               \
+    template void popcount_strided_kernel<type>(const void *, ptrdiff_t,       \
+                                                size_t, Count *, ptrdiff_t);   \
+    template void popcount_strided_kernel<type>(                               \
+        const void *, ptrdiff_t, size_t, Count *, ptrdiff_t, size_t);          \
+    template uint64_t popcount_total_strided_kernel<type>(const void *,        \
+                                                          ptrdiff_t, size_t);  \
+    template uint64_t popcount_total_strided_kernel<type>(                     \
+        const void *, ptrdiff_t, size_t, size_t);                              \
+    template void popcount_total_lines_kernel<type>(const LineView &,          \
+                                                    uint64_t *, size_t);       \
+    template void popcount_histogram_kernel<type>(const void *, ptrdiff_t,     \
+                                                  size_t, uint64_t *, size_t);
+
+POPCOUNT_INSTANTIATE_KERNEL(bool)
+POPCOUNT_INSTANTIATE_KERNEL(int8_t)
+POPCOUNT_INSTANTIATE_KERNEL(uint8_t)
+POPCOUNT_INSTANTIATE_KERNEL(int16_t)
+POPCOUNT_INSTANTIATE_KERNEL(uint16_t)
+POPCOUNT_INSTANTIATE_KERNEL(int32_t)
+POPCOUNT_INSTANTIATE_KERNEL(uint32_t)
+POPCOUNT_INSTANTIATE_KERNEL(int64_t)
+POPCOUNT_INSTANTIATE_KERNEL(uint64_t)
+#undef POPCOUNT_INSTANTIATE_KERNEL
+
+uint64_t popcount_total_kernel(const void *src, size_t size, size_t threads) {
+    if (!is_parallel(size, threads)) {
+        return popcount_total_kernel(src, size);
+    }
+
+    // Sum partial totals in order to get the same result every time
+    const auto *bytes = static_cast<const uint8_t *>(src);
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes;
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> totals(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        totals.at(chunk_index) = popcount_total_kernel(
+            bytes + offset, std::min(chunk_size, size - offset));
+    });
+
+    uint64_t total{0};
+    for (const auto partial : totals) {
+        total += partial;
+    }
+    return total;
+}
+
+void popcount_many_kernel(const std::vector<ManyView> &views,
+                          size_t threads) {
+    const auto count_range = [&](size_t index, size_t begin, size_t end) {
+        const auto &view = views.at(index);
+        view.kernel(static_cast<const uint8_t *>(view.src) +
+                        static_cast<ptrdiff_t>(begin) * view.src_stride,
+                    view.src_stride, end - begin, view.dst + begin, 1);
+    };
+
+    size_t total_bytes{0};
+    for (const auto &view : views) {
+        total_bytes += view.size * view.itemsize;
+    }
+    if (!is_parallel(total_bytes, threads)) {
+        for (size_t index{0}; index < views.size(); ++index) {
+            count_range(index, 0, views[index].size);
+        }
+        return;
+    }
+
+    // A chunk starts at an element of a view and ends at the start of the
+    // next chunk. Chunks group small views and split large views.
+    struct Position {
+        size_t index;  ///< The index of a view
+        size_t offset; ///< The index of an element in the view
+    };
+    std::vector<Position> starts;
+    size_t filled{0};
+    for (size_t index{0}; index < views.size(); ++index) {
+        const auto &view = views[index];
+        size_t offset{0};
+        while (offset < view.size) {
+            if (filled == 0) {
+                starts.push_back(Position{index, offset});
+            }
+            const auto room =
+                (Parallel_Chunk_Bytes - filled + view.itemsize - 1) /
+                view.itemsize;
+            const auto n_elements = std::min(room, view.size - offset);
+            offset += n_elements;
+            filled += n_elements * view.itemsize;
+            if (filled >= Parallel_Chunk_Bytes) {
+                filled = 0;
+            }
+        }
+    }
+    starts.push_back(Position{views.size(), 0});
+
+    ThreadPool::instance().run(
+        starts.size() - 1, threads, [&](size_t chunk_index) {
+            const auto first = starts.at(chunk_index);
+            const auto last = starts.at(chunk_index + 1);
+            for (auto index = first.index;
+                 (index <= last.index) && (index < views.size()); ++index) {
+                const auto begin = (index == first.index) ? first.offset : 0;
+                const auto end =
+                    (index == last.index) ? last.offset : views[index].size;
+                if (begin < end) {
+                    count_range(index, begin, end);
+                }
+            }
+        });
+}
+
+uint64_t popcount_and_kernel(const void *xs, const void *ys, size_t size) {
+    return current_kernel_set().popcount_and(
+        static_cast<const uint8_t *>(xs), static_cast<const uint8_t *>(ys),
+        size);
+}
+
+void hamming_cdist_kernel(const CodeMatrix &xs, const CodeMatrix &ys,
+                          uint32_t *dst, size_t threads) {
+    cdist<HammingDistance>(xs, ys, dst, threads);
+}
+
+void jaccard_cdist_kernel(const CodeMatrix &xs, const CodeMatrix &ys,
+                          double *dst, size_t threads) {
+    cdist<JaccardDistance>(xs, ys, dst, threads);
+}
+
+void hamming_pdist_kernel(const CodeMatrix &xs, bool condensed,
+                          uint32_t *dst, size_t threads) {
+    pdist<HammingDistance>(xs, condensed, dst, threads);
+}
+
+void jaccard_pdist_kernel(const CodeMatrix &xs, bool condensed, double *dst,
+                          size_t threads) {
+    pdist<JaccardDistance>(xs, condensed, dst, threads);
+}
+
+void hamming_topk_kernel(const CodeMatrix &queries, const CodeMatrix &database,
+                         size_t k, uint32_t *distances, int64_t *indexes,
+                         size_t threads) {
+    if (queries.row_bytes != database.row_bytes) {
+        throw std::invalid_argument("Rows of codes differ in length");
+    }
+    if (k > database.rows) {
+        throw std::invalid_argument("k exceeds the number of rows");
+    }
+    if (k == 0) {
+        return;
+    }
+
+    const auto &set = current_kernel_set();
+    const auto query_totals = popcount_rows(set, queries);
+    const auto database_totals = popcount_rows(set, database);
+    const auto *query_origin = static_cast<const uint8_t *>(queries.data);
+    const auto *database_origin = static_cast<const uint8_t *>(database.data);
+
+    const auto row_bytes = std::max(queries.row_bytes, size_t{1});
+    const auto chunk_rows = std::max(Distance_Chunk_Bytes / row_bytes,
+                                     size_t{1});
+    const auto tile_rows = std::max(Distance_Tile_Bytes / row_bytes,
+                                    size_t{1});
+    // The top of a heap is the farthest neighbour and the last one in ties
+    using Neighbour = std::pair<uint32_t, size_t>;
+    const auto run_chunk = [&](size_t chunk_index) {
+        const auto begin = chunk_index * chunk_rows;
+        const auto end = std::min(begin + chunk_rows, queries.rows);
+        std::vector<std::vector<Neighbour>> heaps(end - begin);
+        for (auto &heap : heaps) {
+            heap.reserve(k);
+        }
+
+        for (size_t tile_begin{0}; tile_begin < database.rows;
+             tile_begin += tile_rows) {
+            const auto tile_end = std::min(tile_begin + tile_rows,
+                                           database.rows);
+            for (auto i = begin; i < end; ++i) {
+                auto &heap = heaps.at(i - begin);
+                const auto *query = query_origin + static_cast<ptrdiff_t>(i) *
+                                                       queries.row_stride;
+                const auto x = query_totals[i];
+                for (auto j = tile_begin; j < tile_end; ++j) {
+                    // |x ^ y| >= ||x| - |y|| skips rows which cannot be
+                    // nearer than the farthest neighbour
+                    const auto y = database_totals[j];
+                    const auto lower_bound = (x > y) ? (x - y) : (y - x);
+                    const bool full = (heap.size() == k);
+                    if (full && (lower_bound >= heap.front().first)) {
+                        continue;
+                    }
+
+                    const auto *row =
+                        database_origin +
+                        static_cast<ptrdiff_t>(j) * database.row_stride;
+                    const auto both = set.popcount_and(query, row,
+                                                       queries.row_bytes);
+                    const auto distance =
+                        static_cast<uint32_t>(x + y - 2 * both);
+                    if (!full) {
+                        heap.emplace_back(distance, j);
+                        std::push_heap(heap.begin(), heap.end());
+                    } else if (distance < heap.front().first) {
+                        // Rows come in ascending order and keep earlier ties
+                        std::pop_heap(heap.begin(), heap.end());
+                        heap.back() = Neighbour{distance, j};
+                        std::push_heap(heap.begin(), heap.end());
+                    }
+                }
+            }
+        }
+
+        for (auto i = begin; i < end; ++i) {
+            auto &heap = heaps.at(i - begin);
+            std::sort_heap(heap.begin(), heap.end());
+            for (size_t rank{0}; rank < k; ++rank) {
+                distances[i * k + rank] = heap.at(rank).first;
+                indexes[i * k + rank] =
+                    static_cast<int64_t>(heap.at(rank).second);
+            }
+        }
+    };
+
+    const auto n_chunks = (queries.rows + chunk_rows - 1) / chunk_rows;
+    if (!is_parallel(queries.rows * database.rows * row_bytes, threads)) {
+        for (size_t chunk_index{0}; chunk_index < n_chunks; ++chunk_index) {
+            run_chunk(chunk_index);
+        }
+        return;
+    }
+    ThreadPool::instance().run(n_chunks, threads, run_chunk);
+}
+
+KernelVariant get_kernel_variant() {
+    return kernel_dispatch().variant();
+}
+
+void set_kernel_variant(KernelVariant variant) {
+    kernel_dispatch().set_variant(variant);
+}
+} // namespace py_cpp_sample
@@ -0,0 +1,303 @@
+#ifndef CPP_IMPL_POPCOUNT_KERNEL_H
+#define CPP_IMPL_POPCOUNT_KERNEL_H
+
+#include "popcount_core.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ C++ implementation
+ */
+namespace py_cpp_sample {
+using Count = uint8_t;
+
+// Arrays shorter than this are counted in the calling thread while holding
+// the GIL because releasing it costs more than counting them
+constexpr size_t Small_Array_Size = 64;
+
+/**
+ Instruction sets which popcount kernels are built for
+ */
+using KernelVariant = popcount_core::KernelVariant;
+
+/**
+ * Instantiated for bool, int8_t, uint8_t, int16_t, uint16_t, int32_t,
+ * uint32_t, int64_t and uint64_t. Signed integers are sign-extended to
+ * 64 bits before counting as conversion to uint64_t does.
+ * @tparam SourceType The type of src elements
+ * @param[in] src A pointer to an integer array
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to an array to write the counts of src
+ */
+template <typename SourceType>
+void popcount_kernel(const SourceType *src, size_t size, Count *dst);
+
+/**
+ * Counts elements of a view in place. Strides are in bytes and can be
+ * negative or not multiples of the size of elements as columns of
+ * structured arrays are. Dense views run popcount_kernel().
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements of src in bytes
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to write the count of the first element
+ * @param[in] dst_stride The distance between counts in bytes
+ */
+template <typename SourceType>
+void popcount_strided_kernel(const void *src, ptrdiff_t src_stride,
+                             size_t size, Count *dst, ptrdiff_t dst_stride);
+
+/**
+ Lines along an axis of an N-D view
+ */
+struct LineView {
+    const void *origin;                  ///< The first element of the view
+    std::vector<size_t> outer_shape;     ///< The shape except the axis
+    std::vector<ptrdiff_t> outer_strides; ///< Strides except the axis in bytes
+    size_t size;                         ///< The number of elements in a line
+    ptrdiff_t stride;                    ///< The stride along the axis in bytes
+};
+
+/**
+ * Sums the numbers of 1's of elements of a view
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements of src in bytes
+ * @param[in] size The number of elements in src
+ * @return The total number of 1's in src
+ */
+template <typename SourceType>
+uint64_t popcount_total_strided_kernel(const void *src, ptrdiff_t src_stride,
+                                       size_t size);
+
+/**
+ * Sums the numbers of 1's of elements of a view on a thread pool
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements of src in bytes
+ * @param[in] size The number of elements in src
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's in src
+ */
+template <typename SourceType>
+uint64_t popcount_total_strided_kernel(const void *src, ptrdiff_t src_stride,
+                                       size_t size, size_t threads);
+
+/**
+ * Sums the numbers of 1's along each line in one pass and counts chunks
+ * of lines on a thread pool
+ * @tparam SourceType The type of elements as popcount_kernel() takes
+ * @param[in] view Lines to sum
+ * @param[out] dst An array in C order of outer_shape to write the totals
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename SourceType>
+void popcount_total_lines_kernel(const LineView &view, uint64_t *dst,
+                                 size_t threads);
+
+/**
+ * Counts 1's in a buffer without writing per-element counts
+ * @param[in] src A pointer to a buffer
+ * @param[in] size The size of src in bytes
+ * @return The number of 1's in src
+ */
+extern uint64_t popcount_total_kernel(const void *src, size_t size);
+
+/**
+ * Counts chunks of src on a thread pool and small arrays serially
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to an integer array
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to an array to write the counts of src
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename SourceType>
+void popcount_kernel(const SourceType *src, size_t size, Count *dst,
+                     size_t threads);
+
+/**
+ * Counts chunks of a view on a thread pool and small views serially
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements of src in bytes
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to write the count of the first element
+ * @param[in] dst_stride The distance between counts in bytes
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename SourceType>
+void popcount_strided_kernel(const void *src, ptrdiff_t src_stride,
+                             size_t size, Count *dst, ptrdiff_t dst_stride,
+                             size_t threads);
+
+/**
+ * Counts chunks of src on a thread pool and small buffers serially
+ * @param[in] src A pointer to a buffer
+ * @param[in] size The size of src in bytes
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The number of 1's in src
+ */
+extern uint64_t popcount_total_kernel(const void *src, size_t size,
+                                      size_t threads);
+
+/**
+ * @tparam SourceType The type of elements as popcount_kernel() takes
+ * @return The number of bins of popcount_histogram_kernel() which is 9 for
+ *         uint8_t and 65 for sign-extended narrow integers
+ */
+template <typename SourceType> constexpr size_t popcount_histogram_bins() {
+    return (std::is_signed<SourceType>::value ? 64 : sizeof(SourceType) * 8) +
+           1;
+}
+
+/**
+ * Counts elements of a view by their numbers of 1's in one pass. Counts of
+ * blocks of elements stay in L1 and chunks of large views are binned on a
+ * thread pool to private bins which are merged at the end.
+ * @tparam SourceType The type of src elements as popcount_kernel() takes
+ * @param[in] src A pointer to the first element
+ * @param[in] src_stride The distance between elements of src in bytes
+ * @param[in] size The number of elements in src
+ * @param[in,out] bins popcount_histogram_bins() bins to add the numbers of
+ *                     elements which have 0, 1, ... 1's
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename SourceType>
+void popcount_histogram_kernel(const void *src, ptrdiff_t src_stride,
+                               size_t size, uint64_t *bins, size_t threads);
+
+/**
+ A function which counts a view as popcount_strided_kernel() does
+ */
+using ViewKernel = void (*)(const void *, ptrdiff_t, size_t, Count *,
+                            ptrdiff_t);
+
+/**
+ A view of elements and an array to write their counts
+ */
+struct ManyView {
+    ViewKernel kernel;    ///< popcount_strided_kernel() for the element type
+    const void *src;      ///< The first element
+    ptrdiff_t src_stride; ///< The distance between elements in bytes
+    size_t size;          ///< The number of elements
+    size_t itemsize;      ///< The size of an element in bytes
+    Count *dst;           ///< A dense array to write size counts
+};
+
+/**
+ * Counts many views in one call. Views smaller than chunks are grouped and
+ * larger views are split into chunks which run on a thread pool.
+ * @param[in] views Views and arrays to write their counts
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void popcount_many_kernel(const std::vector<ManyView> &views,
+                                 size_t threads);
+
+/**
+ * Counts 1's in bitwise AND of two buffers
+ * @param[in] xs A pointer to a buffer
+ * @param[in] ys A pointer to a buffer as large as xs
+ * @param[in] size The size of xs and ys in bytes
+ * @return The number of 1's in xs & ys
+ */
+extern uint64_t popcount_and_kernel(const void *xs, const void *ys,
+                                    size_t size);
+
+/**
+ Rows of packed binary codes
+ */
+struct CodeMatrix {
+    const void *data;     ///< The first row
+    size_t rows;          ///< The number of rows
+    size_t row_bytes;     ///< The size of a row in bytes
+    ptrdiff_t row_stride; ///< The distance between rows in bytes
+};
+
+/**
+ * Computes Hamming distances between all pairs of rows in tiles which
+ * fit in caches and counts chunks of rows of xs on a thread pool
+ * @param[in] xs Rows of codes
+ * @param[in] ys Rows of codes as long as rows of xs
+ * @param[out] dst An xs.rows x ys.rows array in C order to write the
+ *                 numbers of different bits
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void hamming_cdist_kernel(const CodeMatrix &xs, const CodeMatrix &ys,
+                                 uint32_t *dst, size_t threads);
+
+/**
+ * Computes Jaccard distances 1 - |x & y| / |x | y| as
+ * hamming_cdist_kernel() does and 0 for pairs of zeros
+ * @param[in] xs Rows of codes
+ * @param[in] ys Rows of codes as long as rows of xs
+ * @param[out] dst An xs.rows x ys.rows array in C order to write distances
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void jaccard_cdist_kernel(const CodeMatrix &xs, const CodeMatrix &ys,
+                                 double *dst, size_t threads);
+
+/**
+ * Computes Hamming distances between pairs of rows in xs once per pair
+ * @param[in] xs Rows of codes
+ * @param[in] condensed Whether to write the upper triangle in the order
+ *                      of scipy.spatial.distance.pdist or a square matrix
+ * @param[out] dst An array of xs.rows * (xs.rows - 1) / 2 distances or
+ *                 xs.rows x xs.rows array in C order
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void hamming_pdist_kernel(const CodeMatrix &xs, bool condensed,
+                                 uint32_t *dst, size_t threads);
+
+/**
+ * Computes Jaccard distances between pairs of rows in xs once per pair
+ * @param[in] xs Rows of codes
+ * @param[in] condensed Whether to write the upper triangle in the order
+ *                      of scipy.spatial.distance.pdist or a square matrix
+ * @param[out] dst An array of xs.rows * (xs.rows - 1) / 2 distances or
+ *                 xs.rows x xs.rows array in C order
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void jaccard_pdist_kernel(const CodeMatrix &xs, bool condensed,
+                                 double *dst, size_t threads);
+
+/**
+ * Finds the k nearest rows of a database for each query by Hamming
+ * distances with a bounded heap per query. Chunks of queries pass over
+ * tiles of the database which fit in caches on a thread pool.
+ * @param[in] queries Rows of codes
+ * @param[in] database Rows of codes as long as rows of queries
+ * @param[in] k The number of neighbours up to database.rows
+ * @param[out] distances A queries.rows x k array in C order to write
+ *                       distances in ascending order
+ * @param[out] indexes A queries.rows x k array in C order to write indexes
+ *                     of rows of the database. Ties are in ascending order.
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+extern void hamming_topk_kernel(const CodeMatrix &queries,
+                                const CodeMatrix &database, size_t k,
+                                uint32_t *distances, int64_t *indexes,
+                                size_t threads);
+
+// Variants which the running CPU supports and their names
+using popcount_core::detect_kernel_variant;
+using popcount_core::is_kernel_variant_supported;
+using popcount_core::kernel_variant_name;
+using popcount_core::parse_kernel_variant;
+using popcount_core::supported_kernel_variants;
+
+/**
+ * @return The variant which popcount_kernel() runs now
+ */
+extern KernelVariant get_kernel_variant();
+
+/**
+ * @param[in] variant A kernel variant which popcount_kernel() runs after this
+ * @throw std::invalid_argument if the running CPU cannot execute the variant
+ */
+extern void set_kernel_variant(KernelVariant variant);
+} // namespace py_cpp_sample
+
+#endif // CPP_IMPL_POPCOUNT_KERNEL_H
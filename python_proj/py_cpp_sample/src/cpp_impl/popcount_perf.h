@@ -0,0 +1,235 @@
+#ifndef POPCOUNT_PERF_H
+#define POPCOUNT_PERF_H
+
+/*
+ Header-only hardware performance counters which tell whether kernels are
+ compute-bound or memory-bound. The Python and R packages have their own
+ copies of this header as they have of popcount_core.h:
+
+ python_proj/py_cpp_sample/src/cpp_impl/popcount_perf.h (master)
+ r_proj/rCppSample/src/popcount_perf.h
+
+ Counters are unavailable on non-Linux hosts, in containers which deny
+ perf_event_open by seccomp or perf_event_paranoid and on virtual machines
+ without a PMU. Callers check PerfSample::available() and report no
+ values instead of failing.
+ */
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#ifdef __linux__
+#define POPCOUNT_PERF_LINUX
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ Binding-agnostic popcount kernels
+ */
+namespace popcount_core {
+/**
+ Hardware events which PerfCounters count
+ */
+enum class PerfEvent : int {
+    Cycles,       ///< CPU cycles
+    Instructions, ///< Retired instructions
+    LlcMisses,    ///< Last level cache misses
+    BranchMisses, ///< Mispredicted branches
+};
+
+/// The number of hardware events
+constexpr size_t Number_Of_Perf_Events =
+    static_cast<size_t>(PerfEvent::BranchMisses) + 1;
+
+/// Names of hardware events in the order of PerfEvent
+constexpr std::array<const char *, Number_Of_Perf_Events> Perf_Event_Names{
+    {"cycles", "instructions", "llc_misses", "branch_misses"}};
+
+/**
+ Counts of hardware events between PerfCounters::start() and stop()
+ */
+class PerfSample {
+  public:
+    PerfSample() {
+        values_.fill(0);
+        available_.fill(false);
+    }
+
+    /**
+     * @param[in] event A hardware event
+     * @return Whether the host counted the event
+     */
+    bool available(PerfEvent event) const {
+        return available_.at(static_cast<size_t>(event));
+    }
+
+    /**
+     * @return Whether the host counted at least one event
+     */
+    bool available() const {
+        for (const auto event_available : available_) {
+            if (event_available) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @param[in] event A hardware event
+     * @return The count of the event or NaN if the host did not count it
+     */
+    double value(PerfEvent event) const {
+        if (!available(event)) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return static_cast<double>(values_.at(static_cast<size_t>(event)));
+    }
+
+    /**
+     * @param[in] event A hardware event
+     * @param[in] value The count of the event
+     */
+    void set_value(PerfEvent event, uint64_t value) {
+        values_.at(static_cast<size_t>(event)) = value;
+        available_.at(static_cast<size_t>(event)) = true;
+    }
+
+    /**
+     * @param[in] n_bytes The number of bytes which kernels read
+     * @return Cycles per byte or NaN if unavailable
+     */
+    double cycles_per_byte(size_t n_bytes) const {
+        return value(PerfEvent::Cycles) / static_cast<double>(n_bytes);
+    }
+
+    /**
+     * @return Instructions per cycle or NaN if unavailable
+     */
+    double ipc() const {
+        return value(PerfEvent::Instructions) / value(PerfEvent::Cycles);
+    }
+
+  private:
+    std::array<uint64_t, Number_Of_Perf_Events> values_; ///< Counts
+    std::array<bool, Number_Of_Perf_Events> available_;  ///< Counted events
+};
+
+/**
+ Counts hardware events of the calling thread in user space. Workers of
+ thread pools are not counted and callers measure kernels on one thread.
+ */
+class PerfCounters {
+  public:
+    PerfCounters() {
+        fds_.fill(-1);
+#ifdef POPCOUNT_PERF_LINUX
+        constexpr std::array<uint64_t, Number_Of_Perf_Events> configs{
+            {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+             PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES}};
+        // Open events one by one to keep others if the host lacks some
+        for (size_t index{0}; index < Number_Of_Perf_Events; ++index) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs.at(index);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format =
+                PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            // Children which the process forks or executes do not inherit fds
+            fds_.at(index) = static_cast<int>(::syscall(
+                SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        }
+#endif // POPCOUNT_PERF_LINUX
+    }
+
+    ~PerfCounters() {
+#ifdef POPCOUNT_PERF_LINUX
+        for (const auto fd : fds_) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif // POPCOUNT_PERF_LINUX
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    /**
+     * @return Whether the host can count at least one event
+     */
+    bool available() const {
+        for (const auto fd : fds_) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Resets and starts counting
+     */
+    void start() {
+#ifdef POPCOUNT_PERF_LINUX
+        for (const auto fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif // POPCOUNT_PERF_LINUX
+    }
+
+    /**
+     * Stops counting
+     * @return Counts since start() which are scaled up if the kernel
+     *         multiplexed events on fewer hardware counters
+     */
+    PerfSample stop() {
+        PerfSample sample;
+#ifdef POPCOUNT_PERF_LINUX
+        for (const auto fd : fds_) {
+            if (fd >= 0) {
+                ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+        for (size_t index{0}; index < Number_Of_Perf_Events; ++index) {
+            const auto fd = fds_.at(index);
+            // The value, time enabled and time running
+            std::array<uint64_t, 3> values{{0, 0, 0}};
+            if ((fd < 0) ||
+                (::read(fd, values.data(), sizeof(values)) !=
+                 static_cast<ssize_t>(sizeof(values))) ||
+                (values.at(2) == 0)) {
+                continue;
+            }
+            const auto scale = static_cast<double>(values.at(1)) /
+                               static_cast<double>(values.at(2));
+            sample.set_value(
+                static_cast<PerfEvent>(index),
+                static_cast<uint64_t>(
+                    std::llround(static_cast<double>(values.at(0)) * scale)));
+        }
+#endif // POPCOUNT_PERF_LINUX
+        return sample;
+    }
+
+  private:
+    /// File descriptors of events in the order of PerfEvent or -1
+    std::array<int, Number_Of_Perf_Events> fds_;
+};
+} // namespace popcount_core
+
+#endif // POPCOUNT_PERF_H
@@ -0,0 +1,325 @@
+#ifndef POPCOUNT_STATS_H
+#define POPCOUNT_STATS_H
+
+/*
+ Header-only in-process metrics of calls which count 1's. The Python and
+ R packages have their own copies of this header as they have of
+ popcount_core.h:
+
+ python_proj/py_cpp_sample/src/cpp_impl/popcount_stats.h (master)
+ r_proj/rCppSample/src/popcount_stats.h
+
+ Each thread adds to its own counters and readers sum counters of all
+ threads, so recording a call takes a few stores without locks or shared
+ cache lines. Reading a clock costs more than counting short inputs and
+ only calls of Stats_Timed_Bytes or more are timed.
+
+ Define POPCOUNT_NO_STATS to compile out recording. StatsScope is empty
+ then and snapshots hold zeros.
+ */
+
+#include "popcount_core.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ Binding-agnostic popcount kernels
+ */
+namespace popcount_core {
+#ifdef POPCOUNT_NO_STATS
+/// Whether calls are recorded
+constexpr bool Stats_Enabled = false;
+#else  // POPCOUNT_NO_STATS
+/// Whether calls are recorded
+constexpr bool Stats_Enabled = true;
+#endif // POPCOUNT_NO_STATS
+
+/// Bins of latencies in [2^i, 2^(i+1)) nanoseconds, up to 2^40 ns or more
+constexpr size_t Stats_Histogram_Bins = 41;
+
+/// Calls which read this number of bytes or more are timed
+constexpr size_t Stats_Timed_Bytes = 1 << 16;
+
+/**
+ Sums of metrics of calls
+ */
+struct StatsSnapshot {
+    uint64_t calls{0};       ///< The number of calls
+    uint64_t bytes{0};       ///< The number of bytes which calls read
+    uint64_t copies{0};      ///< Calls which copied inputs to convert them
+    uint64_t timed_calls{0}; ///< Calls which were timed
+    uint64_t nanoseconds{0}; ///< Time which timed calls spent
+    /// Calls of each kernel variant in the order of KernelVariant
+    std::array<uint64_t, Number_Of_Variants> variant_calls{};
+    /// Timed calls in [2^i, 2^(i+1)) nanoseconds and 0 ns in the first bin
+    std::array<uint64_t, Stats_Histogram_Bins> latency_histogram{};
+};
+
+/**
+ * @param[in] nanoseconds The duration of a call
+ * @return The bin of the log2 histogram of the duration
+ */
+inline size_t stats_histogram_bin(uint64_t nanoseconds) {
+    size_t bin{0};
+    while ((nanoseconds >>= 1) != 0) {
+        ++bin;
+    }
+    return (bin < Stats_Histogram_Bins) ? bin : (Stats_Histogram_Bins - 1);
+}
+
+/**
+ Counters which one thread writes and others read
+ */
+class ThreadStats {
+  public:
+    /// Slots of counters
+    enum Slot : size_t {
+        Calls,
+        Bytes,
+        Copies,
+        TimedCalls,
+        Nanoseconds,
+        VariantCalls,
+        LatencyHistogram = VariantCalls + Number_Of_Variants,
+        Number_Of_Slots = LatencyHistogram + Stats_Histogram_Bins,
+    };
+
+    ThreadStats() {
+        reset();
+    }
+
+    /**
+     * Adds to a counter without read-modify-write instructions because
+     * only the owner thread writes it
+     * @param[in] slot A counter
+     * @param[in] value A value to add
+     */
+    void add(size_t slot, uint64_t value) {
+        auto &counter = counters_[slot];
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+
+    /**
+     * @param[in,out] snapshot Sums of counters to add this thread's to
+     */
+    void add_to(StatsSnapshot &snapshot) const {
+        const auto get = [this](size_t slot) {
+            return counters_[slot].load(std::memory_order_relaxed);
+        };
+        snapshot.calls += get(Calls);
+        snapshot.bytes += get(Bytes);
+        snapshot.copies += get(Copies);
+        snapshot.timed_calls += get(TimedCalls);
+        snapshot.nanoseconds += get(Nanoseconds);
+        for (size_t index{0}; index < Number_Of_Variants; ++index) {
+            snapshot.variant_calls.at(index) += get(VariantCalls + index);
+        }
+        for (size_t index{0}; index < Stats_Histogram_Bins; ++index) {
+            snapshot.latency_histogram.at(index) +=
+                get(LatencyHistogram + index);
+        }
+    }
+
+    /**
+     * Clears counters. Calls which are running may keep their counts.
+     */
+    void reset() {
+        for (auto &counter : counters_) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    std::array<std::atomic<uint64_t>, Number_Of_Slots> counters_;
+};
+
+/**
+ Counters of all threads including exited ones
+ */
+class StatsRegistry {
+  public:
+    /**
+     * @return The registry which outlives threads calling at exit
+     */
+    static StatsRegistry &instance() {
+        static auto *registry = new StatsRegistry();
+        return *registry;
+    }
+
+    /**
+     * @return Counters of the calling thread
+     */
+    ThreadStats &local() {
+        thread_local Member member(*this);
+        return *member.stats;
+    }
+
+    /**
+     * @return Sums of counters of all threads
+     */
+    StatsSnapshot snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StatsSnapshot sums;
+        retired_.add_to(sums);
+        for (const auto *stats : members_) {
+            stats->add_to(sums);
+        }
+        return sums;
+    }
+
+    /**
+     * Clears counters of all threads
+     */
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.reset();
+        for (auto *stats : members_) {
+            stats->reset();
+        }
+    }
+
+  private:
+    /**
+     Registers counters of a thread and keeps them after it exits
+     */
+    struct Member {
+        explicit Member(StatsRegistry &registry)
+            : registry(registry), stats(new ThreadStats()) {
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+            registry.members_.push_back(stats.get());
+        }
+
+        ~Member() {
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+            StatsSnapshot sums;
+            stats->add_to(sums);
+            registry.retire(sums);
+            auto &members = registry.members_;
+            for (auto it = members.begin(); it != members.end(); ++it) {
+                if (*it == stats.get()) {
+                    members.erase(it);
+                    break;
+                }
+            }
+        }
+
+        StatsRegistry &registry;            ///< The owner
+        std::unique_ptr<ThreadStats> stats; ///< Counters of the thread
+    };
+
+    StatsRegistry() = default;
+
+    /**
+     * @param[in] sums Counters of a thread which exits
+     */
+    void retire(const StatsSnapshot &sums) {
+        retired_.add(ThreadStats::Calls, sums.calls);
+        retired_.add(ThreadStats::Bytes, sums.bytes);
+        retired_.add(ThreadStats::Copies, sums.copies);
+        retired_.add(ThreadStats::TimedCalls, sums.timed_calls);
+        retired_.add(ThreadStats::Nanoseconds, sums.nanoseconds);
+        for (size_t index{0}; index < Number_Of_Variants; ++index) {
+            retired_.add(ThreadStats::VariantCalls + index,
+                         sums.variant_calls.at(index));
+        }
+        for (size_t index{0}; index < Stats_Histogram_Bins; ++index) {
+            retired_.add(ThreadStats::LatencyHistogram + index,
+                         sums.latency_histogram.at(index));
+        }
+    }
+
+    std::mutex mutex_;                   ///< Guards members and retired
+    std::vector<ThreadStats *> members_; ///< Counters of running threads
+    ThreadStats retired_;                ///< Sums of exited threads
+};
+
+#ifdef POPCOUNT_NO_STATS
+/**
+ Records nothing
+ */
+class StatsScope {
+  public:
+    StatsScope(KernelVariant, size_t, bool) {}
+};
+#else  // POPCOUNT_NO_STATS
+/**
+ Records a call and times it until the scope ends if it reads many bytes
+ */
+class StatsScope {
+  public:
+    /**
+     * @param[in] variant The kernel variant which the call runs
+     * @param[in] n_bytes The number of bytes which the call reads
+     * @param[in] copied Whether the call copied its input to convert it
+     */
+    StatsScope(KernelVariant variant, size_t n_bytes, bool copied)
+        : stats_(StatsRegistry::instance().local()),
+          timed_(n_bytes >= Stats_Timed_Bytes) {
+        stats_.add(ThreadStats::Calls, 1);
+        stats_.add(ThreadStats::Bytes, n_bytes);
+        stats_.add(ThreadStats::Copies, copied ? 1 : 0);
+        stats_.add(ThreadStats::VariantCalls + static_cast<size_t>(variant),
+                   1);
+        if (timed_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StatsScope() {
+        if (!timed_) {
+            return;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        const auto nanoseconds = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count());
+        stats_.add(ThreadStats::TimedCalls, 1);
+        stats_.add(ThreadStats::Nanoseconds, nanoseconds);
+        stats_.add(ThreadStats::LatencyHistogram +
+                       stats_histogram_bin(nanoseconds),
+                   1);
+    }
+
+    StatsScope(const StatsScope &) = delete;
+    StatsScope &operator=(const StatsScope &) = delete;
+
+  private:
+    ThreadStats &stats_; ///< Counters of the calling thread
+    bool timed_;         ///< Whether to time the call
+    /// The start of the call
+    std::chrono::steady_clock::time_point start_;
+};
+#endif // POPCOUNT_NO_STATS
+
+/**
+ * Records a copy of an input which a binding converted before calling
+ */
+inline void record_stats_copy() {
+#ifndef POPCOUNT_NO_STATS
+    StatsRegistry::instance().local().add(ThreadStats::Copies, 1);
+#endif // POPCOUNT_NO_STATS
+}
+
+/**
+ * @return Sums of metrics of calls in all threads
+ */
+inline StatsSnapshot get_stats() {
+    return StatsRegistry::instance().snapshot();
+}
+
+/**
+ * Clears metrics of calls in all threads
+ */
+inline void reset_stats() {
+    StatsRegistry::instance().reset();
+}
+} // namespace popcount_core
+
+#endif // POPCOUNT_STATS_H
@@ -0,0 +1,150 @@
+#include "popcount_stream.h"
+#include "popcount_kernel.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace py_cpp_sample {
+namespace {
+/**
+ * Bins elements at any alignment as popcount_histogram_cpp() bins arrays
+ * @tparam UnsignedType The unsigned type of elements of the same width
+ * @param[in] src A pointer to whole elements
+ * @param[in] n_elements The number of elements in src
+ * @param[in] is_signed Whether to sign-extend elements
+ * @param[in,out] bins Bins to add the numbers of elements to
+ * @param[in] threads The number of threads or 0 for all cores
+ */
+template <typename UnsignedType>
+void count_elements(const uint8_t *src, size_t n_elements, bool is_signed,
+                    uint64_t *bins, size_t threads) {
+    using SignedType = typename std::make_signed<UnsignedType>::type;
+    constexpr auto stride = static_cast<ptrdiff_t>(sizeof(UnsignedType));
+    if (is_signed) {
+        popcount_histogram_kernel<SignedType>(src, stride, n_elements, bins,
+                                              threads);
+    } else {
+        popcount_histogram_kernel<UnsignedType>(src, stride, n_elements, bins,
+                                                threads);
+    }
+}
+} // namespace
+
+PopcountStream::PopcountStream(size_t itemsize, bool is_signed)
+    : itemsize_(itemsize), is_signed_(is_signed) {
+    switch (itemsize) {
+    case 0:
+        break;
+    case 1:
+    case 2:
+    case 4:
+    case 8:
+        // Sign extension makes 65 bins as popcount_histogram_bins() does
+        histogram_.assign((is_signed ? 64 : itemsize * 8) + 1, 0);
+        break;
+    default:
+        throw std::invalid_argument("itemsize must be 0, 1, 2, 4 or 8");
+    }
+}
+
+PopcountStream::PopcountStream(const PopcountStream &other) {
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    itemsize_ = other.itemsize_;
+    is_signed_ = other.is_signed_;
+    total_ = other.total_;
+    size_ = other.size_;
+    tail_ = other.tail_;
+    tail_size_ = other.tail_size_;
+    histogram_ = other.histogram_;
+}
+
+void PopcountStream::update(const void *src, size_t size, size_t threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto bytes = static_cast<const uint8_t *>(src);
+    size_ += size;
+
+    // Complete a block with bytes carried from previous chunks
+    if (tail_size_ > 0) {
+        const auto n_bytes = std::min(Block_Bytes - tail_size_, size);
+        std::memcpy(tail_.data() + tail_size_, bytes, n_bytes);
+        tail_size_ += n_bytes;
+        bytes += n_bytes;
+        size -= n_bytes;
+        if (tail_size_ < Block_Bytes) {
+            return;
+        }
+        count_blocks(tail_.data(), Block_Bytes, 1);
+        tail_size_ = 0;
+    }
+
+    const auto body_size = size - size % Block_Bytes;
+    count_blocks(bytes, body_size, threads);
+    tail_size_ = size - body_size;
+    if (tail_size_ > 0) {
+        std::memcpy(tail_.data(), bytes + body_size, tail_size_);
+    }
+}
+
+uint64_t PopcountStream::total() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_ + popcount_total_kernel(tail_.data(), tail_size_);
+}
+
+uint64_t PopcountStream::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+size_t PopcountStream::itemsize() const {
+    return itemsize_;
+}
+
+std::vector<uint64_t> PopcountStream::histogram() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto bins = histogram_;
+    const auto n_elements = (itemsize_ > 0) ? (tail_size_ / itemsize_) : 0;
+    count_histogram(tail_.data(), n_elements, bins.data(), 1);
+    return bins;
+}
+
+void PopcountStream::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    total_ = 0;
+    size_ = 0;
+    tail_size_ = 0;
+    std::fill(histogram_.begin(), histogram_.end(), 0);
+}
+
+void PopcountStream::count_blocks(const uint8_t *src, size_t size,
+                                  size_t threads) {
+    if (size == 0) {
+        return;
+    }
+
+    total_ += popcount_total_kernel(src, size, threads);
+
+    const auto n_elements = (itemsize_ > 0) ? (size / itemsize_) : 0;
+    count_histogram(src, n_elements, histogram_.data(), threads);
+}
+
+void PopcountStream::count_histogram(const uint8_t *src, size_t n_elements,
+                                     uint64_t *bins, size_t threads) const {
+    switch (itemsize_) {
+    case 1:
+        count_elements<uint8_t>(src, n_elements, is_signed_, bins, threads);
+        break;
+    case 2:
+        count_elements<uint16_t>(src, n_elements, is_signed_, bins, threads);
+        break;
+    case 4:
+        count_elements<uint32_t>(src, n_elements, is_signed_, bins, threads);
+        break;
+    case 8:
+        count_elements<uint64_t>(src, n_elements, is_signed_, bins, threads);
+        break;
+    default:
+        break;
+    }
+}
+} // namespace py_cpp_sample
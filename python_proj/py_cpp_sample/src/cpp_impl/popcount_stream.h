@@ -0,0 +1,107 @@
+#ifndef CPP_IMPL_POPCOUNT_STREAM_H
+#define CPP_IMPL_POPCOUNT_STREAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ C++ implementation
+ */
+namespace py_cpp_sample {
+/**
+ Accumulates the number of 1's of chunks of a byte stream as hashlib
+ accumulates digests. Chunks can have any sizes and bytes after the last
+ whole block of a chunk are carried to the next chunk, so kernels always
+ run on whole blocks and elements are not split between chunks. A lock
+ serializes calls as hashlib objects do, so threads can update a stream
+ without the GIL.
+ */
+class PopcountStream {
+  public:
+    /**
+     * @param[in] itemsize 0 to count totals only or 1, 2, 4 or 8 to count
+     *                     a histogram of elements as well
+     * @param[in] is_signed Whether to sign-extend elements to 64 bits as
+     *                      popcount_histogram_kernel() does
+     * @throw std::invalid_argument if itemsize is not one of them
+     */
+    explicit PopcountStream(size_t itemsize = 0, bool is_signed = false);
+
+    /**
+     * @param[in] other A stream to copy its counts and carried bytes
+     */
+    PopcountStream(const PopcountStream &other);
+
+    PopcountStream &operator=(const PopcountStream &) = delete;
+
+    /**
+     * Counts a chunk of the stream
+     * @param[in] src A pointer to a chunk
+     * @param[in] size The size of src in bytes
+     * @param[in] threads The number of threads or 0 for all cores
+     */
+    void update(const void *src, size_t size, size_t threads = 1);
+
+    /**
+     * @return The number of 1's in all bytes so far
+     */
+    uint64_t total() const;
+
+    /**
+     * @return The number of bytes so far
+     */
+    uint64_t size() const;
+
+    /**
+     * @return 0 or the size of elements in bytes
+     */
+    size_t itemsize() const;
+
+    /**
+     * @return The numbers of elements which have 0 to itemsize * 8 1's or
+     *         0 to 64 1's for signed elements. Bytes of an element which
+     *         is not complete yet are not counted. Empty if itemsize is 0.
+     */
+    std::vector<uint64_t> histogram() const;
+
+    /**
+     * Clears counts and carried bytes
+     */
+    void reset();
+
+  private:
+    /**
+     * @param[in] src A pointer to whole blocks
+     * @param[in] size The size of src in bytes which is a multiple of
+     *                 blocks
+     * @param[in] threads The number of threads or 0 for all cores
+     */
+    void count_blocks(const uint8_t *src, size_t size, size_t threads);
+
+    /**
+     * @param[in] src A pointer to whole elements at any alignment
+     * @param[in] n_elements The number of elements in src
+     * @param[in,out] bins Bins to add the numbers of elements to
+     * @param[in] threads The number of threads or 0 for all cores
+     */
+    void count_histogram(const uint8_t *src, size_t n_elements,
+                         uint64_t *bins, size_t threads) const;
+
+    /// Kernels count bytes in blocks which are multiples of elements
+    static constexpr size_t Block_Bytes = 64;
+
+    size_t itemsize_{0};                     ///< 0 or the size of elements
+    bool is_signed_{false};                  ///< Whether elements are signed
+    uint64_t total_{0};                      ///< 1's in whole blocks
+    uint64_t size_{0};                       ///< All bytes so far
+    std::array<uint8_t, Block_Bytes> tail_{}; ///< Carried bytes
+    size_t tail_size_{0};                    ///< The number of carried bytes
+    std::vector<uint64_t> histogram_;        ///< Elements in whole blocks
+    mutable std::mutex mutex_;               ///< Guards the members above
+};
+} // namespace py_cpp_sample
+
+#endif // CPP_IMPL_POPCOUNT_STREAM_H
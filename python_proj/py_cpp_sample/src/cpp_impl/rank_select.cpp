@@ -0,0 +1,233 @@
+#include "rank_select.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Queries run POPCNT on CPUs which have it without -m flags
+#if defined(__x86_64__) || defined(__i386__)
+#define RANK_SELECT_QUERY __attribute__((target_clones("popcnt", "default")))
+#else
+#define RANK_SELECT_QUERY
+#endif
+
+namespace popcount_core {
+namespace {
+constexpr size_t Word_Bits = 64;
+constexpr size_t Block_Words = 8;
+constexpr size_t Block_Bits = Block_Words * Word_Bits;
+constexpr size_t Entry_Blocks = 4;
+constexpr size_t Entry_Words = Block_Words * Entry_Blocks;
+constexpr size_t Entry_Bits = Entry_Words * Word_Bits;
+
+// An absolute count per 2^32 bits keeps relative counts in 32 bits
+constexpr unsigned Absolute_Shift = 21;
+constexpr size_t Absolute_Mask = (size_t{1} << Absolute_Shift) - 1;
+constexpr uint64_t Relative_Mask = 0xffffffffu;
+constexpr unsigned Field_Shift = 32;
+constexpr unsigned Field_Bits = 10;
+constexpr uint64_t Field_Mask = (uint64_t{1} << Field_Bits) - 1;
+
+constexpr uint64_t Sample_Interval = 8192;
+
+// Count 256 KiB of bits per call of the kernel
+constexpr size_t Build_Chunk_Entries = 1024;
+
+/**
+ * @param[in] word A word
+ * @return The number of 1's in the word
+ */
+inline uint64_t count_ones(uint64_t word) {
+    return static_cast<uint64_t>(__builtin_popcountll(word));
+}
+
+/**
+ * @param[in] packed An entry of the directory
+ * @param[in] block An index of the first three blocks in the entry
+ * @return The number of 1's in the block
+ */
+inline uint64_t block_count(uint64_t packed, size_t block) {
+    return (packed >> (Field_Shift + Field_Bits * block)) & Field_Mask;
+}
+
+/**
+ * @param[in] word A word
+ * @param[in] nth A 0-based ordinal of 1's less than the number of 1's in word
+ * @return The position of the nth 1 in word
+ */
+inline size_t select_in_word(uint64_t word, uint64_t nth) {
+    size_t offset = 0;
+    for (;;) {
+        const auto byte_count = count_ones(word & 0xffu);
+        if (nth < byte_count) {
+            break;
+        }
+        nth -= byte_count;
+        word >>= 8;
+        offset += 8;
+    }
+
+    for (; nth > 0; --nth) {
+        word &= word - 1;
+    }
+    return offset + static_cast<size_t>(__builtin_ctzll(word));
+}
+} // namespace
+
+RankSelectBitvector::RankSelectBitvector(const void *bits, size_t size,
+                                         KernelVariant variant)
+    : size_(size) {
+    const auto n_entries = (size + Entry_Bits - 1) / Entry_Bits;
+    words_.assign(n_entries * Entry_Words, 0);
+    if (size > 0) {
+        std::memcpy(words_.data(), bits, (size + 7) / 8);
+    }
+
+    // Ignore bits after the last one in the last byte
+    const auto tail_bits = size % Word_Bits;
+    if (tail_bits > 0) {
+        words_[size / Word_Bits] &= (uint64_t{1} << tail_bits) - 1;
+    }
+
+    entries_.assign(n_entries + 1, 0);
+    absolute_.assign((n_entries >> Absolute_Shift) + 1, 0);
+    const auto popcount_words = popcount_uint64_kernel(variant);
+    std::vector<uint8_t> counts(Build_Chunk_Entries * Entry_Words);
+
+    uint64_t total = 0;
+    for (size_t chunk = 0; chunk < n_entries; chunk += Build_Chunk_Entries) {
+        const auto chunk_entries =
+            std::min(Build_Chunk_Entries, n_entries - chunk);
+        popcount_words(words_.data() + chunk * Entry_Words,
+                       chunk_entries * Entry_Words, counts.data());
+
+        const uint8_t *count = counts.data();
+        for (size_t entry = chunk; entry < chunk + chunk_entries; ++entry) {
+            if ((entry & Absolute_Mask) == 0) {
+                absolute_[entry >> Absolute_Shift] = total;
+            }
+
+            auto packed = total - absolute_[entry >> Absolute_Shift];
+            uint64_t entry_total = 0;
+            for (size_t block = 0; block < Entry_Blocks; ++block) {
+                uint64_t block_total = 0;
+                for (size_t i = 0; i < Block_Words; ++i, ++count) {
+                    block_total += *count;
+                }
+                if (block + 1 < Entry_Blocks) {
+                    packed |= block_total << (Field_Shift + Field_Bits * block);
+                }
+                entry_total += block_total;
+            }
+            entries_[entry] = packed;
+
+            // Sample entries which hold every Sample_Interval-th 1
+            while (samples_.size() * Sample_Interval < total + entry_total) {
+                samples_.push_back(entry);
+            }
+            total += entry_total;
+        }
+    }
+
+    // The sentinel gives the last entry its end
+    if ((n_entries & Absolute_Mask) == 0) {
+        absolute_[n_entries >> Absolute_Shift] = total;
+    }
+    entries_[n_entries] = total - absolute_[n_entries >> Absolute_Shift];
+    count_ = total;
+}
+
+size_t RankSelectBitvector::size() const {
+    return size_;
+}
+
+uint64_t RankSelectBitvector::count() const {
+    return count_;
+}
+
+bool RankSelectBitvector::get(size_t index) const {
+    if (index >= size_) {
+        throw std::out_of_range("index is out of range");
+    }
+    return ((words_[index / Word_Bits] >> (index % Word_Bits)) & 1) != 0;
+}
+
+RANK_SELECT_QUERY
+uint64_t RankSelectBitvector::rank(size_t index) const {
+    if (index > size_) {
+        throw std::out_of_range("index is out of range");
+    }
+
+    const auto entry = index / Entry_Bits;
+    const auto packed = entries_[entry];
+    auto total = entry_rank(entry);
+
+    const auto block = (index / Block_Bits) % Entry_Blocks;
+    for (size_t i = 0; i < block; ++i) {
+        total += block_count(packed, i);
+    }
+
+    const auto word = index / Word_Bits;
+    for (auto i = entry * Entry_Words + block * Block_Words; i < word; ++i) {
+        total += count_ones(words_[i]);
+    }
+
+    const auto bit = index % Word_Bits;
+    if (bit > 0) {
+        total += count_ones(words_[word] & ((uint64_t{1} << bit) - 1));
+    }
+    return total;
+}
+
+RANK_SELECT_QUERY
+size_t RankSelectBitvector::select(uint64_t nth) const {
+    if (nth >= count_) {
+        throw std::out_of_range("nth is out of range");
+    }
+
+    // Samples narrow entries which hold the nth 1 to [lower, upper)
+    const auto sample = static_cast<size_t>(nth / Sample_Interval);
+    auto lower = static_cast<size_t>(samples_[sample]);
+    auto upper = (sample + 1 < samples_.size())
+                     ? static_cast<size_t>(samples_[sample + 1]) + 1
+                     : entries_.size() - 1;
+    while ((upper - lower) > 1) {
+        const auto middle = lower + (upper - lower) / 2;
+        if (entry_rank(middle) <= nth) {
+            lower = middle;
+        } else {
+            upper = middle;
+        }
+    }
+
+    auto remaining = nth - entry_rank(lower);
+    const auto packed = entries_[lower];
+    size_t block = 0;
+    for (; block + 1 < Entry_Blocks; ++block) {
+        const auto block_total = block_count(packed, block);
+        if (remaining < block_total) {
+            break;
+        }
+        remaining -= block_total;
+    }
+
+    auto word = lower * Entry_Words + block * Block_Words;
+    for (;; ++word) {
+        const auto word_total = count_ones(words_[word]);
+        if (remaining < word_total) {
+            break;
+        }
+        remaining -= word_total;
+    }
+    return word * Word_Bits + select_in_word(words_[word], remaining);
+}
+
+size_t RankSelectBitvector::overhead_bytes() const {
+    return (entries_.size() + absolute_.size() + samples_.size()) *
+           sizeof(uint64_t);
+}
+
+uint64_t RankSelectBitvector::entry_rank(size_t entry) const {
+    return absolute_[entry >> Absolute_Shift] +
+           (entries_[entry] & Relative_Mask);
+}
+} // namespace popcount_core
@@ -0,0 +1,95 @@
+#ifndef POPCOUNT_RANK_SELECT_H
+#define POPCOUNT_RANK_SELECT_H
+
+/*
+ A succinct bitvector on the word kernels of popcount_core.h. The Python
+ and R packages have their own copies of this header and rank_select.cpp
+ as they have of popcount_core.h:
+
+ python_proj/py_cpp_sample/src/cpp_impl/rank_select.h (master)
+ r_proj/rCppSample/src/rank_select.h
+ */
+
+#include "popcount_core.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ Binding-agnostic popcount kernels
+ */
+namespace popcount_core {
+/**
+ A succinct bitvector which answers rank in O(1) and select in near O(1)
+
+ Directories interleave counts as poppy does. An entry per 2048 bits
+ holds the number of 1's before it in the low 32 bits and the numbers of
+ 1's in the first three 512-bit blocks in three 10-bit fields. Absolute
+ counts every 2^32 bits and the entry of every 8192nd 1 follow them.
+ They take 3.125% of the bits and up to 0.8% more for samples.
+ */
+class RankSelectBitvector {
+  public:
+    /**
+     * Builds directories in one pass with the SIMD popcount kernels
+     * @param[in] bits A buffer of bits which holds bit i in bit (i % 8)
+     *                 of byte (i / 8) as numpy.packbits(bitorder="little")
+     *                 and packBits() of R do
+     * @param[in] size The number of bits in the buffer
+     * @param[in] variant A kernel variant to count 1's of words with
+     */
+    RankSelectBitvector(const void *bits, size_t size, KernelVariant variant);
+
+    /**
+     * @return The number of bits
+     */
+    size_t size() const;
+
+    /**
+     * @return The number of 1's
+     */
+    uint64_t count() const;
+
+    /**
+     * @param[in] index The position of a bit
+     * @return Whether the bit is 1
+     * @throw std::out_of_range if index is not less than size()
+     */
+    bool get(size_t index) const;
+
+    /**
+     * @param[in] index A position up to size()
+     * @return The number of 1's before index
+     * @throw std::out_of_range if index is greater than size()
+     */
+    uint64_t rank(size_t index) const;
+
+    /**
+     * @param[in] nth A 0-based ordinal of 1's
+     * @return The position of the nth 1
+     * @throw std::out_of_range if nth is not less than count()
+     */
+    size_t select(uint64_t nth) const;
+
+    /**
+     * @return The size of directories and samples in bytes
+     */
+    size_t overhead_bytes() const;
+
+  private:
+    /**
+     * @param[in] entry An index of entries including the sentinel
+     * @return The number of 1's before the entry
+     */
+    uint64_t entry_rank(size_t entry) const;
+
+    size_t size_{0};                 ///< The number of bits
+    uint64_t count_{0};              ///< The number of 1's
+    std::vector<uint64_t> words_;    ///< Bits padded to whole entries
+    std::vector<uint64_t> entries_;  ///< Interleaved counts and a sentinel
+    std::vector<uint64_t> absolute_; ///< Counts before every 2^32 bits
+    std::vector<uint64_t> samples_;  ///< Entries of every 8192nd 1
+};
+} // namespace popcount_core
+
+#endif // POPCOUNT_RANK_SELECT_H
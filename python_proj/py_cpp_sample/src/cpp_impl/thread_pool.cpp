@@ -0,0 +1,306 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace popcount_core {
+namespace {
+constexpr uint64_t Bounds_Mask = std::numeric_limits<uint32_t>::max();
+
+/**
+ * @param[in] begin The first index of chunks
+ * @param[in] end The last index of chunks + 1
+ * @return begin and end in a word
+ */
+inline uint64_t pack_bounds(uint64_t begin, uint64_t end) {
+    return (begin << 32) | end;
+}
+
+/**
+ * @return The process which started the pool
+ */
+pid_t owner_process() {
+    static const pid_t pid = getpid();
+    return pid;
+}
+
+/// The executor which AsyncExecutor::instance() started
+std::atomic<AsyncExecutor *> started_executor{nullptr};
+
+/**
+ A singleton which is destroyed at exit only in the process which created
+ it. A forked child does not have the threads of its parent and joining
+ them or destroying condition variables which they waited on blocks.
+ */
+template <typename Type> class ProcessLocal {
+  public:
+    /**
+     * @param[in] object An object to own
+     */
+    explicit ProcessLocal(Type *object)
+        : object_(object), owner_process_(getpid()) {}
+
+    ~ProcessLocal() {
+        if (getpid() == owner_process_) {
+            delete object_;
+        }
+    }
+
+    ProcessLocal(const ProcessLocal &) = delete;
+    ProcessLocal &operator=(const ProcessLocal &) = delete;
+
+    /**
+     * @return The object
+     */
+    Type &get() const {
+        return *object_;
+    }
+
+  private:
+    Type *object_;
+    const pid_t owner_process_;
+};
+} // namespace
+
+ThreadPool &ThreadPool::instance() {
+    const auto n_threads =
+        static_cast<size_t>(std::thread::hardware_concurrency());
+    owner_process();
+    static const ProcessLocal<ThreadPool> pool{
+        new ThreadPool{(n_threads > 1) ? (n_threads - 1) : 0}};
+    return pool.get();
+}
+
+ThreadPool::ThreadPool(size_t n_workers)
+    : ranges_(new ChunkRange[n_workers + 1]) {
+    workers_.reserve(n_workers);
+    for (size_t index = 0; index < n_workers; ++index) {
+        // Slot 0 is for a caller thread
+        workers_.emplace_back(&ThreadPool::worker_loop, this, index + 1);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_condition_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers_.size() + 1;
+}
+
+size_t ThreadPool::threads_to_use(size_t threads) const {
+    // A forked child process does not have the workers
+    if (getpid() != owner_process()) {
+        return 1;
+    }
+    return (threads == 0) ? size() : std::min(threads, size());
+}
+
+void ThreadPool::run(size_t n_chunks, size_t threads,
+                     const ChunkFunction &func) {
+    if (n_chunks > Bounds_Mask) {
+        throw std::invalid_argument("Too many chunks for the thread pool");
+    }
+
+    // Another thread running a job keeps the workers busy
+    std::unique_lock<std::mutex> job_lock(job_mutex_, std::defer_lock);
+    const auto n_threads = std::min(threads_to_use(threads), n_chunks);
+    if ((n_threads <= 1) || !job_lock.try_lock()) {
+        for (size_t index = 0; index < n_chunks; ++index) {
+            func(index);
+        }
+        return;
+    }
+
+    // Give each thread a contiguous range to keep prefetching effective
+    for (size_t slot = 0; slot < n_threads; ++slot) {
+        const uint64_t begin = n_chunks * slot / n_threads;
+        const uint64_t end = n_chunks * (slot + 1) / n_threads;
+        ranges_[slot].bounds.store(pack_bounds(begin, end),
+                                   std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        func_ = &func;
+        active_slots_ = n_threads;
+        pending_slots_ = n_threads - 1;
+        ++generation_;
+    }
+    start_condition_.notify_all();
+
+    process(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_condition_.wait(lock, [this] { return pending_slots_ == 0; });
+    func_ = nullptr;
+}
+
+void ThreadPool::worker_loop(size_t slot) {
+    uint64_t generation{0};
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_condition_.wait(lock, [this, generation] {
+                return stopping_ || (generation_ != generation);
+            });
+            if (stopping_) {
+                return;
+            }
+            generation = generation_;
+            if (slot >= active_slots_) {
+                continue;
+            }
+        }
+
+        process(slot);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_slots_ == 0) {
+            done_condition_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::process(size_t slot) {
+    do {
+        size_t chunk_index{0};
+        while (pop_chunk(slot, chunk_index)) {
+            (*func_)(chunk_index);
+        }
+    } while (steal_chunks(slot));
+}
+
+bool ThreadPool::pop_chunk(size_t slot, size_t &chunk_index) {
+    auto &bounds = ranges_[slot].bounds;
+    auto current = bounds.load(std::memory_order_acquire);
+    for (;;) {
+        const auto begin = current >> 32;
+        const auto end = current & Bounds_Mask;
+        if (begin >= end) {
+            return false;
+        }
+        if (bounds.compare_exchange_weak(current, pack_bounds(begin + 1, end),
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            chunk_index = static_cast<size_t>(begin);
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::steal_chunks(size_t slot) {
+    for (size_t offset = 1; offset < active_slots_; ++offset) {
+        const auto victim = (slot + offset) % active_slots_;
+        auto &bounds = ranges_[victim].bounds;
+        auto current = bounds.load(std::memory_order_acquire);
+        for (;;) {
+            const auto begin = current >> 32;
+            const auto end = current & Bounds_Mask;
+            if (begin >= end) {
+                break;
+            }
+            // Take the latter half and leave the former to the victim
+            const auto middle = begin + (end - begin) / 2;
+            if (bounds.compare_exchange_weak(
+                    current, pack_bounds(begin, middle),
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {
+                // Other threads can steal from the stolen range
+                ranges_[slot].bounds.store(pack_bounds(middle, end),
+                                           std::memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+AsyncExecutor &AsyncExecutor::instance() {
+    const auto n_threads =
+        static_cast<size_t>(std::thread::hardware_concurrency());
+    static const ProcessLocal<AsyncExecutor> executor{
+        new AsyncExecutor{std::max(n_threads, size_t{1})}};
+    started_executor.store(&executor.get(), std::memory_order_release);
+    return executor.get();
+}
+
+AsyncExecutor *AsyncExecutor::started() {
+    return started_executor.load(std::memory_order_acquire);
+}
+
+AsyncExecutor::AsyncExecutor(size_t n_workers) : owner_process_(getpid()) {
+    workers_.reserve(n_workers);
+    for (size_t index = 0; index < n_workers; ++index) {
+        workers_.emplace_back(&AsyncExecutor::worker_loop, this);
+    }
+}
+
+AsyncExecutor::~AsyncExecutor() {
+    shutdown();
+}
+
+size_t AsyncExecutor::size() const {
+    return workers_.size();
+}
+
+void AsyncExecutor::submit(Task task) {
+    // A forked child process does not have the workers
+    if (getpid() != owner_process_) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("The executor is shut down");
+        }
+        tasks_.push_back(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+void AsyncExecutor::shutdown() {
+    // A forked child does not have the workers and submit() runs tasks in
+    // callers. The workers may have held the lock at fork.
+    if (getpid() != owner_process_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto &worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void AsyncExecutor::worker_loop() {
+    for (;;) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock,
+                            [this] { return stopping_ || !tasks_.empty(); });
+            // Run queued tasks before stopping
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+} // namespace popcount_core
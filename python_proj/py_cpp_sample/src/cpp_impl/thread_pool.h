@@ -0,0 +1,167 @@
+#ifndef POPCOUNT_THREAD_POOL_H
+#define POPCOUNT_THREAD_POOL_H
+
+/*
+ Threads which run kernels in parallel and in the background. The Python
+ and R packages have their own copies of this header and thread_pool.cpp
+ as they have of popcount_core.h:
+
+ python_proj/py_cpp_sample/src/cpp_impl/thread_pool.h (master)
+ r_proj/rCppSample/src/thread_pool.h
+
+ Chunk functions and tasks run on worker threads and must not call Python
+ or R APIs.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+/**
+ Binding-agnostic popcount kernels
+ */
+namespace popcount_core {
+/**
+ A persistent thread pool which runs chunks of a job with work stealing
+ */
+class ThreadPool {
+  public:
+    /**
+     * @param[in] chunk_index An index of a chunk to process
+     */
+    using ChunkFunction = std::function<void(size_t chunk_index)>;
+
+    /**
+     * @return The pool which starts on the first call and is reused after it.
+     *         Only the process which started it destroys it at exit.
+     */
+    static ThreadPool &instance();
+
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @return The number of threads including a caller thread
+     */
+    size_t size() const;
+
+    /**
+     * @param[in] threads The number of threads to use or 0 for all
+     * @return The number of threads which run() uses
+     */
+    size_t threads_to_use(size_t threads) const;
+
+    /**
+     * Calls func for each chunk in [0, n_chunks) and waits for all chunks.
+     * A caller thread processes chunks as well.
+     * @param[in] n_chunks The number of chunks
+     * @param[in] threads The number of threads to use or 0 for all
+     * @param[in] func A function which must not throw exceptions
+     */
+    void run(size_t n_chunks, size_t threads, const ChunkFunction &func);
+
+  private:
+    /**
+     * @param[in] n_workers The number of threads except a caller thread
+     */
+    explicit ThreadPool(size_t n_workers);
+
+    void worker_loop(size_t slot);
+    void process(size_t slot);
+    bool pop_chunk(size_t slot, size_t &chunk_index);
+    bool steal_chunks(size_t slot);
+
+    /**
+     Unprocessed chunks [begin, end) of a thread packed in one word.
+     The owner takes chunks from its front and others steal from its back.
+     Padding keeps ranges in different cache lines without aligned new.
+     */
+    struct ChunkRange {
+        std::atomic<uint64_t> bounds{0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::vector<std::thread> workers_;
+    std::unique_ptr<ChunkRange[]> ranges_;
+
+    // Run one job at a time and count serially in other callers
+    std::mutex job_mutex_;
+    std::mutex mutex_;
+    std::condition_variable start_condition_;
+    std::condition_variable done_condition_;
+    uint64_t generation_{0};
+    size_t active_slots_{0};
+    size_t pending_slots_{0};
+    bool stopping_{false};
+    const ChunkFunction *func_{nullptr};
+};
+
+/**
+ Persistent worker threads which start submitted tasks in FIFO order.
+ Several workers run tasks at once, so tasks can finish in any order.
+ */
+class AsyncExecutor {
+  public:
+    using Task = std::function<void()>;
+
+    /**
+     * @return The executor which starts on the first call. Only the
+     *         process which started it destroys it at exit.
+     */
+    static AsyncExecutor &instance();
+
+    /**
+     * @return The executor if instance() has started it or nullptr
+     */
+    static AsyncExecutor *started();
+
+    ~AsyncExecutor();
+    AsyncExecutor(const AsyncExecutor &) = delete;
+    AsyncExecutor &operator=(const AsyncExecutor &) = delete;
+
+    /**
+     * @return The number of worker threads
+     */
+    size_t size() const;
+
+    /**
+     * Runs a task in a caller thread in a forked child process
+     * @param[in] task A task which must not throw exceptions
+     * @throw std::runtime_error if the executor is shut down
+     */
+    void submit(Task task);
+
+    /**
+     * Runs queued tasks and joins the workers. Callers must not hold locks
+     * which the tasks take. A forked child process does nothing as it
+     * does not have the workers.
+     */
+    void shutdown();
+
+  private:
+    /**
+     * @param[in] n_workers The number of worker threads
+     */
+    explicit AsyncExecutor(size_t n_workers);
+
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Task> tasks_;
+    bool stopping_{false};
+    const pid_t owner_process_;
+};
+} // namespace popcount_core
+
+#endif // POPCOUNT_THREAD_POOL_H
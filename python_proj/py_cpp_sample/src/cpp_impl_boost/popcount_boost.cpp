@@ -4,4 +4,10 @@ BOOST_PYTHON_MODULE(py_cpp_sample_cpp_impl_boost) {
     Py_Initialize();
     boost::python::numpy::initialize();
     boost::python::def("popcount_cpp_boost", py_cpp_sample::popcount_cpp_boost);
+    boost::python::def("popcount_total_cpp_boost",
+                       py_cpp_sample::popcount_total_boost);
+    boost::python::def("get_kernel_variant_boost",
+                       py_cpp_sample::get_kernel_variant_name_boost);
+    boost::python::def("set_kernel_variant_boost",
+                       py_cpp_sample::set_kernel_variant_name_boost);
 }
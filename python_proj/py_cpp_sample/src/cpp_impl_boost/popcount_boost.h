@@ -4,6 +4,7 @@
 #include <boost/python.hpp>
 #include <boost/python/numpy.hpp>
 #include <cstdint>
+#include <string>
 
 /**
  C++ implementation
@@ -13,10 +14,32 @@ using Count = uint8_t;
 
 /**
  * @param[in] xs An integer array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or a uint8 array as long as xs to write counts
  * @return The number of 1's of each element in xs
  */
 extern boost::python::numpy::ndarray
-popcount_cpp_boost(const boost::python::numpy::ndarray &xs);
+popcount_cpp_boost(const boost::python::numpy::ndarray &xs,
+                   size_t threads = 1,
+                   const boost::python::object &out = boost::python::object());
+
+/**
+ * @param[in] xs An integer array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's of elements in xs
+ */
+extern uint64_t popcount_total_boost(const boost::python::numpy::ndarray &xs,
+                                     size_t threads = 1);
+
+/**
+ * @return The name of the kernel variant which popcount_cpp_boost runs
+ */
+extern std::string get_kernel_variant_name_boost();
+
+/**
+ * @param[in] name The name of a kernel variant or "auto"
+ */
+extern void set_kernel_variant_name_boost(const std::string &name);
 } // namespace py_cpp_sample
 
 #endif // CPP_IMPL_BOOST_POPCOUNT_BOOST_H
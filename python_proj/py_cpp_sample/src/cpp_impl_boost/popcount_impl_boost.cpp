@@ -1,72 +1,165 @@
 #include "popcount_boost.h"
-#include <boost/type_traits.hpp>
-#include <limits>
+#include "popcount_kernel.h"
 #include <stdexcept>
 #include <type_traits>
 
 namespace py_cpp_sample {
+namespace {
+constexpr const char *Type_Error_Message =
+    "xs must be a 1-D np.ndarray(np.uint8|np.uint64)";
+
+/**
+ Releases the GIL in a scope as pybind11::gil_scoped_release does
+ */
+class ScopedGilRelease {
+  public:
+    ScopedGilRelease() : state_(PyEval_SaveThread()) {}
+    ~ScopedGilRelease() {
+        PyEval_RestoreThread(state_);
+    }
+    ScopedGilRelease(const ScopedGilRelease &) = delete;
+    ScopedGilRelease &operator=(const ScopedGilRelease &) = delete;
+
+  private:
+    PyThreadState *state_;
+};
+
+/**
+ * @param[in] out None or an array to write counts
+ * @param[in] size The number of elements in an input array
+ * @return out or a new array
+ */
+boost::python::numpy::ndarray prepare_counts_boost(
+    const boost::python::object &out, Py_intptr_t size) {
+    const boost::python::numpy::dtype data_type =
+        boost::python::numpy::dtype::get_builtin<Count>();
+    if (out.is_none()) {
+        // Kernels overwrite all elements and need not zeros
+        const boost::python::tuple shape = boost::python::make_tuple(size);
+        return boost::python::numpy::empty(shape, data_type);
+    }
+
+    // Do not convert out because we must write to the array itself
+    boost::python::extract<boost::python::numpy::ndarray> extracted(out);
+    if (!extracted.check()) {
+        throw std::invalid_argument("out must be a numpy.ndarray");
+    }
+    boost::python::numpy::ndarray counts = extracted();
+    const bool writeable =
+        (counts.get_flags() & boost::python::numpy::ndarray::WRITEABLE) != 0;
+    if ((counts.get_dtype() != data_type) || (counts.get_nd() != 1) ||
+        (counts.shape(0) != size) || !writeable) {
+        throw std::invalid_argument(
+            "out must be a writable 1-D uint8 array as long as xs");
+    }
+    return counts;
+}
+} // namespace
+
 /**
  * @tparam SourceType The type of xs elements
  * @param[in] xs An integer array
+ * @param[in] threads The number of threads or 0 for all cores
+ * @param[in] out None or an array to write counts
  * @return The number of 1's of each element in xs
  */
 template <typename SourceType>
 boost::python::numpy::ndarray
-popcount_cpp_impl_boost(const boost::python::numpy::ndarray &xs) {
-    // Assuming NumPy arrays have C-like dense memory layout
-    if (xs.strides(0) != sizeof(SourceType)) {
-        throw std::runtime_error("Unexpected array layout");
-    }
-
+popcount_cpp_impl_boost(const boost::python::numpy::ndarray &xs,
+                        size_t threads, const boost::python::object &out) {
+    // Kernels read and write views at strides in place
     auto size = xs.shape(0);
-    const boost::python::tuple shape = boost::python::make_tuple(size);
-    const boost::python::numpy::dtype data_type =
-        boost::python::numpy::dtype::get_builtin<Count>();
-    auto counts = boost::python::numpy::zeros(shape, data_type);
-    if (counts.strides(0) != sizeof(Count)) {
-        throw std::runtime_error("Unexpected array layout");
-    }
+    auto counts = prepare_counts_boost(out, size);
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const auto dst_stride = static_cast<ptrdiff_t>(counts.strides(0));
 
-    const SourceType *src = reinterpret_cast<const SourceType *>(xs.get_data());
+    const char *src = xs.get_data();
     Count *dst = reinterpret_cast<Count *>(counts.get_data());
-    for (decltype(size) i{0}; i < size; ++i) {
-        const auto value = src[i];
-#ifdef __GNUC__
-        using PopcountArg = unsigned long long;
-        static_assert(std::is_unsigned<SourceType>::value, "Must be unsigned");
-        static_assert(std::is_unsigned<PopcountArg>::value, "Must be unsigned");
-        static_assert(std::numeric_limits<SourceType>::max() <=
-                          std::numeric_limits<PopcountArg>::max(),
-                      "Avoid narrowing casting");
-#ifndef __clang__
-        static_assert(
-            std::is_same<PopcountArg,
-                         boost::function_traits<decltype(
-                             __builtin_popcountll)>::arg1_type>::value,
-            "Pass the correct argument to __builtin_popcountll");
-#endif
-        const auto count = static_cast<Count>(__builtin_popcountll(value));
-#else
-#error Use an alternative of __builtin_popcountll
-#endif
-        dst[i] = count;
+    static_assert(std::is_unsigned<SourceType>::value, "Must be unsigned");
+    if (static_cast<size_t>(size) < Small_Array_Size) {
+        popcount_strided_kernel<SourceType>(
+            src, src_stride, static_cast<size_t>(size), dst, dst_stride);
+        return counts;
+    }
+    {
+        // Other Python threads run while counting
+        ScopedGilRelease release;
+        popcount_strided_kernel<SourceType>(src, src_stride,
+                                            static_cast<size_t>(size), dst,
+                                            dst_stride, threads);
     }
     return counts;
 }
 
 boost::python::numpy::ndarray
-popcount_cpp_boost(const boost::python::numpy::ndarray &xs) {
+popcount_cpp_boost(const boost::python::numpy::ndarray &xs,
+                   size_t threads, const boost::python::object &out) {
+    // Boost.Python raises ValueError for std::invalid_argument
     if (xs.get_nd() != 1) {
-        throw std::runtime_error("xs must be a 1-D uint array");
+        throw std::invalid_argument(Type_Error_Message);
+    }
+    if (xs.shape(0) == 0) {
+        // Any element types are acceptable for empty 1-D arrays
+        return prepare_counts_boost(out, 0);
+    }
+
+    const auto dtype = xs.get_dtype();
+    if (dtype == boost::python::numpy::dtype::get_builtin<uint8_t>()) {
+        return popcount_cpp_impl_boost<uint8_t>(xs, threads, out);
+    } else if (dtype == boost::python::numpy::dtype::get_builtin<uint64_t>()) {
+        return popcount_cpp_impl_boost<uint64_t>(xs, threads, out);
     }
 
-    if (xs.get_dtype() == boost::python::numpy::dtype::get_builtin<uint8_t>()) {
-        return popcount_cpp_impl_boost<uint8_t>(xs);
-    } else if (xs.get_dtype() ==
-               boost::python::numpy::dtype::get_builtin<uint64_t>()) {
-        return popcount_cpp_impl_boost<uint64_t>(xs);
+    throw std::invalid_argument(Type_Error_Message);
+}
+
+/**
+ * @tparam SourceType The type of xs elements
+ * @param[in] xs A 1-D integer array which can be a view at any strides
+ * @param[in] threads The number of threads or 0 for all cores
+ * @return The total number of 1's of elements in xs
+ */
+template <typename SourceType>
+uint64_t popcount_total_impl_boost(const boost::python::numpy::ndarray &xs,
+                                   size_t threads) {
+    const auto size = static_cast<size_t>(xs.shape(0));
+    const auto src_stride = static_cast<ptrdiff_t>(xs.strides(0));
+    const char *src = xs.get_data();
+    static_assert(std::is_unsigned<SourceType>::value, "Must be unsigned");
+
+    // Other Python threads run while counting
+    ScopedGilRelease release;
+    if (src_stride == static_cast<ptrdiff_t>(sizeof(SourceType))) {
+        // Zero extension keeps the number of 1's and we count bytes
+        return popcount_total_kernel(src, size * sizeof(SourceType), threads);
     }
+    // Read views such as xs[::2] in place
+    return popcount_total_strided_kernel<SourceType>(src, src_stride, size,
+                                                     threads);
+}
+
+uint64_t popcount_total_boost(const boost::python::numpy::ndarray &xs,
+                              size_t threads) {
+    // Raise ValueError as popcount_cpp_boost does
+    if (xs.get_nd() != 1) {
+        throw std::invalid_argument(Type_Error_Message);
+    }
+
+    const auto dtype = xs.get_dtype();
+    if (dtype == boost::python::numpy::dtype::get_builtin<uint8_t>()) {
+        return popcount_total_impl_boost<uint8_t>(xs, threads);
+    } else if (dtype == boost::python::numpy::dtype::get_builtin<uint64_t>()) {
+        return popcount_total_impl_boost<uint64_t>(xs, threads);
+    }
+
+    throw std::invalid_argument(Type_Error_Message);
+}
+
+std::string get_kernel_variant_name_boost() {
+    return kernel_variant_name(get_kernel_variant());
+}
 
-    throw std::runtime_error("Unsupported array element types");
+void set_kernel_variant_name_boost(const std::string &name) {
+    set_kernel_variant(parse_kernel_variant(name));
 }
 } // namespace py_cpp_sample
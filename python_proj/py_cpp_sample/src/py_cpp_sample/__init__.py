@@ -3,5 +3,30 @@ The top level of this package
 """
 
 from .main import popcount
+from .main import popcount_many
+from .main import popcount_async
+from .main import popcount_file
 from .main import popcount_boost
-__all__ = ["popcount", "popcount_boost"]
+from .main import popcount_total
+from .main import popcount_total_boost
+from .main import popcount_histogram
+from .main import hamming_cdist
+from .main import hamming_pdist
+from .main import hamming_topk
+from .main import get_kernel_variant
+from .main import set_kernel_variant
+from .main import supported_kernel_variants
+from .main import profile_popcount
+from .main import stats
+from .main import reset_stats
+# Generated code
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import PopcountStream
+from .py_cpp_sample_cpp_impl import RankSelectBitvector
+__all__ = ["popcount", "popcount_many", "popcount_async", "popcount_file",
+           "popcount_boost", "popcount_total", "popcount_total_boost",
+           "popcount_histogram", "hamming_cdist", "hamming_pdist",
+           "hamming_topk", "PopcountStream", "RankSelectBitvector",
+           "get_kernel_variant", "set_kernel_variant",
+           "supported_kernel_variants", "profile_popcount", "stats",
+           "reset_stats"]
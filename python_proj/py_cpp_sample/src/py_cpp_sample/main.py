@@ -2,63 +2,499 @@
 Exported function(s)
 """
 
+from concurrent.futures import Future
+import os
 import numpy as np
 # Generated code
 # pylint: disable=no-name-in-module, disable=import-error
-from .py_cpp_sample_cpp_impl import popcount_cpp_uint8
+from .py_cpp_sample_cpp_impl import popcount_cpp
 # pylint: disable=no-name-in-module, disable=import-error
-from .py_cpp_sample_cpp_impl import popcount_cpp_uint64
+from .py_cpp_sample_cpp_impl import popcount_total_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import popcount_total_axis_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import popcount_histogram_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import popcount_many_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import popcount_async_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import popcount_file_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import hamming_cdist_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import hamming_pdist_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import hamming_topk_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import profile_popcount_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import stats_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import reset_stats_cpp
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import get_kernel_variant as get_kernel_pybind11
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import set_kernel_variant as set_kernel_pybind11
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl import supported_kernel_variants \
+    as supported_kernels
 # pylint: disable=no-name-in-module, disable=import-error
 from .py_cpp_sample_cpp_impl_boost import popcount_cpp_boost
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl_boost import popcount_total_cpp_boost
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl_boost import get_kernel_variant_boost
+# pylint: disable=no-name-in-module, disable=import-error
+from .py_cpp_sample_cpp_impl_boost import set_kernel_variant_boost
 
 
 TYPE_ERROR_MESSAGE = "xs must be a 1-D np.ndarray(np.uint8|np.uint64)"
+THREADS_ERROR_MESSAGE = "threads must be a non-negative integer"
+AXIS_ERROR_MESSAGE = "axis must be None or an integer"
+K_ERROR_MESSAGE = "k must be a non-negative integer"
+OFFSET_ERROR_MESSAGE = "offset must be a non-negative integer"
+LENGTH_ERROR_MESSAGE = "length must be None or a non-negative integer"
+REPEAT_ERROR_MESSAGE = "repeat must be a positive integer"
 
 
-def popcount(xs):
+def check_threads(threads):
     """
-    Count 1's of integers in a 1-D np.ndarray(np.uint8|np.uint64)
+    Check the number of threads to count 1's
+
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores
+    """
+
+    if isinstance(threads, bool) or \
+       not isinstance(threads, (int, np.integer)) or threads < 0:
+        raise ValueError(THREADS_ERROR_MESSAGE)
+
+
+def popcount(xs, threads=1, out=None):
+    """
+    Count 1's of integers in a 1-D np.ndarray(np.uint8|np.uint64).
+    Arrays of other integers and bool are counted without conversion and
+    signed integers are sign-extended to 64 bits.
 
     :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in the calling thread.
+    :type out: np.ndarray[np.uint8]
+    :param out: None or a writable 1-D np.uint8 array as long as xs
+                to write the counts into without allocating
     :rtype: np.ndarray[np.uint]
-    :return: Returns the number of 1's of each element of xs
+    :return: Returns the number of 1's of each element of xs or out
     """
 
+    # Checks in Python cost more than counting short arrays
+    if threads.__class__ is not int or threads < 0:
+        check_threads(threads)
+        threads = int(threads)
+
+    # C++ code checks the shape of xs and chooses a kernel for its
+    # element type. If xs is not convertible, C++ code throws an exception
+    return popcount_cpp(xs, threads, out)
+
+
+def popcount_many(xs_list, threads=1, concatenate=False):
+    """
+    Count 1's of integers in each of 1-D arrays in one call to C++ code,
+    which costs less than calling popcount for each short array
+
+    :type xs_list: list[np.ndarray[np.uint]]
+    :param xs_list: An iterable of 1-D arrays which popcount takes
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small batches are counted in the calling thread.
+    :type concatenate: bool
+    :param concatenate: Whether to return counts of all arrays in one array
+    :rtype: list[np.ndarray[np.uint8]] |
+            (np.ndarray[np.uint8], np.ndarray[np.uint64])
+    :return: Returns the number of 1's of each element of each array,
+             or the counts of all arrays and offsets of them where
+             counts[offsets[i]:offsets[i + 1]] are the counts of xs_list[i]
+    """
+
+    check_threads(threads)
+    # If an array is not convertible, C++ code throws an exception
+    return popcount_many_cpp(xs_list, int(threads), bool(concatenate))
+
+
+def popcount_async(xs, threads=1):
+    """
+    Count 1's of integers in a 1-D np.ndarray(np.uint8|np.uint64)
+    on a native worker thread. Callers must not modify xs until the
+    future is done.
+
+    :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in a worker thread.
+    :rtype: concurrent.futures.Future
+    :return: Returns a future which holds the number of 1's of
+             each element of xs
+    """
+
+    check_threads(threads)
     if isinstance(xs, np.ndarray):
         if len(xs.shape) != 1:
             raise ValueError(TYPE_ERROR_MESSAGE)
 
         if xs.shape[0] == 0:
             # Any element types are acceptable for empty 1-D arrays
-            return np.array([], dtype=np.uint8)
-
-        if isinstance(xs[0], (np.uint8)):
-            return popcount_cpp_uint8(xs)
+            future = Future()
+            future.set_result(np.array([], dtype=np.uint8))
+            return future
 
     # If xs is not convertible, C++ code throws an exception
-    return popcount_cpp_uint64(xs)
+    return popcount_async_cpp(xs, int(threads))
 
 
-def popcount_boost(xs):
+def popcount_boost(xs, threads=1, out=None):
     """
     Count 1's of integers in a 1-D np.ndarray(np.uint8|np.uint64)
 
     :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in the calling thread.
+    :type out: np.ndarray[np.uint8]
+    :param out: None or a writable 1-D np.uint8 array as long as xs
+                to write the counts into without allocating
     :rtype: np.ndarray[np.uint]
-    :return: Returns the number of 1's of each element of xs
+    :return: Returns the number of 1's of each element of xs or out
+    """
+
+    if threads.__class__ is not int or threads < 0:
+        check_threads(threads)
+        threads = int(threads)
+
+    if not isinstance(xs, np.ndarray):
+        raise ValueError(TYPE_ERROR_MESSAGE)
+
+    # C++ code checks the shape and element type of xs
+    return popcount_cpp_boost(xs, threads, out)
+
+
+def popcount_total(xs, threads=1, axis=None):
+    """
+    Count 1's of all integers in an N-D np.ndarray(np.uint8|np.uint64)
+    in one pass without making an array of counts
+
+    :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in the calling thread.
+    :type axis: int
+    :param axis: None to sum all elements or an axis to sum along
+    :rtype: int | np.ndarray[np.uint64]
+    :return: Returns the number of 1's in xs or along the axis,
+             equal to the sum of the counts of elements over the axis
+    """
+
+    check_threads(threads)
+    # If xs is not convertible, C++ code throws an exception
+    if axis is None:
+        return popcount_total_cpp(xs, int(threads))
+
+    if isinstance(axis, bool) or not isinstance(axis, (int, np.integer)):
+        raise ValueError(AXIS_ERROR_MESSAGE)
+
+    totals = popcount_total_axis_cpp(xs, int(axis), int(threads))
+    # Return a scalar for 1-D arrays as numpy.sum does
+    return totals[()] if totals.ndim == 0 else totals
+
+
+def popcount_histogram(xs, threads=1):
+    """
+    Count integers in an N-D np.ndarray by their numbers of 1's
+    in one pass without making an array of counts
+
+    :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in the calling thread.
+    :rtype: np.ndarray[np.uint64]
+    :return: Returns the numbers of elements which have 0, 1, ... 1's,
+             equal to np.bincount(popcount(xs.ravel()), minlength=bins)
+             with 9 bins for 8-bit unsigned integers up to 65 bins
+    """
+
+    check_threads(threads)
+    # If xs is not convertible, C++ code throws an exception
+    return popcount_histogram_cpp(xs, int(threads))
+
+
+def popcount_total_boost(xs, threads=1):
+    """
+    Count 1's of all integers in a 1-D np.ndarray(np.uint8|np.uint64)
+    in one pass without making an array of counts
+
+    :type xs: np.ndarray[np.uint]
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are counted in the calling thread.
+    :rtype: int
+    :return: Returns the number of 1's in xs, equal to popcount(xs).sum()
     """
 
+    check_threads(threads)
     if not isinstance(xs, np.ndarray):
         raise ValueError(TYPE_ERROR_MESSAGE)
 
     if len(xs.shape) != 1:
         raise ValueError(TYPE_ERROR_MESSAGE)
 
-    if xs.shape[0] == 0:
-        # Any element types are acceptable for empty 1-D arrays
+    if xs.dtype not in (np.uint8, np.uint64):
+        raise ValueError(TYPE_ERROR_MESSAGE)
+
+    return popcount_total_cpp_boost(xs, int(threads))
+
+
+def popcount_file(path, offset=0, length=None, dtype=np.uint8, out=None,
+                  total=False, threads=1):
+    """
+    Count 1's of integers in a file through windows of memory mapping
+    instead of np.fromfile. Only a window of the file stays in memory
+    and files can be larger than memory.
+
+    :type path: str | os.PathLike
+    :param path: The path of a file
+    :type offset: int
+    :param offset: The offset of the first element in bytes which is
+                   a multiple of the size of elements
+    :type length: int
+    :param length: The number of elements or None for the rest of the file
+    :type dtype: np.dtype
+    :param dtype: An integer type of elements in the native byte order
+    :type out: str | os.PathLike
+    :param out: None or the path of a file to create or overwrite and
+                write the counts as np.uint8 through windows of memory
+                mapping as well
+    :type total: bool
+    :param total: True to return the total number of 1's
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small windows are counted in the calling thread.
+    :rtype: int | np.ndarray[np.uint8] | np.memmap
+    :return: Returns the total number of 1's if total is True, or the
+             number of 1's of each element. Counts in out are read
+             lazily with np.memmap.
+    """
+
+    check_threads(threads)
+    if isinstance(offset, bool) or \
+       not isinstance(offset, (int, np.integer)) or offset < 0:
+        raise ValueError(OFFSET_ERROR_MESSAGE)
+
+    path = os.fspath(path)
+    dtype = np.dtype(dtype)
+    if length is None:
+        length = max(os.path.getsize(path) - offset, 0) // dtype.itemsize
+    elif isinstance(length, bool) or \
+         not isinstance(length, (int, np.integer)) or length < 0:
+        raise ValueError(LENGTH_ERROR_MESSAGE)
+
+    total = bool(total)
+    if out is not None:
+        out = os.fspath(out)
+
+    # C++ code checks the range and type of elements
+    counts = popcount_file_cpp(path, int(offset), int(length), dtype,
+                               total, out, int(threads))
+    if total or out is None:
+        return counts
+
+    # np.memmap cannot map empty files
+    if length == 0:
         return np.array([], dtype=np.uint8)
+    return np.memmap(out, dtype=np.uint8, mode="r", shape=(int(length),))
 
-    if not isinstance(xs[0], (np.uint8, np.uint64)):
-        raise ValueError(TYPE_ERROR_MESSAGE)
 
-    return popcount_cpp_boost(xs)
+def hamming_cdist(xs, ys, metric="hamming", threads=1):
+    """
+    Compute distances between all pairs of rows of packed binary codes
+    such as rows of np.uint64 words. Bits are compared as stored.
+
+    :type xs: np.ndarray[np.uint]
+    :param xs: A 2-D array of codes
+    :type ys: np.ndarray[np.uint]
+    :param ys: A 2-D array of codes whose rows are as long as rows of xs
+    :type metric: str
+    :param metric: "hamming" for the numbers of different bits or
+                   "jaccard" for 1 - popcount(x & y) / popcount(x | y)
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are computed in the calling thread.
+    :rtype: np.ndarray[np.uint32] | np.ndarray[np.float64]
+    :return: Returns an xs.shape[0] x ys.shape[0] array of distances
+    """
+
+    check_threads(threads)
+    # If xs or ys is not convertible, C++ code throws an exception
+    return hamming_cdist_cpp(xs, ys, metric, int(threads))
+
+
+def hamming_pdist(xs, metric="hamming", threads=1, condensed=True):
+    """
+    Compute distances between pairs of rows of packed binary codes
+    once per pair
+
+    :type xs: np.ndarray[np.uint]
+    :param xs: A 2-D array of codes
+    :type metric: str
+    :param metric: "hamming" or "jaccard" as hamming_cdist takes
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are computed in the calling thread.
+    :type condensed: bool
+    :param condensed: True to return the upper triangle as
+                      scipy.spatial.distance.pdist does or False to return
+                      a square matrix
+    :rtype: np.ndarray[np.uint32] | np.ndarray[np.float64]
+    :return: Returns a condensed or square distance matrix
+    """
+
+    check_threads(threads)
+    return hamming_pdist_cpp(xs, metric, int(threads), bool(condensed))
+
+
+def hamming_topk(queries, database, k, threads=1):
+    """
+    Find the k nearest rows of a database for each query by Hamming
+    distances without making a full distance matrix
+
+    :type queries: np.ndarray[np.uint]
+    :param queries: A 2-D array of codes
+    :type database: np.ndarray[np.uint]
+    :param database: A 2-D array of codes whose rows are as long as
+                     rows of queries
+    :type k: int
+    :param k: The number of neighbours
+    :type threads: int
+    :param threads: The number of threads or 0 for all cores.
+                    Small arrays are searched in the calling thread.
+    :rtype: (np.ndarray[np.uint32], np.ndarray[np.int64])
+    :return: Returns distances and indexes of rows of the database in
+             queries.shape[0] x min(k, database.shape[0]) arrays.
+             Neighbours are nearest first and ties are in ascending
+             order of indexes.
+    """
+
+    check_threads(threads)
+    if isinstance(k, bool) or \
+       not isinstance(k, (int, np.integer)) or k < 0:
+        raise ValueError(K_ERROR_MESSAGE)
+
+    # If queries or database is not convertible, C++ code throws an exception
+    return hamming_topk_cpp(queries, database, int(k), int(threads))
+
+
+def get_kernel_variant():
+    """
+    Get the SIMD kernel variant which popcount and popcount_boost run
+
+    :rtype: str
+    :return: Returns "scalar", "popcnt", "avx2" or "avx512"
+    """
+
+    variant = get_kernel_pybind11()
+    if variant != get_kernel_variant_boost():
+        raise RuntimeError("Kernel variants differ between modules")
+    return variant
+
+
+def set_kernel_variant(name):
+    """
+    Force a SIMD kernel variant instead of the best one detected at load.
+    The PY_CPP_SAMPLE_KERNEL environment variable does the same at load.
+
+    :type name: str
+    :param name: A name in supported_kernel_variants() or "auto"
+    """
+
+    set_kernel_pybind11(name)
+    set_kernel_variant_boost(name)
+
+
+def supported_kernel_variants():
+    """
+    List SIMD kernel variants which the running CPU supports
+
+    :rtype: list[str]
+    :return: Returns names of the variants from the slowest to the fastest
+    """
+
+    return supported_kernels()
+
+
+def profile_popcount(xs, variants=None, repeat=10):
+    """
+    Count 1's of xs on the calling thread with each SIMD kernel variant
+    under hardware performance counters, which tell whether a variant is
+    compute-bound or memory-bound. This is opt-in and popcount does not
+    read counters. Counters of events which the host does not count, such
+    as in containers which deny perf_event_open, are None.
+
+    :type xs: np.ndarray[np.uint]
+    :param xs: A 1-D array which popcount takes
+    :type variants: list[str]
+    :param variants: None for supported_kernel_variants() or their names
+    :type repeat: int
+    :param repeat: The number of times to count xs for each variant
+    :rtype: dict[str, dict]
+    :return: Returns a dict of each variant to a dict of "bytes", "seconds",
+             "available", "cycles", "instructions", "llc_misses",
+             "branch_misses", "cycles_per_byte" and "ipc"
+    """
+
+    if isinstance(repeat, bool) or \
+       not isinstance(repeat, (int, np.integer)) or repeat < 1:
+        raise ValueError(REPEAT_ERROR_MESSAGE)
+    if variants is None:
+        variants = supported_kernels()
+
+    # Restore the variant which popcount runs after profiling
+    current = get_kernel_pybind11()
+    profiles = {}
+    try:
+        for variant in variants:
+            set_kernel_pybind11(variant)
+            profiles[variant] = profile_popcount_cpp(xs, int(repeat))
+    finally:
+        set_kernel_pybind11(current)
+    return profiles
+
+
+def stats():
+    """
+    Get metrics of calls which count 1's in all threads since loading or
+    reset_stats(). Calls of popcount, popcount_total, popcount_histogram,
+    popcount_many, popcount_file, popcount_async, hamming_cdist,
+    hamming_pdist, hamming_topk and PopcountStream.update record them and
+    popcount_async records them when the executor counts. The Boost
+    variants, profile_popcount and RankSelectBitvector record nothing.
+    Calls record their metrics in counters of their threads and only calls
+    which read 64 KiB or more read clocks. Building with
+    -DPOPCOUNT_NO_STATS compiles out recording.
+
+    :rtype: dict
+    :return: Returns a dict of "enabled" whether recording is compiled in,
+             "calls", "bytes" which the calls read, "copies" of calls which
+             converted their inputs to arrays, "timed_calls" and "seconds"
+             which they spent, "variants" of the number of calls of each
+             kernel variant and "latency_histogram" of the numbers of
+             timed calls in [2**i, 2**(i+1)) nanoseconds
+    """
+
+    return stats_cpp()
+
+
+def reset_stats():
+    """
+    Clear metrics which stats() returns
+    """
+
+    reset_stats_cpp()
@@ -0,0 +1,384 @@
+#include "test_popcount.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <pybind11/embed.h>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace {
+/// Kernel variants in the order of py_cpp_sample::KernelVariant
+const std::vector<int64_t> Variants{0, 1, 2, 3};
+
+/// The numbers of elements from L1-resident arrays to larger than LLC
+const std::vector<int64_t> Sizes{16, 1 << 12, 1 << 18, 1 << 24};
+
+/// 0 for arrays on cache lines and 1 for arrays one element after them
+const std::vector<int64_t> Offsets{0, 1};
+
+/// The numbers of elements around py_cpp_sample::Small_Array_Size
+const std::vector<int64_t> Latency_Sizes{1, 8, 63, 64, 256};
+
+constexpr uintptr_t Cache_Line_Size = 64;
+
+/**
+ * Fills bytes with random elements
+ * @tparam SourceType The type of elements
+ * @param[out] bytes A pointer to elements
+ * @param[in] n_bytes The size of elements in bytes
+ */
+template <typename SourceType>
+void fill_elements(uint8_t *bytes, size_t n_bytes) {
+    std::mt19937 engine(static_cast<std::mt19937::result_type>(n_bytes));
+    std::uniform_int_distribution<unsigned int> distribution(0, 255);
+    for (size_t i{0}; i < n_bytes; ++i) {
+        const auto byte = distribution(engine);
+        // Keep bool elements 0 or 1
+        bytes[i] = static_cast<uint8_t>(
+            std::is_same<SourceType, bool>::value ? (byte & 1) : byte);
+    }
+}
+
+/**
+ * @param[in] storage A pointer to a buffer which has 2 spare cache lines
+ * @param[in] offset Bytes after the first cache line in the buffer
+ * @return The address offset bytes after the first cache line
+ */
+uint8_t *align_to_cache_line(uint8_t *storage, size_t offset) {
+    const auto address = reinterpret_cast<uintptr_t>(storage);
+    const auto aligned =
+        (address + Cache_Line_Size - 1) & ~(Cache_Line_Size - 1);
+    return storage + (aligned - address) + offset;
+}
+
+/**
+ Elements on a cache line or one element after it
+ */
+template <typename SourceType> class Buffer {
+  public:
+    /**
+     * @param[in] size The number of elements
+     * @param[in] offset 0 or 1 to place elements one element after a line
+     */
+    Buffer(size_t size, size_t offset)
+        : storage_(size * sizeof(SourceType) + Cache_Line_Size * 2),
+          data_(align_to_cache_line(storage_.data(),
+                                    offset * sizeof(SourceType))) {
+        fill_elements<SourceType>(data_, size * sizeof(SourceType));
+    }
+
+    /**
+     * @return A pointer to the first element
+     */
+    const SourceType *data() const {
+        return reinterpret_cast<const SourceType *>(data_);
+    }
+
+  private:
+    std::vector<uint8_t> storage_; ///< Elements and spare cache lines
+    uint8_t *data_;                ///< The first element
+};
+
+/**
+ * Makes a NumPy array on a cache line or one element after it
+ * @tparam SourceType The type of elements
+ * @param[in] size The number of elements
+ * @param[in] offset 0 or 1 to place elements one element after a line
+ * @return A view of a uint8 array which owns elements
+ */
+template <typename SourceType>
+pybind11::array_t<SourceType> make_array(size_t size, size_t offset) {
+    const auto n_bytes = size * sizeof(SourceType);
+    pybind11::array_t<uint8_t> storage(
+        static_cast<pybind11::ssize_t>(n_bytes + Cache_Line_Size * 2));
+    auto data = align_to_cache_line(storage.mutable_data(),
+                                    offset * sizeof(SourceType));
+    fill_elements<SourceType>(data, n_bytes);
+    return pybind11::array_t<SourceType>(
+        {static_cast<pybind11::ssize_t>(size)},
+        {static_cast<pybind11::ssize_t>(sizeof(SourceType))},
+        reinterpret_cast<const SourceType *>(data), storage);
+}
+
+/**
+ * @param[in] xs A NumPy array made by make_array()
+ * @return An ndarray of Boost.Python which shares elements with xs
+ */
+template <typename SourceType>
+boost::python::numpy::ndarray
+make_boost_array(const pybind11::array_t<SourceType> &xs) {
+    const boost::python::object owner(
+        boost::python::handle<>(boost::python::borrowed(xs.ptr())));
+    return boost::python::numpy::from_data(
+        xs.data(), boost::python::numpy::dtype::get_builtin<SourceType>(),
+        boost::python::make_tuple(xs.shape(0)),
+        boost::python::make_tuple(sizeof(SourceType)), owner);
+}
+
+/**
+ * Selects a kernel variant to measure
+ * @param[in] state A benchmark state
+ * @param[in] index The index of a variant in py_cpp_sample::KernelVariant
+ * @return false if the running CPU cannot execute the variant
+ */
+bool select_variant(benchmark::State &state, int64_t index) {
+    const auto variant = static_cast<py_cpp_sample::KernelVariant>(index);
+    if (!py_cpp_sample::is_kernel_variant_supported(variant)) {
+        state.SkipWithError("Unsupported kernel variant");
+        return false;
+    }
+    py_cpp_sample::set_kernel_variant(variant);
+    state.SetLabel(py_cpp_sample::kernel_variant_name(variant));
+    return true;
+}
+
+/**
+ * Selects the best kernel variant for bindings
+ * @param[in] state A benchmark state
+ */
+void select_best_variant(benchmark::State &state) {
+    const auto variant = py_cpp_sample::detect_kernel_variant();
+    select_variant(state, static_cast<int64_t>(variant));
+}
+
+/**
+ * Reports elements/second and bytes/second
+ * @param[in] state A benchmark state after measuring
+ * @param[in] size The number of elements per iteration
+ * @param[in] element_size The size of an element in bytes
+ */
+void set_processed(benchmark::State &state, size_t size,
+                   size_t element_size) {
+    const auto iterations = static_cast<int64_t>(state.iterations());
+    state.SetItemsProcessed(iterations * static_cast<int64_t>(size));
+    state.SetBytesProcessed(iterations *
+                            static_cast<int64_t>(size * element_size));
+}
+
+/**
+ * Reports hardware counters as cycles/byte, IPC and misses per iteration.
+ * Reports nothing on hosts without counters such as containers.
+ * @param[in] state A benchmark state after measuring
+ * @param[in] sample Counts of hardware events in all iterations
+ * @param[in] n_bytes The number of bytes per iteration
+ */
+void set_perf_counters(benchmark::State &state,
+                       const popcount_core::PerfSample &sample,
+                       size_t n_bytes) {
+    using popcount_core::PerfEvent;
+    const auto iterations = static_cast<size_t>(state.iterations());
+    if (sample.available(PerfEvent::Cycles) && (n_bytes > 0)) {
+        state.counters["cycles/byte"] =
+            sample.cycles_per_byte(n_bytes * iterations);
+    }
+    if (sample.available(PerfEvent::Cycles) &&
+        sample.available(PerfEvent::Instructions)) {
+        state.counters["IPC"] = sample.ipc();
+    }
+    if (sample.available(PerfEvent::LlcMisses)) {
+        state.counters["LLC-misses"] =
+            benchmark::Counter(sample.value(PerfEvent::LlcMisses),
+                               benchmark::Counter::kAvgIterations);
+    }
+    if (sample.available(PerfEvent::BranchMisses)) {
+        state.counters["branch-misses"] =
+            benchmark::Counter(sample.value(PerfEvent::BranchMisses),
+                               benchmark::Counter::kAvgIterations);
+    }
+}
+
+/**
+ * @param[in] bench A benchmark which takes variants, sizes and offsets
+ */
+void kernel_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"variant", "size", "offset"})
+        ->ArgsProduct({Variants, Sizes, Offsets})
+        ->Unit(benchmark::kMicrosecond);
+}
+
+/**
+ * @param[in] bench A benchmark which takes sizes and offsets
+ */
+void binding_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size", "offset"})
+        ->ArgsProduct({Sizes, Offsets})
+        ->Unit(benchmark::kMicrosecond);
+}
+
+/**
+ * @param[in] bench A benchmark which takes sizes of short arrays
+ */
+void latency_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size"})
+        ->ArgsProduct({Latency_Sizes})
+        ->Unit(benchmark::kNanosecond);
+}
+} // namespace
+
+template <typename SourceType>
+void BM_PopcountKernel(benchmark::State &state) {
+    if (!select_variant(state, state.range(0))) {
+        return;
+    }
+    const auto size = static_cast<size_t>(state.range(1));
+    const Buffer<SourceType> src(size, static_cast<size_t>(state.range(2)));
+    std::vector<py_cpp_sample::Count> dst(size);
+    popcount_core::PerfCounters counters;
+    counters.start();
+    for (auto _ : state) {
+        py_cpp_sample::popcount_kernel(src.data(), size, dst.data());
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    const auto sample = counters.stop();
+    set_processed(state, size, sizeof(SourceType));
+    set_perf_counters(state, sample, size * sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountTotalKernel(benchmark::State &state) {
+    if (!select_variant(state, state.range(0))) {
+        return;
+    }
+    const auto size = static_cast<size_t>(state.range(1));
+    const Buffer<SourceType> src(size, static_cast<size_t>(state.range(2)));
+    popcount_core::PerfCounters counters;
+    counters.start();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(py_cpp_sample::popcount_total_kernel(
+            src.data(), size * sizeof(SourceType)));
+    }
+    const auto sample = counters.stop();
+    set_processed(state, size, sizeof(SourceType));
+    set_perf_counters(state, sample, size * sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountPybind11(benchmark::State &state) {
+    select_best_variant(state);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs =
+        make_array<SourceType>(size, static_cast<size_t>(state.range(1)));
+    for (auto _ : state) {
+        const auto counts = py_cpp_sample::popcount_cpp(xs);
+        benchmark::DoNotOptimize(counts.data());
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountTotalPybind11(benchmark::State &state) {
+    select_best_variant(state);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs =
+        make_array<SourceType>(size, static_cast<size_t>(state.range(1)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(py_cpp_sample::popcount_total_cpp(xs));
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountBoost(benchmark::State &state) {
+    select_best_variant(state);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs = make_boost_array(
+        make_array<SourceType>(size, static_cast<size_t>(state.range(1))));
+    for (auto _ : state) {
+        const auto counts = py_cpp_sample::popcount_cpp_boost(xs);
+        benchmark::DoNotOptimize(counts.get_data());
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountTotalBoost(benchmark::State &state) {
+    select_best_variant(state);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs = make_boost_array(
+        make_array<SourceType>(size, static_cast<size_t>(state.range(1))));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(py_cpp_sample::popcount_total_boost(xs));
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+// Call functions as Python does to include conversion of arguments
+template <typename SourceType>
+void BM_PopcountLatencyPybind11(benchmark::State &state) {
+    select_best_variant(state);
+    const pybind11::cpp_function function(
+        &py_cpp_sample::popcount_cpp, pybind11::arg("xs"),
+        pybind11::arg("threads") = 1, pybind11::arg("out") = pybind11::none());
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs = make_array<SourceType>(size, 0);
+    for (auto _ : state) {
+        const auto counts = function(xs);
+        benchmark::DoNotOptimize(counts.ptr());
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+template <typename SourceType>
+void BM_PopcountLatencyBoost(benchmark::State &state) {
+    select_best_variant(state);
+    const auto function =
+        boost::python::make_function(&py_cpp_sample::popcount_cpp_boost);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs = make_boost_array(make_array<SourceType>(size, 0));
+    const boost::python::object out;
+    for (auto _ : state) {
+        const auto counts = function(xs, 1, out);
+        benchmark::DoNotOptimize(counts.ptr());
+    }
+    set_processed(state, size, sizeof(SourceType));
+}
+
+BENCHMARK_TEMPLATE(BM_PopcountKernel, bool)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int8_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint8_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int16_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint16_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int32_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint32_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int64_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint64_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalKernel, uint8_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalKernel, uint64_t)->Apply(kernel_args);
+
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, bool)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, int8_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, uint8_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, int16_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, uint16_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, int32_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, uint32_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, int64_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountPybind11, uint64_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalPybind11, uint8_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalPybind11, uint64_t)->Apply(binding_args);
+
+// The Boost.Python module takes uint8 and uint64 arrays
+BENCHMARK_TEMPLATE(BM_PopcountBoost, uint8_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountBoost, uint64_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalBoost, uint8_t)->Apply(binding_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalBoost, uint64_t)->Apply(binding_args);
+
+BENCHMARK_TEMPLATE(BM_PopcountLatencyPybind11, uint8_t)->Apply(latency_args);
+BENCHMARK_TEMPLATE(BM_PopcountLatencyPybind11, uint64_t)->Apply(latency_args);
+BENCHMARK_TEMPLATE(BM_PopcountLatencyBoost, uint8_t)->Apply(latency_args);
+BENCHMARK_TEMPLATE(BM_PopcountLatencyBoost, uint64_t)->Apply(latency_args);
+
+int main(int argc, char **argv) {
+    // The bindings make NumPy arrays in the interpreter
+    pybind11::scoped_interpreter guard{};
+    boost::python::numpy::initialize();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
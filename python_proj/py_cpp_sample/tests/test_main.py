@@ -3,14 +3,34 @@ Testing Python code
 """
 
 from collections import namedtuple
+from concurrent.futures import Future, ThreadPoolExecutor
 import re
 import numpy as np
 import pytest
 from py_cpp_sample import popcount
+from py_cpp_sample import popcount_many
+from py_cpp_sample import popcount_async
+from py_cpp_sample import popcount_file
 from py_cpp_sample import popcount_boost
+from py_cpp_sample import popcount_total
+from py_cpp_sample import popcount_total_boost
+from py_cpp_sample import popcount_histogram
+from py_cpp_sample import hamming_cdist
+from py_cpp_sample import hamming_pdist
+from py_cpp_sample import hamming_topk
+from py_cpp_sample import PopcountStream
+from py_cpp_sample import RankSelectBitvector
+from py_cpp_sample import get_kernel_variant
+from py_cpp_sample import set_kernel_variant
+from py_cpp_sample import supported_kernel_variants
+from py_cpp_sample import profile_popcount
+from py_cpp_sample import stats
+from py_cpp_sample import reset_stats
+from py_cpp_sample import py_cpp_sample_cpp_impl
 
 # Tested functions
 POPCOUNT_SET = [(popcount), (popcount_boost)]
+POPCOUNT_TOTAL_SET = [(popcount_total), (popcount_total_boost)]
 POPCOUNT_ARG_SET = [(popcount, np.uint8), (popcount, np.uint64),
                     (popcount_boost, np.uint8), (popcount_boost, np.uint64)]
 # Messages in exceptions
@@ -155,6 +175,98 @@ def test_popcount_cpp_uint64_boost(benchmark):
     return ret_code
 
 
+def popcount_cpp_total_uint64(args):
+    """C++ implementation 64-bit total using pybind11"""
+    popcount_total(args.array_uint64)
+    return True
+
+
+def popcount_cpp_sum_uint64(args):
+    """C++ implementation 64-bit and NumPy sum"""
+    popcount(args.array_uint64).sum()
+    return True
+
+
+def test_popcount_cpp_total_uint64(benchmark):
+    """Measure time of the C++ implementation 64-bit total"""
+    args = setup_table(NUMBER_OF_UNIT)
+    ret_code = benchmark.pedantic(popcount_cpp_total_uint64,
+                                  kwargs={"args": args},
+                                  iterations=BENCHMARK_ITERATIONS,
+                                  rounds=BENCHMARK_ROUND)
+    return ret_code
+
+
+def test_popcount_cpp_sum_uint64(benchmark):
+    """Measure time of the C++ implementation 64-bit and NumPy sum"""
+    args = setup_table(NUMBER_OF_UNIT)
+    ret_code = benchmark.pedantic(popcount_cpp_sum_uint64,
+                                  kwargs={"args": args},
+                                  iterations=BENCHMARK_ITERATIONS,
+                                  rounds=BENCHMARK_ROUND)
+    return ret_code
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_popcount_small_latency(benchmark, target_func):
+    """Measure time per call of 16 elements which is mostly overhead"""
+    arg = np.arange(16, dtype=np.uint64)
+    benchmark(target_func, arg)
+
+
+def setup_small_arrays():
+    """Short arrays which request handlers hold"""
+    return [np.arange(size, size + 16, dtype=np.uint64)
+            for size in range(1000)]
+
+
+def popcount_each(arrays):
+    """Call popcount for each array"""
+    return [popcount(xs) for xs in arrays]
+
+
+def test_popcount_many_small(benchmark):
+    """Measure time of counting short arrays in one call"""
+    benchmark(popcount_many, setup_small_arrays())
+
+
+def test_popcount_each_small(benchmark):
+    """Measure time of counting short arrays one by one"""
+    benchmark(popcount_each, setup_small_arrays())
+
+
+def setup_codes(size):
+    """Rows of 16 uint64 words as 1024-bit fingerprints"""
+    rng = np.random.default_rng(13579)
+    return rng.integers(0, np.iinfo(np.uint64).max, size=(size, 16),
+                        dtype=np.uint64, endpoint=True)
+
+
+def hamming_pdist_numpy(codes):
+    """Hamming distances with NumPy broadcasting and popcount"""
+    pairs = codes[:, np.newaxis, :] ^ codes[np.newaxis, :, :]
+    return popcount_total(pairs, axis=2)
+
+
+def test_hamming_pdist_cpp(benchmark):
+    """Measure time of the C++ implementation of Hamming distances"""
+    codes = setup_codes(500)
+    ret_code = benchmark.pedantic(hamming_pdist, kwargs={"xs": codes},
+                                  iterations=BENCHMARK_ITERATIONS,
+                                  rounds=BENCHMARK_ROUND)
+    return ret_code
+
+
+def test_hamming_pdist_numpy(benchmark):
+    """Measure time of XOR in NumPy and popcount"""
+    codes = setup_codes(500)
+    ret_code = benchmark.pedantic(hamming_pdist_numpy,
+                                  kwargs={"codes": codes},
+                                  iterations=BENCHMARK_ITERATIONS,
+                                  rounds=BENCHMARK_ROUND)
+    return ret_code
+
+
 def test_popcount_16():
     """16-bit integers"""
     args = setup_table(256)
@@ -247,6 +359,90 @@ def test_convertible_element_type():
     assert np.all(popcount(values) == expected32)
 
 
+def test_all_integer_types():
+    """Integers which kernels count without conversion"""
+    values = [0, 1, 2, 0x7f, -1, -2, -0x80, 0x5a5a, -0x5a5a, 0x7fffffff,
+              -0x80000000, 0x7fffffffffffffff]
+    for dtype in [np.bool_, np.int8, np.uint8, np.int16, np.uint16,
+                  np.int32, np.uint32, np.int64, np.uint64]:
+        arg = np.array(values).astype(dtype)
+        # Sign extension to 64 bits as conversion to uint64 does
+        expected = np.array(
+            [popcount_local(int(x) & 0xffffffffffffffff) for x in arg],
+            dtype=np.uint8)
+        assert np.all(popcount(arg) == expected)
+        assert np.all(popcount(arg[::2]) == expected[::2])
+        assert np.all(popcount_async(arg).result() == expected)
+
+        # Non-native byte order
+        swapped = arg.astype(arg.dtype.newbyteorder())
+        assert np.all(popcount(swapped) == expected)
+
+    arg = np.array([0.0, 3.0, 255.0])
+    assert np.all(popcount(arg) == np.array([0, 2, 8], dtype=np.uint8))
+
+
+def test_small_buffers():
+    """Short arrays and objects which export buffers"""
+    for dtype in [np.bool_, np.int8, np.uint8, np.int16, np.uint16,
+                  np.int32, np.uint32, np.int64, np.uint64]:
+        for size in [1, 63, 64, 65]:
+            arg = (np.arange(size) * 0x5a5a5a5a5a5a5).astype(dtype)
+            expected = np.array(
+                [popcount_local(int(x) & 0xffffffffffffffff) for x in arg],
+                dtype=np.uint8)
+            assert np.array_equal(popcount(arg), expected)
+            assert np.array_equal(popcount(arg[::-2]), expected[::-2])
+            swapped = arg.astype(arg.dtype.newbyteorder())
+            assert np.array_equal(popcount(swapped), expected)
+
+    expected = np.array([1, 2, 8], dtype=np.uint8)
+    assert np.array_equal(popcount(bytearray([1, 3, 255])), expected)
+    arg = np.array([1, 3, 255], dtype=np.uint64)
+    assert np.array_equal(popcount(memoryview(arg)), expected)
+    assert np.array_equal(popcount(memoryview(arg)[::2]), expected[::2])
+
+
+def test_popcount_many():
+    """Many arrays in one call"""
+    rng = np.random.default_rng(2468)
+    arrays = [rng.integers(0, 256, size=size, dtype=np.uint8)
+              for size in range(70)]
+    arrays += [np.arange(-5, 5, dtype=np.int16), np.array([1.0, 3.0]),
+               [7, 8], np.arange(20, dtype=np.uint64)[::3],
+               rng.integers(0, 1 << 62, size=(1 << 17) + 3, dtype=np.int64)]
+    expected = [popcount(xs) for xs in arrays]
+    for threads in [0, 1, 3]:
+        actual = popcount_many(arrays, threads=threads)
+        assert isinstance(actual, list)
+        assert len(actual) == len(expected)
+        for counts, expected_counts in zip(actual, expected):
+            assert counts.dtype == np.uint8
+            assert np.array_equal(counts, expected_counts)
+
+        counts, offsets = popcount_many(tuple(arrays), threads=threads,
+                                        concatenate=True)
+        assert counts.dtype == np.uint8
+        assert offsets.dtype == np.uint64
+        assert np.array_equal(counts, np.concatenate(expected))
+        assert offsets.shape == (len(arrays) + 1,)
+        for index, expected_counts in enumerate(expected):
+            begin, end = offsets[index], offsets[index + 1]
+            assert np.array_equal(counts[begin:end], expected_counts)
+
+    assert popcount_many([]) == []
+    counts, offsets = popcount_many([], concatenate=True)
+    assert counts.shape == (0,)
+    assert np.array_equal(offsets, [0])
+
+    with pytest.raises(ValueError, match="^xs_list must contain 1-D arrays$"):
+        popcount_many([np.zeros((2, 2), dtype=np.uint8)])
+    with pytest.raises(ValueError, match="^threads must be"):
+        popcount_many(arrays, threads=-1)
+    with pytest.raises(TypeError):
+        popcount_many(1)
+
+
 def test_not_convertible_element_type():
     """Not a uint8 or uint64 array"""
     with pytest.raises(TypeError):
@@ -339,3 +535,717 @@ def test_64bits_uint(target_func):
         value |= mask
         if count < 64:
             mask <<= 1
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_kernel_variants(target_func):
+    """All SIMD kernel variants return the same counts"""
+    rng = np.random.default_rng(12345)
+    arg_uint8 = rng.integers(0, 256, size=1000, dtype=np.uint8)
+    arg_uint64 = rng.integers(0, 2**64, size=1000, dtype=np.uint64,
+                              endpoint=False)
+    expected_uint8 = np.array([popcount_local(int(x)) for x in arg_uint8],
+                              dtype=np.uint8)
+    expected_uint64 = np.array([popcount_local(int(x)) for x in arg_uint64],
+                               dtype=np.uint8)
+
+    variants = supported_kernel_variants()
+    assert variants[0] == "scalar"
+    try:
+        for variant in variants:
+            set_kernel_variant(variant)
+            assert get_kernel_variant() == variant
+            # Sizes around SIMD register widths to run tails
+            for size in [0, 1, 15, 16, 17, 63, 64, 65, 1000]:
+                assert np.all(target_func(arg_uint8[:size]) ==
+                              expected_uint8[:size])
+                assert np.all(target_func(arg_uint64[:size]) ==
+                              expected_uint64[:size])
+    finally:
+        set_kernel_variant("auto")
+    assert get_kernel_variant() == variants[-1]
+
+
+def test_invalid_kernel_variant():
+    """Unknown kernel variants"""
+    expected = get_kernel_variant()
+    with pytest.raises(ValueError):
+        set_kernel_variant("sse2")
+    assert get_kernel_variant() == expected
+
+
+def test_profile_popcount():
+    """Profiles report counters or None in hosts without them"""
+    arg = np.arange(100000, dtype=np.uint64)
+    expected = get_kernel_variant()
+    profiles = profile_popcount(arg, repeat=2)
+    assert list(profiles.keys()) == supported_kernel_variants()
+    assert get_kernel_variant() == expected
+    for variant, profile in profiles.items():
+        assert profile["variant"] == variant
+        assert profile["bytes"] == arg.nbytes * 2
+        assert profile["seconds"] >= 0.0
+        if profile["available"]:
+            assert profile["cycles"] > 0
+            assert profile["cycles_per_byte"] > 0.0
+        else:
+            assert profile["cycles"] is None
+            assert profile["ipc"] is None
+
+    profiles = profile_popcount(arg[::2].astype(np.int8), ["scalar"])
+    assert list(profiles.keys()) == ["scalar"]
+    assert profiles["scalar"]["bytes"] == arg.size // 2 * 10
+
+    for repeat in [0, -1, 1.0, True]:
+        with pytest.raises(ValueError):
+            profile_popcount(arg, repeat=repeat)
+    with pytest.raises(ValueError):
+        profile_popcount(arg, ["sse2"])
+    with pytest.raises(RuntimeError):
+        profile_popcount(arg.reshape(2, -1))
+    assert get_kernel_variant() == expected
+
+
+def test_stats():
+    """Metrics of calls since reset_stats"""
+    reset_stats()
+    actual = stats()
+    if not actual["enabled"]:
+        assert actual["calls"] == 0
+        return
+    assert actual["calls"] == 0
+    assert sum(actual["variants"].values()) == 0
+
+    arg = np.arange(1 << 14, dtype=np.uint64)
+    popcount(arg)
+    popcount(arg[:10].astype(np.uint8))
+    popcount([1, 2, 3])
+    popcount_total(arg.astype(np.float64))
+    popcount_many([arg[:5], arg[5:8]])
+    actual = stats()
+    assert actual["calls"] == 5
+    assert actual["bytes"] == arg.nbytes * 2 + 10 + 3 * 8 + 8 * 8
+    assert actual["copies"] == 2
+    assert actual["variants"][get_kernel_variant()] == 5
+    assert sum(actual["variants"].values()) == 5
+    # Calls which read 64 KiB or more are timed
+    assert actual["timed_calls"] == 2
+    assert sum(actual["latency_histogram"]) == 2
+    assert len(actual["latency_histogram"]) == 41
+    assert actual["seconds"] > 0.0
+
+    # Sum counters of threads including exited ones
+    with ThreadPoolExecutor(max_workers=4) as executor:
+        list(executor.map(popcount, [arg[:4]] * 8))
+    assert stats()["calls"] == 13
+
+    reset_stats()
+    assert stats()["calls"] == 0
+
+
+def test_stats_entry_points(tmp_path):
+    """Every function which counts 1's records its calls"""
+    reset_stats()
+    if not stats()["enabled"]:
+        return
+
+    arg = np.arange(64, dtype=np.uint64)
+    codes = arg.reshape(8, 8)
+    path = tmp_path / "bits.bin"
+    arg.tofile(path)
+    py_cpp_sample_cpp_impl.popcount_cpp_uint8(arg.astype(np.uint8))
+    # forcecast copies int64 to uint64
+    py_cpp_sample_cpp_impl.popcount_cpp_uint64(arg.astype(np.int64))
+    popcount_total(codes, axis=1)
+    popcount_histogram(codes)
+    popcount_histogram(codes.T)
+    hamming_cdist(codes, codes)
+    hamming_pdist(codes)
+    hamming_topk(codes, codes, 2)
+    popcount_file(path, dtype=np.uint64)
+    PopcountStream().update(arg)
+    popcount_async(arg).result(timeout=60)
+    actual = stats()
+    assert actual["calls"] == 11
+    assert actual["bytes"] == arg.size + arg.nbytes * 12
+    # Raveling a transposed array copies it
+    assert actual["copies"] == 2
+    assert actual["variants"][get_kernel_variant()] == 11
+    reset_stats()
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_TOTAL_SET)
+def test_popcount_total(target_func):
+    """Totals equal sums of counts"""
+    rng = np.random.default_rng(23456)
+    # Sizes around Harley-Seal blocks to run tails
+    for size in [0, 1, 7, 8, 9, 63, 64, 65, 511, 512, 513, 10000]:
+        for dtype in [np.uint8, np.uint64]:
+            arg = rng.integers(0, np.iinfo(dtype).max, size=size,
+                               dtype=dtype, endpoint=True)
+            actual = target_func(arg)
+            assert isinstance(actual, int)
+            assert actual == int(popcount(arg).astype(np.uint64).sum())
+
+    arg = np.full(100000, 0xffffffffffffffff, dtype=np.uint64)
+    assert target_func(arg) == 6400000
+
+    # Views are read in place
+    for dtype in [np.uint8, np.uint64]:
+        arg = rng.integers(0, np.iinfo(dtype).max, size=10000, dtype=dtype,
+                           endpoint=True)
+        for view in [arg[::2], arg[::-3], arg[5:]]:
+            assert target_func(view) == int(
+                popcount(view).astype(np.uint64).sum())
+
+
+def test_popcount_total_conversion():
+    """Totals of other element types"""
+    assert popcount_total([1, 3, 7]) == 6
+    arg = np.array([0x7fff, 0x8000, 0xffff], dtype=np.uint16)
+    assert popcount_total(arg) == 32
+    # Sign extension to uint64 as popcount does
+    arg = np.array([-1, -2], dtype=np.int8)
+    assert popcount_total(arg) == 127
+    # Non-contiguous arrays
+    arg = np.arange(20, dtype=np.uint64)[::2]
+    assert popcount_total(arg) == int(popcount(arg).astype(np.uint64).sum())
+
+    with pytest.raises(RuntimeError, match="a scalar variable passed"):
+        popcount_total(1)
+
+    # Totals of all elements in N-D arrays
+    assert popcount_total(np.array([[1, 2], [3, 4]], dtype=np.uint8)) == 5
+    arg = np.arange(-30, 30, dtype=np.int16).reshape(3, 4, 5)[:, ::2, ::-1]
+    assert popcount_total(arg) == int(
+        popcount(arg.ravel()).astype(np.uint64).sum())
+
+    with pytest.raises(TypeError):
+        popcount_total([1, "str"])
+
+    for arg in [1, np.array([[1, 2], [3, 4]], dtype=np.uint8),
+                np.array([1, 2], dtype=np.uint16)]:
+        with pytest.raises(ValueError, match=EXPECTED_ERROR_COMMON_MSG):
+            popcount_total_boost(arg)
+
+
+def test_popcount_total_axis():
+    """Totals along axes equal sums of counts along them"""
+    rng = np.random.default_rng(24680)
+    dtypes = [np.bool_, np.int8, np.uint8, np.int16, np.uint16,
+              np.int32, np.uint32, np.int64, np.uint64, np.float64]
+    for dtype in dtypes:
+        if dtype == np.bool_:
+            arg = rng.integers(0, 2, size=(3, 4, 5)).astype(np.bool_)
+        elif dtype == np.float64:
+            arg = rng.integers(0, 1000, size=(3, 4, 5)).astype(dtype)
+        else:
+            arg = rng.integers(np.iinfo(dtype).min, np.iinfo(dtype).max,
+                               size=(3, 4, 5), dtype=dtype, endpoint=True)
+        counts = popcount(arg.ravel()).astype(np.uint64).reshape(arg.shape)
+        for axis in [0, 1, 2, -1, -3, np.int64(1)]:
+            actual = popcount_total(arg, axis=axis)
+            assert actual.dtype == np.uint64
+            assert np.array_equal(actual, counts.sum(axis=axis))
+
+        # Views are read in place
+        view = arg[::-1, 1:, ::2]
+        view_counts = counts[::-1, 1:, ::2]
+        for axis in [0, 1, 2]:
+            assert np.array_equal(popcount_total(view, axis=axis),
+                                  view_counts.sum(axis=axis))
+
+    # One value per row in a single pass
+    arg = rng.integers(0, np.iinfo(np.uint64).max, size=(1000, 300),
+                       dtype=np.uint64, endpoint=True)
+    expected = popcount(arg.ravel()).astype(np.uint64).reshape(
+        arg.shape).sum(axis=1)
+    for threads in [1, 0, 3]:
+        assert np.array_equal(popcount_total(arg, threads=threads, axis=1),
+                              expected)
+    assert np.array_equal(popcount_total(arg.T, threads=0, axis=0), expected)
+
+    # 1-D arrays and empty lines
+    arg = np.array([1, 3, 7], dtype=np.uint8)
+    assert popcount_total(arg, axis=0) == 6
+    assert popcount_total([[1, 3], [7, 15]], axis=-1).tolist() == [3, 7]
+    arg = np.zeros((2, 0), dtype=np.uint8)
+    assert popcount_total(arg, axis=1).tolist() == [0, 0]
+    assert popcount_total(arg, axis=0).shape == (0,)
+
+    for axis in [2, -3]:
+        with pytest.raises(ValueError, match="^axis is out of range$"):
+            popcount_total(np.zeros((2, 2), dtype=np.uint8), axis=axis)
+
+    for axis in [1.0, "0", True]:
+        with pytest.raises(ValueError, match="^axis must be"):
+            popcount_total(np.zeros((2, 2), dtype=np.uint8), axis=axis)
+
+    with pytest.raises(RuntimeError, match="a scalar variable passed"):
+        popcount_total(1, axis=0)
+
+
+def test_popcount_histogram():
+    """Histograms equal bincounts of counts of elements"""
+    rng = np.random.default_rng(13579)
+    for dtype, n_bins in [(np.uint8, 9), (np.int8, 65), (np.uint16, 17),
+                          (np.int32, 65), (np.uint64, 65), (np.bool_, 9)]:
+        arg = rng.integers(0, 256, size=(37, 101)).astype(dtype)
+        for xs in [arg, arg.T, arg[:, ::3], arg[::2, 5]]:
+            expected = np.bincount(popcount(xs.ravel()), minlength=n_bins)
+            actual = popcount_histogram(xs)
+            assert actual.dtype == np.uint64
+            assert np.array_equal(actual, expected)
+
+    arg = rng.integers(0, np.iinfo(np.uint64).max, size=(1 << 18) + 3,
+                       dtype=np.uint64, endpoint=True)
+    expected = np.bincount(popcount(arg), minlength=65)
+    for threads in [0, 1, 2, 3, 64]:
+        assert np.array_equal(popcount_histogram(arg, threads=threads),
+                              expected)
+    assert np.array_equal(popcount_histogram([1.0, 3.0]),
+                          [0, 1, 1] + [0] * 62)
+    assert np.array_equal(popcount_histogram(np.zeros(0, dtype=np.uint8)),
+                          [0] * 9)
+    with pytest.raises(ValueError, match="^threads must be"):
+        popcount_histogram(arg, threads=-1)
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_popcount_threads(target_func):
+    """Counting on threads returns the same counts as serial counting"""
+    rng = np.random.default_rng(34567)
+    # Larger than the threshold to count on threads
+    for size in [1000, (1 << 20) + 17]:
+        for dtype in [np.uint8, np.uint64]:
+            arg = rng.integers(0, np.iinfo(dtype).max, size=size,
+                               dtype=dtype, endpoint=True)
+            expected = target_func(arg)
+            for threads in [0, 2, 3, 64, np.int64(4)]:
+                actual = target_func(arg, threads=threads)
+                assert np.array_equal(actual, expected)
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_TOTAL_SET)
+def test_popcount_total_threads(target_func):
+    """Totals on threads equal serial totals"""
+    rng = np.random.default_rng(45678)
+    arg = rng.integers(0, np.iinfo(np.uint64).max, size=(1 << 18) + 3,
+                       dtype=np.uint64, endpoint=True)
+    expected = target_func(arg)
+    for threads in [0, 2, 3, 64]:
+        assert target_func(arg, threads=threads) == expected
+
+
+@pytest.mark.parametrize("target_func",
+                         POPCOUNT_SET + POPCOUNT_TOTAL_SET)
+def test_invalid_threads(target_func):
+    """Reject negative and non-integer numbers of threads"""
+    arg = np.array([1, 2, 3], dtype=np.uint8)
+    for threads in [-1, 1.5, "2", None, True]:
+        with pytest.raises(ValueError, match="^threads must be"):
+            target_func(arg, threads=threads)
+
+
+@pytest.mark.parametrize("target_func",
+                         POPCOUNT_SET + POPCOUNT_TOTAL_SET)
+def test_concurrent_callers(target_func):
+    """Python threads count concurrently without the GIL"""
+    rng = np.random.default_rng(56789)
+    args = [rng.integers(0, np.iinfo(np.uint64).max, size=100000 + i,
+                         dtype=np.uint64, endpoint=True) for i in range(16)]
+    expected = [target_func(arg) for arg in args]
+    with ThreadPoolExecutor(max_workers=8) as executor:
+        actual = list(executor.map(target_func, args))
+    for actual_one, expected_one in zip(actual, expected):
+        assert np.array_equal(actual_one, expected_one)
+
+
+def test_popcount_async():
+    """Futures hold the same counts as popcount"""
+    rng = np.random.default_rng(67890)
+    for dtype in [np.uint8, np.uint64]:
+        args = [rng.integers(0, np.iinfo(dtype).max, size=size,
+                             dtype=dtype, endpoint=True)
+                for size in [1, 100, 100000, (1 << 18) + 3]]
+        futures = [popcount_async(arg) for arg in args]
+        for arg, future in zip(args, futures):
+            assert isinstance(future, Future)
+            assert np.array_equal(future.result(timeout=60), popcount(arg))
+
+    future = popcount_async([1, 3, 7], threads=0)
+    assert np.array_equal(future.result(timeout=60), [1, 2, 3])
+    future = popcount_async(np.array([], dtype=np.int8))
+    assert future.result(timeout=60).shape == (0,)
+
+
+def test_popcount_async_error():
+    """Invalid arguments raise errors before submitting"""
+    with pytest.raises(RuntimeError, match=EXPECTED_ERROR_SCALAR_MSG):
+        popcount_async(1)
+    with pytest.raises(ValueError, match=EXPECTED_ERROR_COMMON_MSG):
+        popcount_async(np.array([[1, 2], [3, 4]], dtype=np.uint8))
+    with pytest.raises(TypeError):
+        popcount_async([1, "str"])
+    with pytest.raises(ValueError, match="^threads must be"):
+        popcount_async(np.array([1], dtype=np.uint8), threads=-1)
+
+
+def test_popcount_file(tmp_path):
+    """Files are counted as np.fromfile and popcount do"""
+    rng = np.random.default_rng(24680)
+    path = tmp_path / "bits.bin"
+    data = rng.integers(0, 256, size=(1 << 20) + 13, dtype=np.uint8)
+    data.tofile(path)
+    for dtype in [np.uint8, np.int8, np.uint16, np.int32, np.uint64]:
+        for offset in [0, 8, 4096]:
+            expected = popcount(np.fromfile(path, dtype=dtype, offset=offset))
+            for threads in [1, 0]:
+                actual = popcount_file(path, offset, dtype=dtype,
+                                       threads=threads)
+                assert actual.dtype == np.uint8
+                assert np.array_equal(actual, expected)
+                assert popcount_file(path, offset, dtype=dtype, total=True,
+                                     threads=threads) == expected.sum()
+
+            out = tmp_path / "counts.bin"
+            actual = popcount_file(str(path), offset, 100, dtype, out=out)
+            assert np.array_equal(actual, expected[:100])
+            assert np.array_equal(np.fromfile(out, dtype=np.uint8),
+                                  expected[:100])
+
+    assert popcount_file(path, length=0).shape == (0,)
+    assert popcount_file(path, length=0, out=tmp_path / "empty.bin",
+                         total=False).shape == (0,)
+    assert popcount_file(path, len(data), total=True) == 0
+
+    with pytest.raises(ValueError, match="^offset must be a multiple"):
+        popcount_file(path, 1, dtype=np.uint16)
+    with pytest.raises(IndexError):
+        popcount_file(path, length=len(data) + 1)
+    with pytest.raises(TypeError, match="^dtype must be"):
+        popcount_file(path, dtype=np.float64)
+    with pytest.raises(FileNotFoundError):
+        popcount_file(tmp_path / "none.bin")
+    # Writing counts to the input would truncate it
+    for dtype in [np.uint8, np.uint64]:
+        with pytest.raises(ValueError, match="^out must not be the input"):
+            popcount_file(path, dtype=dtype, out=path)
+        assert np.array_equal(np.fromfile(path, dtype=np.uint8), data)
+    with pytest.raises(ValueError, match="^offset must be a non-negative"):
+        popcount_file(path, -1)
+    with pytest.raises(ValueError, match="^length must be"):
+        popcount_file(path, length=1.0)
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_popcount_out(target_func):
+    """Write counts into caller-supplied arrays"""
+    rng = np.random.default_rng(78901)
+    for dtype in [np.uint8, np.uint64]:
+        arg = rng.integers(0, np.iinfo(dtype).max, size=1000,
+                           dtype=dtype, endpoint=True)
+        expected = target_func(arg)
+        out = np.full(1000, 0xee, dtype=np.uint8)
+        actual = target_func(arg, out=out)
+        assert np.array_equal(out, expected)
+        # Returns out itself
+        assert np.shares_memory(actual, out)
+
+        # Reuse the buffer
+        arg = np.zeros(1000, dtype=dtype)
+        target_func(arg, out=out)
+        assert not out.any()
+
+    out = np.array([], dtype=np.uint8)
+    assert target_func(np.array([], dtype=np.uint64), out=out).shape == (0,)
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_popcount_invalid_out(target_func):
+    """Reject out which we cannot write into directly"""
+    arg = np.array([1, 2, 3], dtype=np.uint64)
+    read_only = np.zeros(3, dtype=np.uint8)
+    read_only.flags.writeable = False
+    for out in [np.zeros(2, dtype=np.uint8), np.zeros(4, dtype=np.uint8),
+                np.zeros(3, dtype=np.uint64), np.zeros((3, 1), dtype=np.uint8),
+                read_only]:
+        with pytest.raises(ValueError, match="^out must be"):
+            target_func(arg, out=out)
+
+
+
+@pytest.mark.parametrize("target_func", POPCOUNT_SET)
+def test_popcount_strided(target_func):
+    """Count views in place and write counts into views"""
+    rng = np.random.default_rng(89012)
+    for dtype in [np.uint8, np.uint64]:
+        # Larger than the threshold to count on threads
+        base = rng.integers(0, np.iinfo(dtype).max, size=(1 << 18) + 5,
+                            dtype=dtype, endpoint=True)
+        for arg in [base[::2], base[::-3], base[1::7]]:
+            expected = target_func(np.ascontiguousarray(arg))
+            assert np.array_equal(target_func(arg), expected)
+            assert np.array_equal(target_func(arg, threads=0), expected)
+
+            out = np.full(arg.shape[0] * 2, 0xee, dtype=np.uint8)
+            actual = target_func(arg, out=out[::2])
+            assert np.array_equal(actual, expected)
+            assert np.array_equal(out[::2], expected)
+            assert np.all(out[1::2] == 0xee)
+
+    # A column of a packed structured array is not aligned
+    records = np.zeros(1000, dtype=[("flag", np.uint8), ("value", np.uint64)])
+    records["flag"] = 0xff
+    records["value"] = np.arange(1000, dtype=np.uint64) * 0x10101010101
+    column = records["value"]
+    assert column.strides == (9,)
+    expected = target_func(np.ascontiguousarray(column))
+    assert np.array_equal(target_func(column), expected)
+
+
+def test_popcount_strided_types():
+    """Views of all integer types"""
+    arg = np.arange(-500, 500, dtype=np.int64)
+    for dtype in [np.int8, np.int16, np.uint16, np.int32, np.uint32,
+                  np.int64]:
+        view = arg.astype(dtype)[::-3]
+        expected = popcount(np.ascontiguousarray(view))
+        assert np.array_equal(popcount(view), expected)
+        assert np.array_equal(popcount_async(view).result(), expected)
+
+
+def expected_distances(xs, ys):
+    """Hamming and Jaccard distances of rows in Python"""
+    xs_bits = np.unpackbits(np.ascontiguousarray(xs).view(np.uint8), axis=1)
+    ys_bits = np.unpackbits(np.ascontiguousarray(ys).view(np.uint8), axis=1)
+    hamming = np.zeros((xs.shape[0], ys.shape[0]), dtype=np.uint32)
+    jaccard = np.zeros((xs.shape[0], ys.shape[0]), dtype=np.float64)
+    for i, x_bits in enumerate(xs_bits):
+        for j, y_bits in enumerate(ys_bits):
+            both = int(np.count_nonzero(x_bits & y_bits))
+            either = int(np.count_nonzero(x_bits | y_bits))
+            hamming[i, j] = either - both
+            jaccard[i, j] = (either - both) / either if either else 0.0
+    return hamming, jaccard
+
+
+def test_hamming_cdist():
+    """Distances between all pairs of rows"""
+    rng = np.random.default_rng(97531)
+    for dtype, columns in [(np.uint64, 16), (np.uint8, 13), (np.int32, 5)]:
+        info = np.iinfo(dtype)
+        xs = rng.integers(info.min, info.max, size=(7, columns), dtype=dtype,
+                          endpoint=True)
+        ys = rng.integers(info.min, info.max, size=(5, columns), dtype=dtype,
+                          endpoint=True)
+        ys[0] = 0
+        xs[1] = 0
+        hamming, jaccard = expected_distances(xs, ys)
+        for threads in [1, 0]:
+            actual = hamming_cdist(xs, ys, threads=threads)
+            assert actual.dtype == np.uint32
+            assert np.array_equal(actual, hamming)
+            actual = hamming_cdist(xs, ys, metric="jaccard", threads=threads)
+            assert actual.dtype == np.float64
+            assert np.array_equal(actual, jaccard)
+
+        # Views of rows and columns
+        hamming, jaccard = expected_distances(xs[::-2, 1:], ys[:, 1:])
+        assert np.array_equal(hamming_cdist(xs[::-2, 1:], ys[:, 1:]),
+                              hamming)
+        hamming, jaccard = expected_distances(xs[:, ::2], ys[:, ::2])
+        assert np.array_equal(
+            hamming_cdist(xs[:, ::2], ys[:, ::2], metric="jaccard"), jaccard)
+
+    # Large inputs on threads
+    xs = setup_codes(300)
+    expected = popcount_total(xs[:, np.newaxis, :] ^ xs[np.newaxis, :100, :],
+                              axis=2)
+    for threads in [1, 0, 3]:
+        assert np.array_equal(hamming_cdist(xs, xs[:100], threads=threads),
+                              expected)
+
+    assert hamming_cdist(np.zeros((0, 2), dtype=np.uint64),
+                         np.zeros((3, 2), dtype=np.uint64)).shape == (0, 3)
+    assert hamming_cdist([[1, 2]], [[3, 0]]).tolist() == [[2]]
+
+
+def test_hamming_pdist():
+    """Condensed and square distance matrices"""
+    codes = setup_codes(40)
+    codes[3] = 0
+    codes[7] = 0
+    hamming, jaccard = expected_distances(codes, codes)
+    upper = np.triu_indices(codes.shape[0], k=1)
+    for threads in [1, 0]:
+        actual = hamming_pdist(codes, threads=threads)
+        assert actual.dtype == np.uint32
+        assert np.array_equal(actual, hamming[upper])
+        actual = hamming_pdist(codes, threads=threads, condensed=False)
+        assert np.array_equal(actual, hamming)
+        actual = hamming_pdist(codes, metric="jaccard", threads=threads)
+        assert np.array_equal(actual, jaccard[upper])
+        actual = hamming_pdist(codes, metric="jaccard", threads=threads,
+                               condensed=False)
+        assert np.array_equal(actual, jaccard)
+
+    codes = setup_codes(700)
+    expected = popcount_total(
+        codes[:, np.newaxis, :] ^ codes[np.newaxis, :, :], axis=2)
+    assert np.array_equal(hamming_pdist(codes, threads=0, condensed=False),
+                          expected)
+    assert hamming_pdist(codes[:1]).shape == (0,)
+    assert hamming_pdist(codes[:0], condensed=False).shape == (0, 0)
+
+
+def test_hamming_invalid_args():
+    """Reject codes which are not 2-D or have different lengths"""
+    codes = np.zeros((2, 2), dtype=np.uint64)
+    with pytest.raises(ValueError, match="^codes must be 2-D arrays$"):
+        hamming_cdist(codes[0], codes)
+
+    with pytest.raises(ValueError, match="^codes must be 2-D arrays$"):
+        hamming_pdist(np.zeros((2, 2, 2), dtype=np.uint64))
+
+    with pytest.raises(ValueError, match="^rows of xs and ys must be"):
+        hamming_cdist(codes, codes[:, :1])
+
+    for func in [lambda: hamming_cdist(codes, codes, metric="cosine"),
+                 lambda: hamming_pdist(codes, metric="Hamming")]:
+        with pytest.raises(ValueError, match="^metric must be"):
+            func()
+
+    with pytest.raises(ValueError, match="^threads must be"):
+        hamming_pdist(codes, threads=-1)
+
+
+def test_hamming_topk():
+    """Nearest neighbours equal the first columns of sorted distances"""
+    rng = np.random.default_rng(86420)
+    # Sparse codes make ties
+    queries = setup_codes(50) & setup_codes(50)[::-1]
+    database = rng.integers(0, 1 << 16, size=(3000, 16), dtype=np.uint64)
+    database[100] = queries[0]
+    expected = hamming_cdist(queries, database)
+    order = np.argsort(expected, axis=1, kind="stable")
+    for k in [1, 5, 64]:
+        for threads in [1, 0, 3]:
+            distances, indexes = hamming_topk(queries, database, k,
+                                              threads=threads)
+            assert distances.shape == (50, k)
+            assert distances.dtype == np.uint32
+            assert indexes.dtype == np.int64
+            assert np.array_equal(indexes, order[:, :k])
+            assert np.array_equal(
+                distances, np.take_along_axis(expected, order[:, :k], axis=1))
+    assert hamming_topk(queries, database, 1)[1][0, 0] == 100
+
+    # Views and small databases
+    distances, indexes = hamming_topk(queries[::3], database[::-100], 100)
+    assert distances.shape == (17, 30)
+    assert np.array_equal(
+        indexes, np.argsort(hamming_cdist(queries[::3], database[::-100]),
+                            axis=1, kind="stable"))
+    distances, indexes = hamming_topk(queries, database, 0)
+    assert distances.shape == (50, 0)
+    assert indexes.shape == (50, 0)
+
+    with pytest.raises(ValueError, match="^rows of queries and database"):
+        hamming_topk(queries, database[:, 1:], 1)
+
+    for k in [-1, 1.0, None, True]:
+        with pytest.raises(ValueError, match="^k must be"):
+            hamming_topk(queries, database, k)
+
+
+def test_rank_select_bitvector():
+    """Rank and select equal cumulative sums and positions of 1's"""
+    rng = np.random.default_rng(97531)
+    for size in [0, 1, 511, 2048, 100003]:
+        for density in [0.0, 0.01, 0.5, 1.0]:
+            bits = rng.random(size) < density
+            bitvector = RankSelectBitvector(bits)
+            ranks = np.cumsum(np.concatenate([[False], bits]),
+                              dtype=np.uint64)
+            positions = np.flatnonzero(bits).astype(np.uint64)
+            assert len(bitvector) == size
+            assert bitvector.count() == positions.size
+            assert bitvector.overhead_bytes() <= max(64, size // 8 * 0.05)
+            assert np.array_equal(bitvector.rank(np.arange(size + 1)), ranks)
+            assert np.array_equal(
+                bitvector.select(np.arange(positions.size)), positions)
+            if positions.size > 0:
+                assert bitvector.rank(size) == positions.size
+                assert bitvector.select(positions.size - 1) == positions[-1]
+                assert bitvector.get(int(positions[0]))
+
+    # Bytes of integers hold bits in the little-endian order
+    bitvector = RankSelectBitvector(np.array([0x8001, 0x2], dtype=np.uint16))
+    assert len(bitvector) == 32
+    assert np.array_equal(bitvector.select([0, 1, 2]), [0, 15, 17])
+    assert bitvector.rank(np.array([[1, 16], [17, 18]])).shape == (2, 2)
+    bitvector = RankSelectBitvector(np.array([0xff], dtype=np.uint8), 3)
+    assert len(bitvector) == 3
+    assert bitvector.count() == 3
+
+    with pytest.raises(IndexError):
+        bitvector.rank(4)
+    with pytest.raises(IndexError):
+        bitvector.select([0, 3])
+    with pytest.raises(IndexError):
+        bitvector.get(3)
+    with pytest.raises(ValueError, match="^size is out of range"):
+        RankSelectBitvector(np.array([0xff], dtype=np.uint8), 9)
+    with pytest.raises(TypeError, match="^bits must be"):
+        RankSelectBitvector(np.array([1.0]))
+
+
+def test_popcount_stream():
+    """Chunks of any sizes are counted as the whole data"""
+    rng = np.random.default_rng(24680)
+    xs = rng.integers(0, 2 ** 63, size=10007, dtype=np.uint64)
+    data = xs.tobytes()
+    expected_histogram = np.bincount(popcount(xs), minlength=65)
+    for chunk_size in [1, 7, 64, 1000, len(data)]:
+        stream = PopcountStream(np.uint64)
+        for start in range(0, len(data), chunk_size):
+            stream.update(data[start:(start + chunk_size)])
+        assert stream.nbytes == len(data)
+        assert stream.total() == popcount_total(xs)
+        assert np.array_equal(stream.histogram(), expected_histogram)
+
+    # Arrays are read as bytes of their elements in the C order
+    stream = PopcountStream(np.uint8)
+    stream.update(np.array([[1, 3], [7, 15]], dtype=np.uint16).T)
+    stream.update(bytearray(b"\xff"))
+    stream.update(memoryview(b"\x00"))
+    assert stream.nbytes == 10
+    assert stream.total() == 18
+    assert np.array_equal(stream.histogram(),
+                          [5, 1, 1, 1, 1, 0, 0, 0, 1])
+
+    copied = stream.copy()
+    stream.reset()
+    assert stream.total() == 0
+    assert stream.nbytes == 0
+    assert copied.total() == 18
+
+    # Signed elements are sign-extended as popcount_histogram does
+    for dtype in [np.int8, np.int16, np.int32, np.int64]:
+        xs = np.arange(-100, 100, dtype=dtype)
+        stream = PopcountStream(dtype)
+        data = xs.tobytes()
+        stream.update(data[:3])
+        stream.update(data[3:])
+        assert np.array_equal(stream.histogram(), popcount_histogram(xs))
+
+    stream = PopcountStream()
+    stream.update(b"\x01\x03", threads=0)
+    assert stream.total() == 3
+    with pytest.raises(ValueError, match="histograms"):
+        stream.histogram()
+    with pytest.raises(TypeError, match="^data must be"):
+        stream.update([1, 2])
+    with pytest.raises(TypeError, match="^dtype must be"):
+        PopcountStream(np.float64)
@@ -1,9 +1,26 @@
 #include "test_popcount.h"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <pybind11/embed.h>
 #include <stdexcept>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
 #include <type_traits>
+#include <unistd.h>
 #include <vector>
 
 namespace {
@@ -388,7 +405,9 @@ TEST_F(TestPopcountBoost, InvalidDimension) {
     const BoostArrayShape shape = boost::python::make_tuple(2, 3);
     const BoostDataType data_type = create_numpy_data_type_boost<uint8_t>();
     const auto arg = boost::python::numpy::zeros(shape, data_type);
-    ASSERT_THROW(py_cpp_sample::popcount_cpp_boost(arg), std::runtime_error);
+    ASSERT_THROW(py_cpp_sample::popcount_cpp_boost(arg), std::invalid_argument);
+    ASSERT_THROW(py_cpp_sample::popcount_total_boost(arg),
+                 std::invalid_argument);
 }
 
 TEST_F(TestPopcountBoost, InvalidElemenyType) {
@@ -396,7 +415,9 @@ TEST_F(TestPopcountBoost, InvalidElemenyType) {
     const BoostArrayShape shape = boost::python::make_tuple(size);
     const BoostDataType data_type = create_numpy_data_type_boost<uint16_t>();
     const auto arg = boost::python::numpy::zeros(shape, data_type);
-    ASSERT_THROW(py_cpp_sample::popcount_cpp_boost(arg), std::runtime_error);
+    ASSERT_THROW(py_cpp_sample::popcount_cpp_boost(arg), std::invalid_argument);
+    ASSERT_THROW(py_cpp_sample::popcount_total_boost(arg),
+                 std::invalid_argument);
 }
 
 TYPED_TEST(TestPopcountTyped, ArraySizePybind11) {
@@ -506,6 +527,48 @@ TEST_F(TestPopcountPybind11, ValuesUint64) {
     ASSERT_TRUE(are_equal(Expected_Uint64, actual));
 }
 
+TEST_F(TestPopcountPybind11, OutUint64) {
+    const auto array_size = Expected_Uint64.size();
+    const auto arg_array_size = static_cast<PyBindSize>(array_size);
+    PyUint64Array arg({arg_array_size});
+    copy_array(Input_Uint64, arg);
+
+    CountArray out({arg_array_size});
+    const auto actual = py_cpp_sample::popcount_cpp_uint64(arg, 1, out);
+    ASSERT_TRUE(are_equal(Expected_Uint64, out));
+    // Write to out without allocating a new array
+    EXPECT_EQ(out.data(), actual.data());
+
+    CountArray out_short({arg_array_size - 1});
+    EXPECT_THROW(py_cpp_sample::popcount_cpp_uint64(arg, 1, out_short),
+                 pybind11::value_error);
+    const pybind11::array_t<uint64_t> out_uint64({arg_array_size});
+    EXPECT_THROW(py_cpp_sample::popcount_cpp_uint64(arg, 1, out_uint64),
+                 pybind11::value_error);
+}
+
+TEST_F(TestPopcountBoost, OutUint8) {
+    using Element = uint8_t;
+    const auto array_size = Expected_Uint8.size();
+    const BoostArrayShape shape = boost::python::make_tuple(array_size);
+    auto arg = boost::python::numpy::zeros(
+        shape, create_numpy_data_type_boost<Element>());
+    Element *arg_values = reinterpret_cast<Element *>(arg.get_data());
+    std::copy(Input_Uint8.begin(), Input_Uint8.end(), arg_values);
+
+    const auto out =
+        boost::python::numpy::zeros(shape, create_count_data_type_boost());
+    const auto actual = py_cpp_sample::popcount_cpp_boost(arg, 1, out);
+    ASSERT_TRUE(are_equal_boost_numpy(Expected_Uint8, out));
+    EXPECT_EQ(out.get_data(), actual.get_data());
+
+    const auto out_short = boost::python::numpy::zeros(
+        boost::python::make_tuple(array_size - 1),
+        create_count_data_type_boost());
+    EXPECT_THROW(py_cpp_sample::popcount_cpp_boost(arg, 1, out_short),
+                 std::invalid_argument);
+}
+
 TEST_F(TestPopcountBoost, ValuesUint64) {
     using Element = uint64_t;
     const auto array_size = Expected_Uint64.size();
@@ -656,6 +719,858 @@ TEST_F(TestPopcountBoost, BitsUint64) {
     }
 }
 
+class TestPopcountKernel : public ::testing::Test {
+  protected:
+    void TearDown() override {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::detect_kernel_variant());
+    }
+};
+
+TEST_F(TestPopcountKernel, VariantNames) {
+    using py_cpp_sample::KernelVariant;
+    for (const auto &variant : {KernelVariant::Scalar, KernelVariant::Popcnt,
+                                KernelVariant::Avx2, KernelVariant::Avx512}) {
+        const auto name = py_cpp_sample::kernel_variant_name(variant);
+        EXPECT_EQ(variant, py_cpp_sample::parse_kernel_variant(name));
+    }
+
+    EXPECT_EQ(py_cpp_sample::detect_kernel_variant(),
+              py_cpp_sample::parse_kernel_variant("auto"));
+    ASSERT_THROW(py_cpp_sample::parse_kernel_variant("sse2"),
+                 std::invalid_argument);
+}
+
+TEST_F(TestPopcountKernel, SupportedVariants) {
+    const auto names = py_cpp_sample::supported_kernel_variants();
+    ASSERT_FALSE(names.empty());
+    EXPECT_EQ("scalar", names.front());
+
+    const auto best = py_cpp_sample::detect_kernel_variant();
+    EXPECT_EQ(py_cpp_sample::kernel_variant_name(best), names.back());
+    EXPECT_TRUE(py_cpp_sample::is_kernel_variant_supported(best));
+}
+
+TEST_F(TestPopcountKernel, AllVariants) {
+    // Sizes around SIMD register widths to run tails
+    const std::vector<size_t> sizes{0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64,
+                                    65, 127, 128, 129, 1000};
+    constexpr size_t max_size = 1000;
+    std::vector<uint8_t> arg_uint8(max_size);
+    std::vector<uint64_t> arg_uint64(max_size);
+    const auto expected_uint8 =
+        setup_popcount<uint8_t>(max_size, size_t{0}, arg_uint8.data());
+    const auto expected_uint64 = setup_popcount<uint64_t>(
+        max_size, size_t{0x7ffffffffffffe00}, arg_uint64.data());
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        ASSERT_EQ(name, py_cpp_sample::kernel_variant_name(
+                            py_cpp_sample::get_kernel_variant()));
+
+        for (const auto size : sizes) {
+            // Check that kernels do not write past the end
+            constexpr Count guard = 0xee;
+            std::vector<Count> actual(size + 1, guard);
+            py_cpp_sample::popcount_kernel(arg_uint8.data(), size,
+                                           actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_uint8.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+
+            std::fill(actual.begin(), actual.end(), guard);
+            py_cpp_sample::popcount_kernel(arg_uint64.data(), size,
+                                           actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_uint64.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+        }
+    }
+}
+
+template <typename T>
+class TestPopcountElementType : public TestPopcountKernel {};
+using PopcountElementTypes = ::testing::Types<bool, int8_t, int16_t, uint16_t,
+                                              int32_t, uint32_t, int64_t>;
+TYPED_TEST_SUITE(TestPopcountElementType, PopcountElementTypes);
+
+TYPED_TEST(TestPopcountElementType, AllVariants) {
+    using Element = TypeParam;
+    // Sizes around SIMD register widths to run tails
+    const std::vector<size_t> sizes{0,  1,  15, 16, 17,  31,  32,
+                                    33, 63, 64, 65, 127, 128, 1000};
+    constexpr size_t max_size = 1000;
+    // std::vector<bool> does not have data()
+    std::unique_ptr<Element[]> arg(new Element[max_size]);
+    std::vector<Count> expected(max_size);
+    for (size_t index{0}; index < max_size; ++index) {
+        // Spread bits including sign bits
+        const auto value = static_cast<uint64_t>(index) * 0x9e3779b97f4a7c15ull;
+        arg[index] = static_cast<Element>(value);
+        // Signed integers are sign-extended to 64 bits
+        const std::bitset<64> bits(
+            static_cast<uint64_t>(static_cast<int64_t>(arg[index])));
+        expected.at(index) = static_cast<Count>(bits.count());
+    }
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const auto size : sizes) {
+            // Check that kernels do not write past the end
+            constexpr Count guard = 0xee;
+            std::vector<Count> actual(size + 1, guard);
+            py_cpp_sample::popcount_kernel(arg.get(), size, actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Strided) {
+    using Element = int32_t;
+    constexpr size_t size = 1000;
+    // Elements are not aligned and written at a stride of 3 bytes
+    constexpr ptrdiff_t src_stride = 13;
+    constexpr ptrdiff_t dst_stride = 3;
+    std::vector<uint8_t> arg(size * src_stride);
+    std::vector<Count> expected(size);
+    for (size_t index{0}; index < size; ++index) {
+        const auto element =
+            static_cast<Element>(index * 0x9e3779b9u - 0x40000000u);
+        std::memcpy(arg.data() + index * src_stride, &element,
+                    sizeof(element));
+        expected.at(index) = static_cast<Count>(
+            std::bitset<64>(static_cast<uint64_t>(element)).count());
+    }
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const size_t threads : {0, 1}) {
+            constexpr Count guard = 0xee;
+            std::vector<Count> actual(size * dst_stride, guard);
+            py_cpp_sample::popcount_strided_kernel<Element>(
+                arg.data(), src_stride, size, actual.data(), dst_stride,
+                threads);
+            for (size_t index{0}; index < actual.size(); ++index) {
+                const auto position = index / dst_stride;
+                EXPECT_EQ((index % dst_stride) ? guard : expected.at(position),
+                          actual.at(index));
+            }
+
+            // Read from the last element backwards
+            std::vector<Count> reversed(size, guard);
+            py_cpp_sample::popcount_strided_kernel<Element>(
+                arg.data() + (size - 1) * src_stride, -src_stride, size,
+                reversed.data(), 1, threads);
+            EXPECT_TRUE(std::equal(reversed.rbegin(), reversed.rend(),
+                                   expected.begin()));
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Total) {
+    // Sizes around Harley-Seal blocks to run tails
+    const std::vector<size_t> sizes{0,   1,   7,   8,   9,   63,  64,  65,
+                                    127, 128, 129, 511, 512, 513, 4000};
+    constexpr size_t max_size = 4000;
+    constexpr size_t max_offset = 8;
+    std::vector<uint8_t> arg(max_size + max_offset);
+    setup_popcount<uint8_t>(arg.size(), size_t{0x5a}, arg.data());
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        // Unaligned heads
+        for (size_t offset = 0; offset < max_offset; ++offset) {
+            for (const auto size : sizes) {
+                const auto src = arg.data() + offset;
+                uint64_t expected = 0;
+                for (size_t i = 0; i < size; ++i) {
+                    expected += __builtin_popcount(src[i]);
+                }
+                EXPECT_EQ(expected,
+                          py_cpp_sample::popcount_total_kernel(src, size));
+            }
+        }
+    }
+
+    const std::vector<uint64_t> all_ones(1000, ~uint64_t{0});
+    EXPECT_EQ(64000, py_cpp_sample::popcount_total_kernel(
+                         all_ones.data(), all_ones.size() * sizeof(uint64_t)));
+}
+
+TEST_F(TestPopcountKernel, TotalLines) {
+    // A 3 x 500 x 7 array of int16 elements
+    using Element = int16_t;
+    constexpr size_t rows = 3;
+    constexpr size_t columns = 500;
+    constexpr size_t depth = 7;
+    std::vector<Element> arg(rows * columns * depth);
+    std::vector<uint64_t> expected(rows * depth, 0);
+    for (size_t index{0}; index < arg.size(); ++index) {
+        const auto element = static_cast<Element>(index * 40503u);
+        arg.at(index) = element;
+        const auto row = index / (columns * depth);
+        expected.at(row * depth + index % depth) +=
+            std::bitset<64>(static_cast<uint64_t>(element)).count();
+    }
+
+    // Sum along the middle axis
+    const py_cpp_sample::LineView view{
+        arg.data(),
+        {rows, depth},
+        {static_cast<ptrdiff_t>(columns * depth * sizeof(Element)),
+         static_cast<ptrdiff_t>(sizeof(Element))},
+        columns,
+        static_cast<ptrdiff_t>(depth * sizeof(Element))};
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const size_t threads : {0, 1}) {
+            std::vector<uint64_t> actual(expected.size(), 0);
+            py_cpp_sample::popcount_total_lines_kernel<Element>(
+                view, actual.data(), threads);
+            EXPECT_EQ(expected, actual);
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Histogram) {
+    static_assert(py_cpp_sample::popcount_histogram_bins<uint8_t>() == 9, "");
+    static_assert(py_cpp_sample::popcount_histogram_bins<int8_t>() == 65, "");
+    static_assert(py_cpp_sample::popcount_histogram_bins<uint32_t>() == 33,
+                  "");
+
+    // Larger than inputs which threads count
+    using Element = int16_t;
+    constexpr size_t size = 600007;
+    constexpr size_t n_bins = py_cpp_sample::popcount_histogram_bins<Element>();
+    std::vector<Element> arg(size);
+    std::vector<uint64_t> expected(n_bins, 0);
+    std::vector<uint64_t> expected_odd(n_bins, 0);
+    for (size_t index{0}; index < size; ++index) {
+        const auto element = static_cast<Element>(index * 40503u);
+        arg.at(index) = element;
+        const auto count =
+            std::bitset<64>(static_cast<uint64_t>(element)).count();
+        ++expected.at(count);
+        if (index % 2) {
+            ++expected_odd.at(count);
+        }
+    }
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const size_t threads : {0, 1, 3}) {
+            std::vector<uint64_t> actual(n_bins, 0);
+            py_cpp_sample::popcount_histogram_kernel<Element>(
+                arg.data(), sizeof(Element), size, actual.data(), threads);
+            EXPECT_EQ(expected, actual);
+
+            // Add to bins and read odd elements backwards
+            py_cpp_sample::popcount_histogram_kernel<Element>(
+                arg.data() + size - 2,
+                -2 * static_cast<ptrdiff_t>(sizeof(Element)), size / 2,
+                actual.data(), threads);
+            for (size_t bin{0}; bin < n_bins; ++bin) {
+                EXPECT_EQ(expected.at(bin) + expected_odd.at(bin),
+                          actual.at(bin));
+            }
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Distances) {
+    // Rows which are not multiples of vector widths
+    constexpr size_t rows = 40;
+    constexpr size_t row_bytes = 37;
+    std::vector<uint8_t> codes(rows * row_bytes);
+    setup_popcount<uint8_t>(codes.size(), size_t{0x3c}, codes.data());
+    std::fill(codes.begin(), codes.begin() + row_bytes, 0);
+    const py_cpp_sample::CodeMatrix xs{codes.data(), rows, row_bytes,
+                                       static_cast<ptrdiff_t>(row_bytes)};
+
+    std::vector<uint32_t> hamming(rows * rows);
+    std::vector<double> jaccard(rows * rows);
+    for (size_t i{0}; i < rows; ++i) {
+        for (size_t j{0}; j < rows; ++j) {
+            uint32_t both{0};
+            uint32_t either{0};
+            for (size_t k{0}; k < row_bytes; ++k) {
+                const auto x = codes.at(i * row_bytes + k);
+                const auto y = codes.at(j * row_bytes + k);
+                both += static_cast<uint32_t>(std::bitset<8>(x & y).count());
+                either += static_cast<uint32_t>(std::bitset<8>(x | y).count());
+            }
+            hamming.at(i * rows + j) = either - both;
+            jaccard.at(i * rows + j) =
+                either ? static_cast<double>(either - both) / either : 0.0;
+        }
+    }
+
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const size_t threads : {0, 1}) {
+            std::vector<uint32_t> actual_hamming(rows * rows);
+            py_cpp_sample::hamming_cdist_kernel(xs, xs, actual_hamming.data(),
+                                                threads);
+            EXPECT_EQ(hamming, actual_hamming);
+            std::vector<double> actual_jaccard(rows * rows);
+            py_cpp_sample::jaccard_cdist_kernel(xs, xs, actual_jaccard.data(),
+                                                threads);
+            EXPECT_EQ(jaccard, actual_jaccard);
+
+            std::vector<uint32_t> square(rows * rows, 1);
+            py_cpp_sample::hamming_pdist_kernel(xs, false, square.data(),
+                                                threads);
+            EXPECT_EQ(hamming, square);
+            std::vector<double> condensed(rows * (rows - 1) / 2);
+            py_cpp_sample::jaccard_pdist_kernel(xs, true, condensed.data(),
+                                                threads);
+            auto distance = condensed.begin();
+            for (size_t i{0}; i < rows; ++i) {
+                for (size_t j = i + 1; j < rows; ++j) {
+                    EXPECT_EQ(jaccard.at(i * rows + j), *distance++);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, TopK) {
+    constexpr size_t rows = 300;
+    constexpr size_t row_bytes = 16;
+    // Rows differ from each other
+    std::vector<uint8_t> codes(rows * row_bytes);
+    for (size_t index{0}; index < codes.size(); ++index) {
+        codes.at(index) = static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+    const py_cpp_sample::CodeMatrix database{
+        codes.data(), rows, row_bytes, static_cast<ptrdiff_t>(row_bytes)};
+    const py_cpp_sample::CodeMatrix queries{
+        codes.data() + row_bytes * 7, 3, row_bytes,
+        static_cast<ptrdiff_t>(row_bytes * 50)};
+
+    std::vector<uint32_t> all(queries.rows * rows);
+    py_cpp_sample::hamming_cdist_kernel(queries, database, all.data(), 1);
+
+    constexpr size_t k = 10;
+    for (const auto &name : py_cpp_sample::supported_kernel_variants()) {
+        py_cpp_sample::set_kernel_variant(
+            py_cpp_sample::parse_kernel_variant(name));
+        for (const size_t threads : {0, 1}) {
+            std::vector<uint32_t> distances(queries.rows * k);
+            std::vector<int64_t> indexes(queries.rows * k);
+            py_cpp_sample::hamming_topk_kernel(queries, database, k,
+                                               distances.data(),
+                                               indexes.data(), threads);
+            for (size_t query{0}; query < queries.rows; ++query) {
+                // Queries are rows of the database
+                EXPECT_EQ(0, distances.at(query * k));
+                EXPECT_EQ(7 + query * 50, indexes.at(query * k));
+
+                std::vector<std::pair<uint32_t, int64_t>> expected;
+                for (size_t row{0}; row < rows; ++row) {
+                    expected.emplace_back(all.at(query * rows + row),
+                                          static_cast<int64_t>(row));
+                }
+                std::sort(expected.begin(), expected.end());
+                for (size_t rank{0}; rank < k; ++rank) {
+                    EXPECT_EQ(expected.at(rank).first,
+                              distances.at(query * k + rank));
+                    EXPECT_EQ(expected.at(rank).second,
+                              indexes.at(query * k + rank));
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> distances(rows + 1);
+    std::vector<int64_t> indexes(rows + 1);
+    EXPECT_THROW(py_cpp_sample::hamming_topk_kernel(
+                     database, database, rows + 1, distances.data(),
+                     indexes.data(), 1),
+                 std::invalid_argument);
+}
+
+TEST(TestPopcountFile, Windows) {
+    // Larger than a window to map
+    constexpr size_t size = (1 << 26) + 4099;
+    std::vector<uint8_t> bytes(size);
+    for (size_t index = 0; index < size; ++index) {
+        bytes.at(index) = static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+    const std::string src_path{"test_popcount_file_src.bin"};
+    const std::string dst_path{"test_popcount_file_dst.bin"};
+    {
+        std::ofstream src_file(src_path, std::ios::binary);
+        src_file.write(reinterpret_cast<const char *>(bytes.data()),
+                       static_cast<std::streamsize>(size));
+    }
+
+    constexpr uint64_t offset = 8;
+    constexpr uint64_t n_elements = (size - offset) / sizeof(int32_t);
+    std::vector<Count> expected(n_elements);
+    py_cpp_sample::popcount_kernel(
+        reinterpret_cast<const int32_t *>(bytes.data() + offset), n_elements,
+        expected.data());
+    const py_cpp_sample::FileRange src{src_path, offset, n_elements};
+    for (const size_t threads : {0, 1, 3}) {
+        std::vector<Count> actual(n_elements);
+        py_cpp_sample::popcount_file_kernel<int32_t>(src, actual.data(),
+                                                     threads);
+        EXPECT_EQ(expected, actual);
+
+        py_cpp_sample::popcount_file_kernel<int32_t>(src, dst_path, threads);
+        std::ifstream dst_file(dst_path, std::ios::binary);
+        const std::vector<Count> written{
+            std::istreambuf_iterator<char>(dst_file),
+            std::istreambuf_iterator<char>()};
+        EXPECT_EQ(expected, written);
+
+        uint64_t expected_total = 0;
+        for (const auto count : expected) {
+            expected_total += count;
+        }
+        EXPECT_EQ(expected_total,
+                  py_cpp_sample::popcount_file_total_kernel<int32_t>(
+                      src, threads));
+    }
+
+    EXPECT_THROW(py_cpp_sample::popcount_file_total_kernel<int32_t>(
+                     py_cpp_sample::FileRange{src_path, 2, 1}, 1),
+                 std::invalid_argument);
+    EXPECT_THROW(py_cpp_sample::popcount_file_total_kernel<int32_t>(
+                     py_cpp_sample::FileRange{src_path, 0, size}, 1),
+                 std::out_of_range);
+    // Writing counts to the input keeps it
+    EXPECT_THROW(
+        py_cpp_sample::popcount_file_kernel<int32_t>(src, src_path, 1),
+        std::invalid_argument);
+    EXPECT_EQ(expected, [&src]() {
+        std::vector<Count> counts(n_elements);
+        py_cpp_sample::popcount_file_kernel<int32_t>(src, counts.data(), 1);
+        return counts;
+    }());
+    std::remove(src_path.c_str());
+    std::remove(dst_path.c_str());
+    EXPECT_THROW(py_cpp_sample::popcount_file_total_kernel<int32_t>(
+                     py_cpp_sample::FileRange{src_path, 0, 0}, 1),
+                 std::system_error);
+}
+
+TEST(TestRankSelectBitvector, RankSelect) {
+    for (const size_t size : {0, 1, 63, 64, 513, 2047, 2048, 2049, 100003}) {
+        for (const uint32_t density : {0u, 1u, 128u, 255u, 256u}) {
+            // Bits after size must be ignored
+            std::vector<uint8_t> bytes(size / 8 + 1, 0xff);
+            std::vector<size_t> positions;
+            for (size_t index = 0; index < size; ++index) {
+                const auto hash = (index * 2654435761u) >> 13;
+                const uint8_t mask = static_cast<uint8_t>(1u << (index % 8));
+                if ((hash & 0xffu) < density) {
+                    positions.push_back(index);
+                } else {
+                    bytes.at(index / 8) &= static_cast<uint8_t>(~mask);
+                }
+            }
+
+            // Every variant counts 1's of words to build directories
+            for (const auto &name :
+                 py_cpp_sample::supported_kernel_variants()) {
+                const py_cpp_sample::RankSelectBitvector bitvector(
+                    bytes.data(), size,
+                    py_cpp_sample::parse_kernel_variant(name));
+                ASSERT_EQ(size, bitvector.size());
+                ASSERT_EQ(positions.size(), bitvector.count());
+                size_t rank = 0;
+                for (size_t index = 0; index <= size; ++index) {
+                    ASSERT_EQ(rank, bitvector.rank(index));
+                    if ((rank < positions.size()) &&
+                        (positions[rank] == index)) {
+                        ASSERT_TRUE(bitvector.get(index));
+                        ++rank;
+                    } else if (index < size) {
+                        ASSERT_FALSE(bitvector.get(index));
+                    }
+                }
+                for (size_t nth = 0; nth < positions.size(); ++nth) {
+                    ASSERT_EQ(positions[nth], bitvector.select(nth));
+                }
+
+                EXPECT_THROW(bitvector.rank(size + 1), std::out_of_range);
+                EXPECT_THROW(bitvector.select(positions.size()),
+                             std::out_of_range);
+                EXPECT_THROW(bitvector.get(size), std::out_of_range);
+            }
+        }
+    }
+}
+
+TEST(TestPopcountStream, Chunks) {
+    constexpr size_t size = 300007;
+    std::vector<uint8_t> bytes(size);
+    for (size_t index = 0; index < size; ++index) {
+        bytes.at(index) = static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+
+    // Count whole elements as popcount_kernel does
+    constexpr size_t n_elements = size / sizeof(uint32_t);
+    std::vector<Count> counts(n_elements);
+    py_cpp_sample::popcount_kernel(
+        reinterpret_cast<const uint32_t *>(bytes.data()), n_elements,
+        counts.data());
+    std::vector<uint64_t> expected_histogram(33, 0);
+    for (const auto count : counts) {
+        ++expected_histogram.at(count);
+    }
+    const auto expected_total =
+        py_cpp_sample::popcount_total_kernel(bytes.data(), size);
+
+    // Split elements and blocks between chunks
+    for (const size_t chunk_size : {1, 3, 63, 64, 65, 4099, 100000}) {
+        for (const size_t threads : {1, 0}) {
+            py_cpp_sample::PopcountStream stream(sizeof(uint32_t));
+            uint64_t running_total = 0;
+            for (size_t index = 0; index < size; index += chunk_size) {
+                const auto n_bytes = std::min(chunk_size, size - index);
+                stream.update(bytes.data() + index, n_bytes, threads);
+                running_total += py_cpp_sample::popcount_total_kernel(
+                    bytes.data() + index, n_bytes);
+                ASSERT_EQ(running_total, stream.total());
+            }
+            EXPECT_EQ(size, stream.size());
+            EXPECT_EQ(expected_total, stream.total());
+            EXPECT_EQ(expected_histogram, stream.histogram());
+        }
+    }
+
+    py_cpp_sample::PopcountStream stream;
+    stream.update(bytes.data(), size);
+    EXPECT_EQ(expected_total, stream.total());
+    EXPECT_TRUE(stream.histogram().empty());
+    stream.reset();
+    EXPECT_EQ(0, stream.size());
+    EXPECT_EQ(0, stream.total());
+
+    EXPECT_EQ(9, py_cpp_sample::PopcountStream(1).histogram().size());
+    EXPECT_EQ(65, py_cpp_sample::PopcountStream(8).histogram().size());
+
+    // Signed elements are sign-extended as popcount_histogram_kernel does
+    constexpr size_t n_signed = size / sizeof(int16_t);
+    std::vector<uint64_t> expected_signed(65, 0);
+    py_cpp_sample::popcount_histogram_kernel<int16_t>(
+        bytes.data(), sizeof(int16_t), n_signed, expected_signed.data(), 1);
+    py_cpp_sample::PopcountStream signed_stream(sizeof(int16_t), true);
+    signed_stream.update(bytes.data(), 3);
+    signed_stream.update(bytes.data() + 3, size - 3);
+    EXPECT_EQ(expected_signed, signed_stream.histogram());
+    EXPECT_THROW(py_cpp_sample::PopcountStream(3), std::invalid_argument);
+}
+
+TEST(TestPopcountStream, ConcurrentUpdates) {
+    // Odd chunks carry bytes between blocks in every update
+    constexpr size_t chunk_size = 67;
+    constexpr size_t n_chunks = 2000;
+    std::vector<uint8_t> bytes(chunk_size);
+    for (size_t index = 0; index < chunk_size; ++index) {
+        bytes.at(index) = static_cast<uint8_t>((index * 2654435761u) >> 13);
+    }
+    const auto chunk_total =
+        py_cpp_sample::popcount_total_kernel(bytes.data(), chunk_size);
+
+    py_cpp_sample::PopcountStream stream(1);
+    std::vector<std::thread> threads;
+    for (size_t index = 0; index < 4; ++index) {
+        threads.emplace_back([&stream, &bytes] {
+            for (size_t count = 0; count < n_chunks; ++count) {
+                stream.update(bytes.data(), chunk_size);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(4 * n_chunks * chunk_size, stream.size());
+    EXPECT_EQ(4 * n_chunks * chunk_total, stream.total());
+    const auto bins = stream.histogram();
+    EXPECT_EQ(4 * n_chunks * chunk_size,
+              std::accumulate(bins.begin(), bins.end(), uint64_t{0}));
+
+    const py_cpp_sample::PopcountStream copied(stream);
+    EXPECT_EQ(stream.total(), copied.total());
+    EXPECT_EQ(bins, copied.histogram());
+}
+
+TEST(TestThreadPool, AllChunks) {
+    auto &pool = popcount_core::ThreadPool::instance();
+    ASSERT_LE(1, pool.size());
+    EXPECT_EQ(pool.size(), pool.threads_to_use(0));
+    EXPECT_EQ(1, pool.threads_to_use(1));
+    EXPECT_EQ(pool.size(), pool.threads_to_use(pool.size() + 1));
+
+    for (const size_t n_chunks : {0, 1, 2, 7, 1000}) {
+        for (const size_t threads : {0, 1, 2, 3}) {
+            // Each chunk runs once
+            std::vector<std::atomic<int>> counts(n_chunks);
+            for (auto &count : counts) {
+                count.store(0);
+            }
+            pool.run(n_chunks, threads,
+                     [&](size_t chunk_index) { ++counts.at(chunk_index); });
+            for (const auto &count : counts) {
+                EXPECT_EQ(1, count.load());
+            }
+        }
+    }
+}
+
+TEST(TestThreadPool, ConcurrentCallers) {
+    auto &pool = popcount_core::ThreadPool::instance();
+    constexpr size_t n_callers = 4;
+    constexpr size_t n_chunks = 1000;
+    std::vector<std::vector<std::atomic<int>>> counts(n_callers);
+    for (auto &caller_counts : counts) {
+        caller_counts = std::vector<std::atomic<int>>(n_chunks);
+    }
+
+    // Callers which cannot take the pool count serially
+    std::vector<std::thread> callers;
+    for (size_t caller = 0; caller < n_callers; ++caller) {
+        callers.emplace_back([&, caller]() {
+            pool.run(n_chunks, 0, [&](size_t chunk_index) {
+                ++counts.at(caller).at(chunk_index);
+            });
+        });
+    }
+    for (auto &thread : callers) {
+        thread.join();
+    }
+
+    for (const auto &caller_counts : counts) {
+        for (const auto &count : caller_counts) {
+            EXPECT_EQ(1, count.load());
+        }
+    }
+}
+
+TEST(TestAsyncExecutor, AllTasks) {
+    auto &executor = popcount_core::AsyncExecutor::instance();
+    ASSERT_LE(1, executor.size());
+    EXPECT_EQ(&executor, popcount_core::AsyncExecutor::started());
+
+    constexpr size_t n_tasks = 100;
+    std::mutex mutex;
+    std::condition_variable condition;
+    size_t n_done = 0;
+    std::vector<int> counts(n_tasks, 0);
+    for (size_t index = 0; index < n_tasks; ++index) {
+        executor.submit([&, index]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++counts.at(index);
+            ++n_done;
+            condition.notify_one();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&] { return n_done == n_tasks; });
+    EXPECT_TRUE(std::all_of(counts.begin(), counts.end(),
+                            [](int count) { return count == 1; }));
+}
+
+TEST(TestAsyncExecutor, ForkedChild) {
+    popcount_core::AsyncExecutor::instance();
+    popcount_core::ThreadPool::instance();
+    const auto pid = ::fork();
+    ASSERT_LE(0, pid);
+    if (pid == 0) {
+        // Static destructors must not join workers of the parent
+        ::alarm(10);
+        popcount_core::AsyncExecutor::instance().shutdown();
+        std::exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(pid, ::waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST_F(TestPopcountKernel, Threads) {
+    // Larger than the threshold to count on threads
+    constexpr size_t size = (1 << 18) + 3;
+    std::vector<uint64_t> arg(size);
+    const auto expected =
+        setup_popcount<uint64_t>(size, size_t{0x5a5a5a5a5a5a}, arg.data());
+    const auto expected_total = py_cpp_sample::popcount_total_kernel(
+        arg.data(), size * sizeof(uint64_t));
+
+    for (const size_t threads : {0, 1, 2, 3}) {
+        std::vector<Count> actual(size);
+        py_cpp_sample::popcount_kernel(arg.data(), size, actual.data(),
+                                       threads);
+        EXPECT_TRUE(std::equal(actual.begin(), actual.end(), expected.begin()));
+        EXPECT_EQ(expected_total,
+                  py_cpp_sample::popcount_total_kernel(
+                      arg.data(), size * sizeof(uint64_t), threads));
+    }
+}
+
+TEST_F(TestPopcountKernel, Many) {
+    // Small views which chunks group and a large view which chunks split
+    // to count on threads. Odd views are uint8 and others are uint64.
+    std::vector<size_t> sizes;
+    for (size_t index{0}; index < 3000; ++index) {
+        sizes.push_back(index % 70);
+    }
+    sizes.push_back((1 << 17) + 5);
+    sizes.push_back(3);
+
+    std::vector<std::vector<uint64_t>> args;
+    std::vector<std::vector<Count>> expected;
+    std::vector<py_cpp_sample::ManyView> views;
+    for (size_t index{0}; index < sizes.size(); ++index) {
+        const auto size = sizes.at(index);
+        args.emplace_back(size);
+        expected.push_back(setup_popcount<uint64_t>(
+            size, size_t{0x5a5a5a5a5a5a} + index, args.back().data()));
+        if (index % 2) {
+            // Low bytes of uint64 elements at a stride
+            for (size_t i{0}; i < size; ++i) {
+                expected.back().at(i) = static_cast<Count>(
+                    __builtin_popcount(args.back().at(i) & 0xffu));
+            }
+            views.push_back(py_cpp_sample::ManyView{
+                &py_cpp_sample::popcount_strided_kernel<uint8_t>,
+                args.back().data(), sizeof(uint64_t), size, sizeof(uint8_t),
+                nullptr});
+        } else {
+            views.push_back(py_cpp_sample::ManyView{
+                &py_cpp_sample::popcount_strided_kernel<uint64_t>,
+                args.back().data(), sizeof(uint64_t), size, sizeof(uint64_t),
+                nullptr});
+        }
+    }
+
+    for (const size_t threads : {0, 1, 2, 3}) {
+        std::vector<std::vector<Count>> actual;
+        for (size_t index{0}; index < views.size(); ++index) {
+            actual.emplace_back(sizes.at(index), Count{0xee});
+            views.at(index).dst = actual.back().data();
+        }
+        py_cpp_sample::popcount_many_kernel(views, threads);
+        EXPECT_EQ(expected, actual);
+    }
+}
+
+TEST_F(TestPopcountKernel, PerfCounters) {
+    popcount_core::PerfSample empty;
+    EXPECT_FALSE(empty.available());
+    EXPECT_TRUE(std::isnan(empty.value(popcount_core::PerfEvent::Cycles)));
+    EXPECT_TRUE(std::isnan(empty.cycles_per_byte(64)));
+    EXPECT_TRUE(std::isnan(empty.ipc()));
+
+    popcount_core::PerfSample sample;
+    sample.set_value(popcount_core::PerfEvent::Cycles, 200);
+    EXPECT_TRUE(sample.available());
+    EXPECT_TRUE(sample.available(popcount_core::PerfEvent::Cycles));
+    EXPECT_FALSE(sample.available(popcount_core::PerfEvent::Instructions));
+    EXPECT_DOUBLE_EQ(2.0, sample.cycles_per_byte(100));
+    EXPECT_TRUE(std::isnan(sample.ipc()));
+    sample.set_value(popcount_core::PerfEvent::Instructions, 500);
+    EXPECT_DOUBLE_EQ(2.5, sample.ipc());
+
+    // Hosts without counters such as containers count nothing
+    constexpr size_t size = 1 << 16;
+    std::vector<uint64_t> arg(size);
+    const auto expected =
+        setup_popcount<uint64_t>(size, size_t{0x5a5a5a5a5a5a}, arg.data());
+    std::vector<Count> actual(size);
+    popcount_core::PerfCounters counters;
+    counters.start();
+    py_cpp_sample::popcount_kernel(arg.data(), size, actual.data());
+    const auto counted = counters.stop();
+    EXPECT_EQ(expected, actual);
+    if (!counters.available()) {
+        EXPECT_FALSE(counted.available());
+    }
+    if (counted.available(popcount_core::PerfEvent::Cycles)) {
+        EXPECT_LT(0.0, counted.cycles_per_byte(size * sizeof(uint64_t)));
+    }
+}
+
+TEST_F(TestPopcountKernel, StatsHistogramBin) {
+    EXPECT_EQ(0, popcount_core::stats_histogram_bin(0));
+    EXPECT_EQ(0, popcount_core::stats_histogram_bin(1));
+    EXPECT_EQ(1, popcount_core::stats_histogram_bin(2));
+    EXPECT_EQ(1, popcount_core::stats_histogram_bin(3));
+    EXPECT_EQ(9, popcount_core::stats_histogram_bin(1023));
+    EXPECT_EQ(10, popcount_core::stats_histogram_bin(1024));
+    EXPECT_EQ(popcount_core::Stats_Histogram_Bins - 1,
+              popcount_core::stats_histogram_bin(
+                  std::numeric_limits<uint64_t>::max()));
+}
+
+TEST_F(TestPopcountKernel, Stats) {
+    using popcount_core::KernelVariant;
+    popcount_core::reset_stats();
+    const auto empty = popcount_core::get_stats();
+    EXPECT_EQ(0, empty.calls);
+
+    // Threads exit before reading their counters
+    constexpr size_t n_threads = 4;
+    constexpr size_t n_calls = 100;
+    std::vector<std::thread> threads;
+    for (size_t index{0}; index < n_threads; ++index) {
+        threads.emplace_back([] {
+            for (size_t count{0}; count < n_calls; ++count) {
+                const popcount_core::StatsScope stats(
+                    KernelVariant::Popcnt,
+                    count ? 10 : popcount_core::Stats_Timed_Bytes,
+                    (count % 10) == 0);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    {
+        const popcount_core::StatsScope stats(KernelVariant::Scalar, 3, false);
+    }
+
+    const auto actual = popcount_core::get_stats();
+    if (!popcount_core::Stats_Enabled) {
+        EXPECT_EQ(0, actual.calls);
+        return;
+    }
+    EXPECT_EQ(n_threads * n_calls + 1, actual.calls);
+    EXPECT_EQ(n_threads * ((n_calls - 1) * 10 +
+                           popcount_core::Stats_Timed_Bytes) +
+                  3,
+              actual.bytes);
+    EXPECT_EQ(n_threads * n_calls / 10, actual.copies);
+    EXPECT_EQ(n_threads, actual.timed_calls);
+    EXPECT_EQ(1, actual.variant_calls.at(
+                     static_cast<size_t>(KernelVariant::Scalar)));
+    EXPECT_EQ(n_threads * n_calls,
+              actual.variant_calls.at(
+                  static_cast<size_t>(KernelVariant::Popcnt)));
+    EXPECT_EQ(n_threads, std::accumulate(actual.latency_histogram.begin(),
+                                         actual.latency_histogram.end(),
+                                         uint64_t{0}));
+
+    popcount_core::reset_stats();
+    EXPECT_EQ(0, popcount_core::get_stats().calls);
+    EXPECT_EQ(0, popcount_core::get_stats().bytes);
+}
+
 int main(int argc, char *argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
 
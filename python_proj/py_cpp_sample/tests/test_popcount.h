@@ -3,5 +3,12 @@
 
 #include "popcount.h"
 #include "popcount_boost.h"
+#include "popcount_file.h"
+#include "popcount_kernel.h"
+#include "popcount_perf.h"
+#include "popcount_stats.h"
+#include "popcount_stream.h"
+#include "rank_select.h"
+#include "thread_pool.h"
 
 #endif // TESTS_TEST_POPCOUNT_H
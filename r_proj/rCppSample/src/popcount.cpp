@@ -1,52 +1,741 @@
 #include "popcount_impl.h"
+#include "popcount_perf.h"
+#include "popcount_stats.h"
+#include "rank_select.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#ifndef UNIT_TEST_CPP
+#include <R_ext/Altrep.h>
+#endif // UNIT_TEST_CPP
 
 namespace {
+//' Convert the number of threads from R
+//'
+//' @param threads The number of threads or 0 for all cores
+//' @return The number of threads for kernels
+size_t to_thread_count(int threads) {
+    // Reject NA_integer_ as well
+    if (threads < 0) {
+        throw std::invalid_argument("threads must be a non-negative integer");
+    }
+    return static_cast<size_t>(threads);
+}
+
+//' Get the size of a vector
+//'
+//' @tparam T A type of vectors
+//' @param xs A vector
+//' @return The size of elements in bytes
+template <typename T> size_t size_in_bytes(const T &xs) {
+    return static_cast<size_t>(xs.size()) * sizeof(*get_data_pointer(xs));
+}
+
 //' Count 1's in each element
 //'
+//' @tparam U A type of vectors to return
 //' @tparam T A type of integers
 //' @param xs An integer vector to count populations
+//' @param threads The number of threads or 0 for all cores
 //' @return The populations of elements in the vector
-template <typename T> rCppSample::IntegerVector popcount_cpp_impl(const T &xs) {
-    auto size = xs.size();
-    // Initialize with 0s
-    rCppSample::IntegerVector results(size);
+template <typename U, typename T>
+U popcount_cpp_impl(const T &xs, int threads) {
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size_in_bytes(xs), false);
+    const auto size = xs.size();
+    // Kernels write all elements
+    auto results = make_uninitialized_vector<U>(size);
+    rCppSample::popcount_kernel(get_data_pointer(xs), static_cast<size_t>(size),
+                                get_data_pointer(results), thread_count);
+    return results;
+}
+
+//' Count 1's in each element and write them into out
+//'
+//' @tparam T A type of integers
+//' @tparam U A type of integer vectors
+//' @param xs An integer vector to count populations
+//' @param out An integer vector as long as xs
+//' @param threads The number of threads or 0 for all cores
+template <typename T, typename U>
+void popcount_into_cpp_impl(const T &xs, U &out, int threads) {
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size_in_bytes(xs), false);
+    const auto size = xs.size();
+    if (static_cast<size_t>(out.size()) != static_cast<size_t>(size)) {
+        throw std::invalid_argument("out must be as long as xs");
+    }
+    rCppSample::popcount_kernel(get_data_pointer(xs), static_cast<size_t>(size),
+                                get_data_pointer(out), thread_count);
+}
+
+//' Count 1's in all non-NA elements
+//'
+//' @tparam T int or int64_t
+//' @param xs A pointer to elements
+//' @param size The number of elements
+//' @param na_rm Skip NAs if true, return NA if false and xs has NAs
+//' @param threads The number of threads or 0 for all cores
+//' @return The total population of elements
+template <typename T>
+double popcount_total_na_cpp_impl(const T *xs, size_t size, bool na_rm,
+                                  int threads) {
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size * sizeof(T), false);
+    size_t na_count = 0;
+    const auto total =
+        rCppSample::popcount_total_kernel(xs, size, na_count, thread_count);
+    if ((na_count > 0) && !na_rm) {
+        return rCppSample::NaReal;
+    }
+    return static_cast<double>(total);
+}
+} // namespace
 
-    for (decltype(size) i = 0; i < size; ++i) {
-        const auto x = xs[i];
-        static_assert(std::is_integral<decltype(x)>::value, "Must be integral");
-#ifdef __GNUC__
 #ifdef UNIT_TEST_CPP
-        const auto v = is_na_integer(x)
-                           ? get_na_int_value()
-                           : __builtin_popcount(static_cast<unsigned int>(x));
+rCppSample::IntegerVector popcount_cpp_raw(rCppSample::ArgRawVector xs,
+                                           int threads)
 #else  // UNIT_TEST_CPP
-        const auto v = is_na_integer<T>(x)
-                           ? get_na_int_value()
-                           : __builtin_popcount(static_cast<unsigned int>(x));
+Rcpp::IntegerVector popcount_cpp_raw(const Rcpp::RawVector &xs, int threads)
 #endif // UNIT_TEST_CPP
-#else
-#error Use an alternative of __builtin_popcount
-#endif
-        results[i] = v;
+{
+    return popcount_cpp_impl<rCppSample::IntegerVector>(xs, threads);
+}
+
+#ifdef UNIT_TEST_CPP
+rCppSample::IntegerVector popcount_cpp_integer(rCppSample::ArgIntegerVector xs,
+                                               int threads)
+#else  // UNIT_TEST_CPP
+Rcpp::IntegerVector popcount_cpp_integer(const Rcpp::IntegerVector &xs,
+                                         int threads)
+#endif // UNIT_TEST_CPP
+{
+    return popcount_cpp_impl<rCppSample::IntegerVector>(xs, threads);
+}
+
+// Logical vectors hold TRUE, FALSE and NA_INTEGER in integers
+#ifdef UNIT_TEST_CPP
+rCppSample::IntegerVector popcount_cpp_logical(rCppSample::ArgLogicalVector xs,
+                                               int threads)
+#else  // UNIT_TEST_CPP
+Rcpp::IntegerVector popcount_cpp_logical(const Rcpp::LogicalVector &xs,
+                                         int threads)
+#endif // UNIT_TEST_CPP
+{
+    return popcount_cpp_impl<rCppSample::IntegerVector>(xs, threads);
+}
+
+#ifdef UNIT_TEST_CPP
+rCppSample::IntegerVector popcount_cpp_double(rCppSample::ArgNumericVector xs,
+                                              int threads)
+#else  // UNIT_TEST_CPP
+Rcpp::IntegerVector popcount_cpp_double(const Rcpp::NumericVector &xs,
+                                        int threads)
+#endif // UNIT_TEST_CPP
+{
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size_in_bytes(xs), false);
+    const auto size = xs.size();
+    auto results = make_uninitialized_vector<rCppSample::IntegerVector>(size);
+    const auto out_of_range = rCppSample::popcount_kernel(
+        get_data_pointer(xs), static_cast<size_t>(size),
+        get_data_pointer(results), thread_count);
+#ifndef UNIT_TEST_CPP
+    // Warn once as as.integer() does
+    if (out_of_range > 0) {
+        Rcpp::warning("NAs introduced by coercion to integer range");
     }
+#else  // UNIT_TEST_CPP
+    static_cast<void>(out_of_range);
+#endif // UNIT_TEST_CPP
     return results;
 }
-} // namespace
 
 #ifdef UNIT_TEST_CPP
-rCppSample::IntegerVector popcount_cpp_raw(rCppSample::ArgRawVector xs)
+rCppSample::IntegerVector
+popcount_cpp_integer64(rCppSample::ArgNumericVector xs, int threads)
 #else  // UNIT_TEST_CPP
-Rcpp::IntegerVector popcount_cpp_raw(const Rcpp::RawVector &xs)
+Rcpp::IntegerVector popcount_cpp_integer64(const Rcpp::NumericVector &xs,
+                                           int threads)
 #endif // UNIT_TEST_CPP
 {
-    return popcount_cpp_impl(xs);
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size_in_bytes(xs), false);
+    const auto size = xs.size();
+    auto results = make_uninitialized_vector<rCppSample::IntegerVector>(size);
+    rCppSample::popcount_kernel(get_integer64_pointer(xs),
+                                static_cast<size_t>(size),
+                                get_data_pointer(results), thread_count);
+    return results;
 }
 
+// Counts of bytes fit in bytes and take a quarter of integers
 #ifdef UNIT_TEST_CPP
-rCppSample::IntegerVector popcount_cpp_integer(rCppSample::ArgIntegerVector xs)
+rCppSample::RawVector popcount_compact_cpp_raw(rCppSample::ArgRawVector xs,
+                                               int threads)
 #else  // UNIT_TEST_CPP
-Rcpp::IntegerVector popcount_cpp_integer(const Rcpp::IntegerVector &xs)
+Rcpp::RawVector popcount_compact_cpp_raw(const Rcpp::RawVector &xs, int threads)
 #endif // UNIT_TEST_CPP
 {
-    return popcount_cpp_impl(xs);
+    return popcount_cpp_impl<rCppSample::RawVector>(xs, threads);
+}
+
+// Return doubles because totals can exceed the range of R integers
+#ifdef UNIT_TEST_CPP
+double popcount_total_cpp_raw(rCppSample::ArgRawVector xs, int threads)
+#else  // UNIT_TEST_CPP
+double popcount_total_cpp_raw(const Rcpp::RawVector &xs, int threads)
+#endif // UNIT_TEST_CPP
+{
+    const auto thread_count = to_thread_count(threads);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size_in_bytes(xs), false);
+    return static_cast<double>(rCppSample::popcount_total_kernel(
+        get_data_pointer(xs), static_cast<size_t>(xs.size()), thread_count));
+}
+
+#ifdef UNIT_TEST_CPP
+double popcount_total_cpp_integer(rCppSample::ArgIntegerVector xs, bool na_rm,
+                                  int threads)
+#else  // UNIT_TEST_CPP
+double popcount_total_cpp_integer(const Rcpp::IntegerVector &xs, bool na_rm,
+                                  int threads)
+#endif // UNIT_TEST_CPP
+{
+    return popcount_total_na_cpp_impl(
+        get_data_pointer(xs), static_cast<size_t>(xs.size()), na_rm, threads);
+}
+
+#ifdef UNIT_TEST_CPP
+double popcount_total_cpp_logical(rCppSample::ArgLogicalVector xs, bool na_rm,
+                                  int threads)
+#else  // UNIT_TEST_CPP
+double popcount_total_cpp_logical(const Rcpp::LogicalVector &xs, bool na_rm,
+                                  int threads)
+#endif // UNIT_TEST_CPP
+{
+    return popcount_total_na_cpp_impl(
+        get_data_pointer(xs), static_cast<size_t>(xs.size()), na_rm, threads);
+}
+
+#ifdef UNIT_TEST_CPP
+double popcount_total_cpp_integer64(rCppSample::ArgNumericVector xs,
+                                    bool na_rm, int threads)
+#else  // UNIT_TEST_CPP
+double popcount_total_cpp_integer64(const Rcpp::NumericVector &xs, bool na_rm,
+                                    int threads)
+#endif // UNIT_TEST_CPP
+{
+    return popcount_total_na_cpp_impl(get_integer64_pointer(xs),
+                                      static_cast<size_t>(xs.size()), na_rm,
+                                      threads);
+}
+
+#ifdef UNIT_TEST_CPP
+void popcount_into_cpp_raw(rCppSample::ArgRawVector xs,
+                           rCppSample::IntegerVector &out, int threads)
+#else  // UNIT_TEST_CPP
+void popcount_into_cpp_raw(const Rcpp::RawVector &xs, Rcpp::IntegerVector out,
+                           int threads)
+#endif // UNIT_TEST_CPP
+{
+    popcount_into_cpp_impl(xs, out, threads);
+}
+
+#ifdef UNIT_TEST_CPP
+void popcount_into_cpp_integer(rCppSample::ArgIntegerVector xs,
+                               rCppSample::IntegerVector &out, int threads)
+#else  // UNIT_TEST_CPP
+void popcount_into_cpp_integer(const Rcpp::IntegerVector &xs,
+                               Rcpp::IntegerVector out, int threads)
+#endif // UNIT_TEST_CPP
+{
+    popcount_into_cpp_impl(xs, out, threads);
+}
+
+#ifndef UNIT_TEST_CPP
+namespace {
+//' Point to the elements of a vector in a list
+//'
+//' @param xs A raw, integer, logical, double or integer64 vector
+//' @param dst A vector to write populations of xs
+//' @return A vector which popcount_many_kernel counts
+rCppSample::ManyVector to_many_vector(SEXP xs, int *dst) {
+    const auto size = static_cast<size_t>(XLENGTH(xs));
+    switch (TYPEOF(xs)) {
+    case RAWSXP:
+        return rCppSample::ManyVector{
+            rCppSample::popcount_many_element<uint8_t>, RAW(xs), size,
+            sizeof(uint8_t), dst};
+    case INTSXP:
+        return rCppSample::ManyVector{rCppSample::popcount_many_element<int>,
+                                      INTEGER(xs), size, sizeof(int), dst};
+    case LGLSXP:
+        return rCppSample::ManyVector{rCppSample::popcount_many_element<int>,
+                                      LOGICAL(xs), size, sizeof(int), dst};
+    case REALSXP:
+        if (Rf_inherits(xs, "integer64")) {
+            return rCppSample::ManyVector{
+                rCppSample::popcount_many_element<int64_t>, REAL(xs), size,
+                sizeof(int64_t), dst};
+        }
+        return rCppSample::ManyVector{
+            rCppSample::popcount_many_element<double>, REAL(xs), size,
+            sizeof(double), dst};
+    default:
+        throw std::invalid_argument("xs_list must contain raw, integer, "
+                                    "logical, double or integer64 vectors");
+    }
+}
+} // namespace
+
+Rcpp::List popcount_many_cpp(const Rcpp::List &xs_list, bool concatenate,
+                             int threads) {
+    const auto thread_count = to_thread_count(threads);
+    const auto n_vectors = xs_list.size();
+
+    // Vectors in xs_list outlive kernels without copying them
+    std::vector<R_xlen_t> offsets(n_vectors + 1, 0);
+    for (R_xlen_t i = 0; i < n_vectors; ++i) {
+        offsets[i + 1] = offsets[i] + XLENGTH(VECTOR_ELT(xs_list, i));
+    }
+
+    std::vector<rCppSample::ManyVector> vectors;
+    vectors.reserve(n_vectors);
+    Rcpp::List result;
+    if (concatenate) {
+        auto counts = make_uninitialized_vector<Rcpp::IntegerVector>(
+            offsets[n_vectors]);
+        auto starts = make_uninitialized_vector<Rcpp::NumericVector>(
+            n_vectors + 1);
+        for (R_xlen_t i = 0; i < n_vectors; ++i) {
+            vectors.push_back(to_many_vector(
+                VECTOR_ELT(xs_list, i), get_data_pointer(counts) + offsets[i]));
+            starts[i] = static_cast<double>(offsets[i]);
+        }
+        starts[n_vectors] = static_cast<double>(offsets[n_vectors]);
+        result = Rcpp::List::create(Rcpp::Named("counts") = counts,
+                                    Rcpp::Named("offsets") = starts);
+    } else {
+        Rcpp::List counts_list(n_vectors);
+        for (R_xlen_t i = 0; i < n_vectors; ++i) {
+            auto counts = make_uninitialized_vector<Rcpp::IntegerVector>(
+                offsets[i + 1] - offsets[i]);
+            vectors.push_back(to_many_vector(VECTOR_ELT(xs_list, i),
+                                             get_data_pointer(counts)));
+            counts_list[i] = counts;
+        }
+        // Keep names as lapply() does
+        counts_list.attr("names") = Rf_getAttrib(xs_list, R_NamesSymbol);
+        result = counts_list;
+    }
+
+    size_t n_bytes = 0;
+    for (const auto &vector : vectors) {
+        n_bytes += vector.size * vector.element_size;
+    }
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          n_bytes, false);
+    const auto out_of_range =
+        rCppSample::popcount_many_kernel(vectors, thread_count);
+    // Warn once as as.integer() does
+    if (out_of_range > 0) {
+        Rcpp::warning("NAs introduced by coercion to integer range");
+    }
+    return result;
+}
+
+Rcpp::NumericVector popcount_profile_cpp(SEXP xs, int times) {
+    if (times <= 0) {
+        throw std::invalid_argument("times must be a positive integer");
+    }
+    const auto size = static_cast<size_t>(XLENGTH(xs));
+    auto counts = make_uninitialized_vector<Rcpp::IntegerVector>(size);
+    const auto vector = to_many_vector(xs, get_data_pointer(counts));
+
+    // Count on this thread which the counters measure
+    popcount_core::PerfCounters counters;
+    vector.kernel(vector.src, vector.size, vector.dst);
+    const auto start = std::chrono::steady_clock::now();
+    counters.start();
+    for (int count = 0; count < times; ++count) {
+        vector.kernel(vector.src, vector.size, vector.dst);
+    }
+    const auto sample = counters.stop();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    const auto n_bytes =
+        vector.size * vector.element_size * static_cast<size_t>(times);
+    Rcpp::NumericVector profile(4 + popcount_core::Number_Of_Perf_Events);
+    Rcpp::CharacterVector names(profile.size());
+    R_xlen_t index = 0;
+    const auto add = [&](const char *name, double value) {
+        // NaN for events which the host does not count
+        names[index] = name;
+        profile[index] = std::isnan(value) ? NA_REAL : value;
+        ++index;
+    };
+    add("bytes", static_cast<double>(n_bytes));
+    add("seconds", elapsed.count());
+    for (size_t event = 0; event < popcount_core::Number_Of_Perf_Events;
+         ++event) {
+        add(popcount_core::Perf_Event_Names.at(event),
+            sample.value(static_cast<popcount_core::PerfEvent>(event)));
+    }
+    add("cycles_per_byte", sample.cycles_per_byte(n_bytes));
+    add("ipc", sample.ipc());
+    profile.attr("names") = names;
+    return profile;
+}
+
+namespace {
+using BitvectorPointer = Rcpp::XPtr<popcount_core::RankSelectBitvector>;
+
+//' Convert a position or an ordinal of bits from R
+//'
+//' @param x A non-negative integer in a double
+//' @return x for kernels which reject too large ones
+size_t to_bit_index(double x) {
+    // Reject NAs, negative and fractional numbers and 2^64 or more
+    if (!(x >= 0.0) || !(x < 18446744073709551616.0) || (std::floor(x) < x)) {
+        throw std::out_of_range("positions must be non-negative integers");
+    }
+    return static_cast<size_t>(x);
+}
+
+//' Answer queries to a bitvector
+//'
+//' @tparam Query A type of functions
+//' @param bitvector An external pointer to a bitvector
+//' @param queries Positions or ordinals of bits
+//' @param query A function which answers a query
+//' @return The answer of each query
+template <typename Query>
+Rcpp::NumericVector answer_queries(SEXP bitvector,
+                                   const Rcpp::NumericVector &queries,
+                                   Query query) {
+    // Pointers are invalid after saveRDS() and readRDS()
+    const BitvectorPointer pointer(bitvector);
+    const auto &index = *pointer.checked_get();
+    const auto size = queries.size();
+    Rcpp::NumericVector answers(size);
+    for (decltype(queries.size()) i = 0; i < size; ++i) {
+        answers[i] =
+            static_cast<double>(query(index, to_bit_index(queries[i])));
+    }
+    return answers;
+}
+} // namespace
+
+SEXP rank_select_bitvector_cpp(const Rcpp::RawVector &bits, double size) {
+    const auto n_bits = to_bit_index(size);
+    if (n_bits > static_cast<size_t>(bits.size()) * 8) {
+        throw std::invalid_argument("size must not exceed the bits");
+    }
+    return BitvectorPointer(
+        new popcount_core::RankSelectBitvector(
+            get_data_pointer(bits), n_bits, rCppSample::get_kernel_variant()),
+        true);
+}
+
+double rank_select_count_cpp(SEXP bitvector) {
+    const BitvectorPointer pointer(bitvector);
+    return static_cast<double>(pointer.checked_get()->count());
+}
+
+Rcpp::NumericVector rank_select_rank_cpp(SEXP bitvector,
+                                         const Rcpp::NumericVector &indexes) {
+    return answer_queries(
+        bitvector, indexes,
+        [](const popcount_core::RankSelectBitvector &index, size_t position) {
+            return index.rank(position);
+        });
+}
+
+Rcpp::NumericVector rank_select_select_cpp(SEXP bitvector,
+                                           const Rcpp::NumericVector &nths) {
+    return answer_queries(
+        bitvector, nths,
+        [](const popcount_core::RankSelectBitvector &index, size_t nth) {
+            return index.select(nth);
+        });
+}
+
+namespace {
+// Lazy populations hold list(xs, threads) in data1 and
+// materialized populations or NULL in data2. Double sources are integer64
+// and popcount counts plain doubles at once to warn about coercion.
+R_altrep_class_t popcount_lazy_class;
+
+SEXP get_lazy_source(SEXP x) {
+    return VECTOR_ELT(R_altrep_data1(x), 0);
+}
+
+size_t get_lazy_threads(SEXP x) {
+    return static_cast<size_t>(INTEGER(VECTOR_ELT(R_altrep_data1(x), 1))[0]);
+}
+
+//' Get the size of elements of a source of lazy populations
+//'
+//' @param xs A raw, integer, logical or integer64 vector
+//' @return The size of an element in bytes
+size_t get_element_size(SEXP xs) {
+    switch (TYPEOF(xs)) {
+    case RAWSXP:
+        return sizeof(uint8_t);
+    case REALSXP:
+        return sizeof(int64_t);
+    default:
+        return sizeof(int);
+    }
+}
+
+//' Count 1's in a region of raw, integer, logical or integer64 elements
+//'
+//' @param xs A raw, integer, logical or integer64 vector
+//' @param offset The index of the first element of the region
+//' @param size The number of elements in the region
+//' @param dst A pointer to the populations of the region
+//' @param threads The number of threads or 0 for all cores
+void popcount_region(SEXP xs, R_xlen_t offset, R_xlen_t size, int *dst,
+                     size_t threads) {
+    const auto n = static_cast<size_t>(size);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          n * get_element_size(xs), false);
+    switch (TYPEOF(xs)) {
+    case RAWSXP:
+        rCppSample::popcount_kernel(RAW(xs) + offset, n, dst, threads);
+        break;
+    case REALSXP:
+        rCppSample::popcount_kernel(
+            reinterpret_cast<const int64_t *>(REAL(xs)) + offset, n, dst,
+            threads);
+        break;
+    default:
+        // INTEGER() reads logical vectors as well
+        rCppSample::popcount_kernel(INTEGER(xs) + offset, n, dst, threads);
+        break;
+    }
+}
+
+R_xlen_t popcount_lazy_length(SEXP x) {
+    return XLENGTH(get_lazy_source(x));
+}
+
+Rboolean popcount_lazy_inspect(SEXP x, int, int, int,
+                               void (*)(SEXP, int, int, int)) {
+    Rprintf("popcount_lazy_integer (len=%lld, materialized=%s)\n",
+            static_cast<long long>(popcount_lazy_length(x)),
+            (R_altrep_data2(x) == R_NilValue) ? "F" : "T");
+    return TRUE;
+}
+
+// Writing to the data pointer needs materialized populations
+SEXP popcount_lazy_duplicate(SEXP x, Rboolean) {
+    if (R_altrep_data2(x) != R_NilValue) {
+        return nullptr;
+    }
+    return R_new_altrep(popcount_lazy_class, R_altrep_data1(x), R_NilValue);
+}
+
+void *popcount_lazy_dataptr(SEXP x, Rboolean) {
+    SEXP populations = R_altrep_data2(x);
+    if (populations == R_NilValue) {
+        const auto xs = get_lazy_source(x);
+        const auto size = XLENGTH(xs);
+        populations = PROTECT(Rf_allocVector(INTSXP, size));
+        popcount_region(xs, 0, size, INTEGER(populations),
+                        get_lazy_threads(x));
+        R_set_altrep_data2(x, populations);
+        UNPROTECT(1);
+    }
+    return INTEGER(populations);
+}
+
+const void *popcount_lazy_dataptr_or_null(SEXP x) {
+    const auto populations = R_altrep_data2(x);
+    return (populations == R_NilValue) ? nullptr : INTEGER(populations);
+}
+
+int popcount_lazy_elt(SEXP x, R_xlen_t i) {
+    const auto populations = R_altrep_data2(x);
+    if (populations != R_NilValue) {
+        return INTEGER(populations)[i];
+    }
+
+    const auto xs = get_lazy_source(x);
+    int population = 0;
+    switch (TYPEOF(xs)) {
+    case RAWSXP: {
+        const uint8_t element = RAW_ELT(xs, i);
+        rCppSample::popcount_kernel(&element, 1, &population);
+        break;
+    }
+    case REALSXP: {
+        const double bits = REAL_ELT(xs, i);
+        int64_t element = 0;
+        std::memcpy(&element, &bits, sizeof(element));
+        rCppSample::popcount_kernel(&element, 1, &population);
+        break;
+    }
+    case LGLSXP: {
+        const int element = LOGICAL_ELT(xs, i);
+        rCppSample::popcount_kernel(&element, 1, &population);
+        break;
+    }
+    default: {
+        const int element = INTEGER_ELT(xs, i);
+        rCppSample::popcount_kernel(&element, 1, &population);
+        break;
+    }
+    }
+    return population;
+}
+
+R_xlen_t popcount_lazy_get_region(SEXP x, R_xlen_t i, R_xlen_t n, int *buf) {
+    const auto size = std::min(n, popcount_lazy_length(x) - i);
+    const auto populations = R_altrep_data2(x);
+    if (populations != R_NilValue) {
+        std::copy_n(INTEGER(populations) + i, size, buf);
+    } else {
+        popcount_region(get_lazy_source(x), i, size, buf,
+                        get_lazy_threads(x));
+    }
+    return size;
+}
+
+SEXP popcount_lazy_sum(SEXP x, Rboolean narm) {
+    // Sum modified populations as they are
+    if (R_altrep_data2(x) != R_NilValue) {
+        return nullptr;
+    }
+
+    const auto xs = get_lazy_source(x);
+    const auto size = static_cast<size_t>(XLENGTH(xs));
+    const auto threads = get_lazy_threads(x);
+    const popcount_core::StatsScope stats(rCppSample::get_kernel_variant(),
+                                          size * get_element_size(xs), false);
+    size_t na_count = 0;
+    uint64_t total = 0;
+    switch (TYPEOF(xs)) {
+    case RAWSXP:
+        total = rCppSample::popcount_total_kernel(RAW(xs), size, threads);
+        break;
+    case REALSXP:
+        total = rCppSample::popcount_total_kernel(
+            reinterpret_cast<const int64_t *>(REAL(xs)), size, na_count,
+            threads);
+        break;
+    default:
+        total = rCppSample::popcount_total_kernel(INTEGER(xs), size, na_count,
+                                                  threads);
+        break;
+    }
+    if ((na_count > 0) && !narm) {
+        return Rf_ScalarInteger(NA_INTEGER);
+    }
+
+    // R warns on overflow and returns NA while summing regions
+    if (total > static_cast<uint64_t>(INT_MAX)) {
+        return nullptr;
+    }
+    return Rf_ScalarInteger(static_cast<int>(total));
+}
+
+int popcount_lazy_no_na(SEXP x) {
+    // R may have written NAs into materialized populations
+    if (R_altrep_data2(x) != R_NilValue) {
+        return 0;
+    }
+    return (TYPEOF(get_lazy_source(x)) == RAWSXP);
+}
+} // namespace
+
+SEXP popcount_lazy_cpp(SEXP xs, int threads) {
+    const auto thread_count = to_thread_count(threads);
+    const auto type = TYPEOF(xs);
+    if ((type != RAWSXP) && (type != INTSXP) && (type != LGLSXP) &&
+        !((type == REALSXP) && Rf_inherits(xs, "integer64"))) {
+        throw std::invalid_argument(
+            "xs must be a raw, integer, logical or integer64 vector");
+    }
+
+    // Modifying xs later copies it and keeps populations
+    MARK_NOT_MUTABLE(xs);
+    const auto data1 = Rcpp::List::create(
+        xs, Rcpp::IntegerVector::create(static_cast<int>(thread_count)));
+    return R_new_altrep(popcount_lazy_class, data1, R_NilValue);
+}
+
+void init_popcount_lazy_class(DllInfo *dll) {
+    popcount_lazy_class = R_make_altinteger_class("popcount_lazy_integer",
+                                                  "rCppSample", dll);
+    R_set_altrep_Length_method(popcount_lazy_class, popcount_lazy_length);
+    R_set_altrep_Inspect_method(popcount_lazy_class, popcount_lazy_inspect);
+    R_set_altrep_Duplicate_method(popcount_lazy_class,
+                                  popcount_lazy_duplicate);
+    R_set_altvec_Dataptr_method(popcount_lazy_class, popcount_lazy_dataptr);
+    R_set_altvec_Dataptr_or_null_method(popcount_lazy_class,
+                                        popcount_lazy_dataptr_or_null);
+    R_set_altinteger_Elt_method(popcount_lazy_class, popcount_lazy_elt);
+    R_set_altinteger_Get_region_method(popcount_lazy_class,
+                                       popcount_lazy_get_region);
+    R_set_altinteger_Sum_method(popcount_lazy_class, popcount_lazy_sum);
+    R_set_altinteger_No_NA_method(popcount_lazy_class, popcount_lazy_no_na);
+}
+
+Rcpp::List stats_cpp() {
+    const auto snapshot = popcount_core::get_stats();
+    Rcpp::NumericVector variants(popcount_core::Number_Of_Variants);
+    Rcpp::CharacterVector names(popcount_core::Number_Of_Variants);
+    for (size_t index = 0; index < popcount_core::Number_Of_Variants;
+         ++index) {
+        variants[index] = static_cast<double>(snapshot.variant_calls.at(index));
+        names[index] = popcount_core::Kernel_Variant_Names.at(index);
+    }
+    variants.attr("names") = names;
+    const Rcpp::NumericVector histogram(snapshot.latency_histogram.begin(),
+                                        snapshot.latency_histogram.end());
+
+    // Counts may exceed the range of R integers
+    return Rcpp::List::create(
+        Rcpp::Named("enabled") = popcount_core::Stats_Enabled,
+        Rcpp::Named("calls") = static_cast<double>(snapshot.calls),
+        Rcpp::Named("bytes") = static_cast<double>(snapshot.bytes),
+        Rcpp::Named("copies") = static_cast<double>(snapshot.copies),
+        Rcpp::Named("timed_calls") = static_cast<double>(snapshot.timed_calls),
+        Rcpp::Named("seconds") =
+            static_cast<double>(snapshot.nanoseconds) * 1e-9,
+        Rcpp::Named("variants") = variants,
+        Rcpp::Named("latency_histogram") = histogram);
+}
+#endif // UNIT_TEST_CPP
+
+std::string get_kernel_variant_cpp() {
+    return rCppSample::kernel_variant_name(rCppSample::get_kernel_variant());
+}
+
+void set_kernel_variant_cpp(const std::string &name) {
+    rCppSample::set_kernel_variant(rCppSample::parse_kernel_variant(name));
+}
+
+std::vector<std::string> supported_kernel_variants_cpp() {
+    return rCppSample::supported_kernel_variants();
+}
+
+void reset_stats_cpp() {
+    popcount_core::reset_stats();
+}
+
+void record_stats_copy_cpp() {
+    popcount_core::record_stats_copy();
 }
@@ -1,11 +1,13 @@
 #ifndef SRC_POPCOUNT_H
 #define SRC_POPCOUNT_H
 
+#include <string>
+#include <vector>
 #ifdef UNIT_TEST_CPP
 #include <cstdint>
 #include <limits>
-#include <vector>
 #else // UNIT_TEST_CPP
+#include <R_ext/Rdynload.h>
 #include <Rcpp.h>
 #endif // UNIT_TEST_CPP
 
@@ -14,35 +16,275 @@ namespace rCppSample {
 // Types for testing
 using IntegerVector = std::vector<int>;
 using RawVector = std::vector<uint8_t>;
+using LogicalVector = std::vector<int>;
+using NumericVector = std::vector<double>;
 using ArgIntegerVector = const std::vector<int> &;
 using ArgRawVector = const std::vector<uint8_t> &;
+using ArgLogicalVector = const std::vector<int> &;
+using ArgNumericVector = const std::vector<double> &;
 constexpr int NaInteger = std::numeric_limits<int>::min();
+constexpr double NaReal = std::numeric_limits<double>::quiet_NaN();
 #else  // UNIT_TEST_CPP
 using IntegerVector = Rcpp::IntegerVector;
 using RawVector = Rcpp::RawVector;
+using LogicalVector = Rcpp::LogicalVector;
+using NumericVector = Rcpp::NumericVector;
 const int NaInteger = NA_INTEGER;
+const double NaReal = NA_REAL;
 #endif // UNIT_TEST_CPP
 } // namespace rCppSample
 
 #ifdef UNIT_TEST_CPP
-extern rCppSample::IntegerVector popcount_cpp_raw(rCppSample::ArgRawVector xs);
+extern rCppSample::IntegerVector popcount_cpp_raw(rCppSample::ArgRawVector xs,
+                                                  int threads = 1);
+extern rCppSample::IntegerVector
+popcount_cpp_integer(rCppSample::ArgIntegerVector xs, int threads = 1);
+extern rCppSample::IntegerVector
+popcount_cpp_logical(rCppSample::ArgLogicalVector xs, int threads = 1);
+extern rCppSample::IntegerVector
+popcount_cpp_double(rCppSample::ArgNumericVector xs, int threads = 1);
 extern rCppSample::IntegerVector
-popcount_cpp_integer(rCppSample::ArgIntegerVector xs);
+popcount_cpp_integer64(rCppSample::ArgNumericVector xs, int threads = 1);
+extern rCppSample::RawVector
+popcount_compact_cpp_raw(rCppSample::ArgRawVector xs, int threads = 1);
+extern double popcount_total_cpp_raw(rCppSample::ArgRawVector xs,
+                                     int threads = 1);
+extern double popcount_total_cpp_integer(rCppSample::ArgIntegerVector xs,
+                                         bool na_rm, int threads = 1);
+extern double popcount_total_cpp_logical(rCppSample::ArgLogicalVector xs,
+                                         bool na_rm, int threads = 1);
+extern double popcount_total_cpp_integer64(rCppSample::ArgNumericVector xs,
+                                           bool na_rm, int threads = 1);
+extern void popcount_into_cpp_raw(rCppSample::ArgRawVector xs,
+                                  rCppSample::IntegerVector &out,
+                                  int threads = 1);
+extern void popcount_into_cpp_integer(rCppSample::ArgIntegerVector xs,
+                                      rCppSample::IntegerVector &out,
+                                      int threads = 1);
 #else  // UNIT_TEST_CPP
 // Call by value, not reference to check types!
 //' Count 1's in each raw element
 //'
 //' @param xs A raw vector to count populations
+//' @param threads The number of threads or 0 for all cores
 //' @return The populations of elements in the vector
 // [[Rcpp::export]]
-extern Rcpp::IntegerVector popcount_cpp_raw(const Rcpp::RawVector &xs);
+extern Rcpp::IntegerVector popcount_cpp_raw(const Rcpp::RawVector &xs,
+                                            int threads = 1);
 
 //' Count 1's in each integer element
 //'
 //' @param xs An integer vector to count populations
+//' @param threads The number of threads or 0 for all cores
+//' @return The populations of elements in the vector
+// [[Rcpp::export]]
+extern Rcpp::IntegerVector popcount_cpp_integer(const Rcpp::IntegerVector &xs,
+                                                int threads = 1);
+
+//' Count 1's in each logical element
+//'
+//' @param xs A logical vector to count populations
+//' @param threads The number of threads or 0 for all cores
+//' @return 1 for TRUE, 0 for FALSE and NA for NA
+// [[Rcpp::export]]
+extern Rcpp::IntegerVector popcount_cpp_logical(const Rcpp::LogicalVector &xs,
+                                                int threads = 1);
+
+//' Count 1's in each double element truncated to an integer
+//'
+//' @param xs A double vector to count populations
+//' @param threads The number of threads or 0 for all cores
+//' @return The populations of elements in the vector and NAs for elements
+//'   which as.integer() converts to NAs
+// [[Rcpp::export]]
+extern Rcpp::IntegerVector popcount_cpp_double(const Rcpp::NumericVector &xs,
+                                               int threads = 1);
+
+//' Count 1's in each integer64 element
+//'
+//' @param xs An integer64 vector of bit64 which stores int64 in doubles
+//' @param threads The number of threads or 0 for all cores
 //' @return The populations of elements in the vector
 // [[Rcpp::export]]
-extern Rcpp::IntegerVector popcount_cpp_integer(const Rcpp::IntegerVector &xs);
+extern Rcpp::IntegerVector
+popcount_cpp_integer64(const Rcpp::NumericVector &xs, int threads = 1);
+
+//' Count 1's in each raw element into a raw vector
+//'
+//' @param xs A raw vector to count populations
+//' @param threads The number of threads or 0 for all cores
+//' @return The populations of elements in the vector as raw elements
+// [[Rcpp::export]]
+extern Rcpp::RawVector popcount_compact_cpp_raw(const Rcpp::RawVector &xs,
+                                                int threads = 1);
+
+//' Count 1's in all raw elements
+//'
+//' @param xs A raw vector to count populations
+//' @param threads The number of threads or 0 for all cores
+//' @return The total population of the vector
+// [[Rcpp::export]]
+extern double popcount_total_cpp_raw(const Rcpp::RawVector &xs,
+                                     int threads = 1);
+
+//' Count 1's in all integer elements
+//'
+//' @param xs An integer vector to count populations
+//' @param na_rm Skip NAs if true, return NA if false and xs has NAs
+//' @param threads The number of threads or 0 for all cores
+//' @return The total population of the vector
+// [[Rcpp::export]]
+extern double popcount_total_cpp_integer(const Rcpp::IntegerVector &xs,
+                                         bool na_rm, int threads = 1);
+
+//' Count TRUEs in all logical elements
+//'
+//' @param xs A logical vector to count populations
+//' @param na_rm Skip NAs if true, return NA if false and xs has NAs
+//' @param threads The number of threads or 0 for all cores
+//' @return The total population of the vector
+// [[Rcpp::export]]
+extern double popcount_total_cpp_logical(const Rcpp::LogicalVector &xs,
+                                         bool na_rm, int threads = 1);
+
+//' Count 1's in all integer64 elements
+//'
+//' @param xs An integer64 vector of bit64 which stores int64 in doubles
+//' @param na_rm Skip NAs if true, return NA if false and xs has NAs
+//' @param threads The number of threads or 0 for all cores
+//' @return The total population of the vector
+// [[Rcpp::export]]
+extern double popcount_total_cpp_integer64(const Rcpp::NumericVector &xs,
+                                           bool na_rm, int threads = 1);
+
+// Rcpp vectors share the SEXP of out and write to it in place
+//' Count 1's in each raw element and write them into out
+//'
+//' @param xs A raw vector to count populations
+//' @param out An integer vector as long as xs
+//' @param threads The number of threads or 0 for all cores
+// [[Rcpp::export]]
+extern void popcount_into_cpp_raw(const Rcpp::RawVector &xs,
+                                  Rcpp::IntegerVector out, int threads = 1);
+
+//' Count 1's in each integer element and write them into out
+//'
+//' @param xs An integer vector to count populations
+//' @param out An integer vector as long as xs
+//' @param threads The number of threads or 0 for all cores
+// [[Rcpp::export]]
+extern void popcount_into_cpp_integer(const Rcpp::IntegerVector &xs,
+                                      Rcpp::IntegerVector out,
+                                      int threads = 1);
+
+// One call counts all vectors and amortizes its overhead
+//' Count 1's in each element of vectors in a list
+//'
+//' @param xs_list A list of raw, integer, logical, double or integer64
+//'   vectors
+//' @param concatenate Return counts of all vectors in one vector if true
+//' @param threads The number of threads or 0 for all cores
+//' @return A list of the populations of elements in each vector, or a list
+//'   of counts and 0-based offsets of each vector in counts if concatenate
+// [[Rcpp::export]]
+extern Rcpp::List popcount_many_cpp(const Rcpp::List &xs_list,
+                                    bool concatenate, int threads = 1);
+
+//' Count 1's in each element on one thread under hardware performance
+//' counters
+//'
+//' @param xs A raw, integer, logical, double or integer64 vector
+//' @param times The number of times to count xs
+//' @return A named double vector of bytes, seconds, counts of events and
+//'   cycles per byte and IPC which are NA if the host does not count them
+// [[Rcpp::export]]
+extern Rcpp::NumericVector popcount_profile_cpp(SEXP xs, int times = 1);
+
+// ALTREP vectors count elements when R reads them
+//' Count 1's in each element lazily
+//'
+//' @param xs A raw, integer, logical or integer64 vector to count
+//'   populations
+//' @param threads The number of threads or 0 for all cores
+//' @return An integer vector which counts populations of regions on access
+//'   and sums them without making a vector of populations
+// [[Rcpp::export]]
+extern SEXP popcount_lazy_cpp(SEXP xs, int threads = 1);
+
+//' Register the ALTREP class of lazy populations
+//'
+//' @param dll The package
+// [[Rcpp::init]]
+extern void init_popcount_lazy_class(DllInfo *dll);
+
+// Pass bitvectors as external pointers which R finalizes
+//' Build a rank/select index of packed bits
+//'
+//' @param bits A raw vector which holds bits in the order of packBits()
+//' @param size The number of bits
+//' @return An external pointer to the index
+// [[Rcpp::export]]
+extern SEXP rank_select_bitvector_cpp(const Rcpp::RawVector &bits,
+                                      double size);
+
+//' Count 1's in an index of bits
+//'
+//' @param bitvector An index which rank_select_bitvector_cpp returns
+//' @return The number of 1's
+// [[Rcpp::export]]
+extern double rank_select_count_cpp(SEXP bitvector);
+
+//' Count 1's before positions
+//'
+//' @param bitvector An index which rank_select_bitvector_cpp returns
+//' @param indexes 0-based positions up to the number of bits
+//' @return The number of 1's before each position
+// [[Rcpp::export]]
+extern Rcpp::NumericVector
+rank_select_rank_cpp(SEXP bitvector, const Rcpp::NumericVector &indexes);
+
+//' Find positions of 1's
+//'
+//' @param bitvector An index which rank_select_bitvector_cpp returns
+//' @param nths 0-based ordinals of 1's
+//' @return The 0-based position of each nth 1
+// [[Rcpp::export]]
+extern Rcpp::NumericVector
+rank_select_select_cpp(SEXP bitvector, const Rcpp::NumericVector &nths);
+
+//' Get metrics of calls which count 1's
+//'
+//' @return A list of the numbers of calls, bytes and copied inputs, time
+//'   of calls which read 64 KiB or more, calls of each kernel variant and
+//'   a log2 histogram of latencies in nanoseconds
+// [[Rcpp::export]]
+extern Rcpp::List stats_cpp();
 #endif // UNIT_TEST_CPP
 
+//' Get the SIMD kernel variant
+//'
+//' @return The name of the kernel variant which popcount runs
+// [[Rcpp::export]]
+extern std::string get_kernel_variant_cpp();
+
+//' Set the SIMD kernel variant
+//'
+//' @param name The name of a kernel variant or "auto" for the best one
+// [[Rcpp::export]]
+extern void set_kernel_variant_cpp(const std::string &name);
+
+//' List SIMD kernel variants
+//'
+//' @return The names of kernel variants which the running CPU supports
+// [[Rcpp::export]]
+extern std::vector<std::string> supported_kernel_variants_cpp();
+
+//' Clear metrics of calls in all threads
+// [[Rcpp::export]]
+extern void reset_stats_cpp();
+
+//' Count an input which R copied to convert its type
+// [[Rcpp::export]]
+extern void record_stats_copy_cpp();
+
 #endif // SRC_POPCOUNT_H
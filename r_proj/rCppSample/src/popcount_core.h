@@ -0,0 +1,754 @@
+#ifndef POPCOUNT_CORE_H
+#define POPCOUNT_CORE_H
+
+/*
+ Header-only popcount kernels on pointers and lengths which do not depend
+ on pybind11, Boost.Python, Rcpp or R headers. The Python and R packages
+ build their bindings on this header and have their own copies of it:
+
+ python_proj/py_cpp_sample/src/cpp_impl/popcount_core.h (master)
+ r_proj/rCppSample/src/popcount_core.h
+
+ Edit the master and copy it to the R package. The C++ tests of the R
+ package check that they are identical.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POPCOUNT_CORE_X86
+#include <immintrin.h>
+#endif
+
+#ifndef __GNUC__
+#error Use alternatives of __attribute__((target)) and __builtin_popcountll
+#endif
+
+/**
+ Binding-agnostic popcount kernels
+ */
+namespace popcount_core {
+/**
+ Instruction sets which popcount kernels are built for
+ */
+enum class KernelVariant : int {
+    Scalar, ///< Portable code without the popcnt instruction
+    Popcnt, ///< SSE4.2 POPCNT
+    Avx2,   ///< AVX2 nibble look-up tables
+    Avx512, ///< AVX-512 VPOPCNTDQ and BITALG
+};
+
+/// The number of kernel variants
+constexpr size_t Number_Of_Variants =
+    static_cast<size_t>(KernelVariant::Avx512) + 1;
+
+/// Names of kernel variants in the order of KernelVariant
+constexpr std::array<const char *, Number_Of_Variants> Kernel_Variant_Names{
+    {"scalar", "popcnt", "avx2", "avx512"}};
+
+/// The name which selects the best variant
+constexpr const char *Kernel_Variant_Auto = "auto";
+
+/**
+ * @param[in] variant A kernel variant
+ * @return Whether the running CPU can execute the variant
+ */
+inline bool is_kernel_variant_supported(KernelVariant variant) {
+#ifdef POPCOUNT_CORE_X86
+    __builtin_cpu_init();
+    switch (variant) {
+    case KernelVariant::Scalar:
+        return true;
+    case KernelVariant::Popcnt:
+        return __builtin_cpu_supports("popcnt");
+    case KernelVariant::Avx2:
+        return __builtin_cpu_supports("popcnt") &&
+               __builtin_cpu_supports("avx2");
+    case KernelVariant::Avx512:
+        return __builtin_cpu_supports("popcnt") &&
+               __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512vpopcntdq") &&
+               __builtin_cpu_supports("avx512bitalg");
+    }
+    return false;
+#else  // POPCOUNT_CORE_X86
+    return variant == KernelVariant::Scalar;
+#endif // POPCOUNT_CORE_X86
+}
+
+/**
+ * @return The best variant which the running CPU supports
+ */
+inline KernelVariant detect_kernel_variant() {
+    for (auto index = Number_Of_Variants; index > 0; --index) {
+        const auto variant = static_cast<KernelVariant>(index - 1);
+        if (is_kernel_variant_supported(variant)) {
+            return variant;
+        }
+    }
+    return KernelVariant::Scalar;
+}
+
+/**
+ * @param[in] variant A kernel variant
+ * @return The name of the variant
+ */
+inline std::string kernel_variant_name(KernelVariant variant) {
+    return Kernel_Variant_Names.at(static_cast<size_t>(variant));
+}
+
+/**
+ * @param[in] name The name of a variant or "auto" for the best one
+ * @return The variant
+ * @throw std::invalid_argument if the name is unknown
+ */
+inline KernelVariant parse_kernel_variant(const std::string &name) {
+    if (name == Kernel_Variant_Auto) {
+        return detect_kernel_variant();
+    }
+
+    for (size_t index{0}; index < Number_Of_Variants; ++index) {
+        if (name == Kernel_Variant_Names.at(index)) {
+            return static_cast<KernelVariant>(index);
+        }
+    }
+    throw std::invalid_argument("Unknown kernel variant " + name);
+}
+
+/**
+ * @return The names of variants which the running CPU supports
+ */
+inline std::vector<std::string> supported_kernel_variants() {
+    std::vector<std::string> names;
+    for (size_t index{0}; index < Number_Of_Variants; ++index) {
+        const auto variant = static_cast<KernelVariant>(index);
+        if (is_kernel_variant_supported(variant)) {
+            names.push_back(kernel_variant_name(variant));
+        }
+    }
+    return names;
+}
+
+/**
+ * @param[in] env_name An environment variable which names a variant
+ * @return The variant in the variable if the running CPU supports it or
+ *         the best one
+ */
+inline KernelVariant initial_kernel_variant(const char *env_name) {
+    const char *name = std::getenv(env_name);
+    if (name) {
+        try {
+            const auto variant = parse_kernel_variant(name);
+            if (is_kernel_variant_supported(variant)) {
+                return variant;
+            }
+        } catch (const std::invalid_argument &) {
+            // Ignore unknown names and use the best one
+        }
+    }
+    return detect_kernel_variant();
+}
+
+/**
+ Selects kernels of a variant at run time. Each package defines KernelSet
+ with its own kernels and a table of the sets of all variants. Sets of
+ variants which the target does not build are left empty because they
+ are never selected.
+ @tparam KernelSet A struct of pointers to kernels of a variant
+ */
+template <typename KernelSet> class KernelDispatch {
+  public:
+    /// Kernel sets in the order of KernelVariant
+    using Table = std::array<KernelSet, Number_Of_Variants>;
+
+    /**
+     * @param[in] table Kernel sets which outlive the dispatch
+     * @param[in] env_name An environment variable which forces a variant
+     */
+    KernelDispatch(const Table &table, const char *env_name)
+        : table_(table), variant_(initial_kernel_variant(env_name)) {}
+
+    /**
+     * @return The selected variant
+     */
+    KernelVariant variant() const {
+        return variant_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @param[in] variant A variant to select
+     * @throw std::invalid_argument if the running CPU does not support it
+     */
+    void set_variant(KernelVariant variant) {
+        if (!is_kernel_variant_supported(variant)) {
+            throw std::invalid_argument("Unsupported kernel variant " +
+                                        kernel_variant_name(variant));
+        }
+        variant_.store(variant, std::memory_order_relaxed);
+    }
+
+    /**
+     * @return Kernels of the selected variant
+     */
+    const KernelSet &current() const {
+        return table_.at(static_cast<size_t>(variant()));
+    }
+
+  private:
+    const Table &table_;
+    std::atomic<KernelVariant> variant_;
+};
+
+// Reads a possibly unaligned word
+inline uint64_t load_word(const uint8_t *src) {
+    uint64_t word;
+    std::memcpy(&word, src, sizeof(word));
+    return word;
+}
+
+// Reads a possibly unaligned element
+template <typename SourceType>
+inline SourceType load_element(const uint8_t *src) {
+    SourceType element;
+    std::memcpy(&element, src, sizeof(element));
+    return element;
+}
+
+/**
+ * Carry-save adder
+ * @param[out] high Carries of a + b + c
+ * @param[out] low Sums of a + b + c
+ */
+template <typename T>
+inline void carry_save_add(T &high, T &low, T a, T b, T c) {
+    const T u = a ^ b;
+    high = (a & b) | (u & c);
+    low = u ^ c;
+}
+
+// Counts 1's with SWAR arithmetic
+inline uint64_t popcount_word_swar(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (x * 0x0101010101010101ull) >> 56;
+}
+
+/**
+ * Harley-Seal popcount over 16 words per iteration
+ * @param[in] src A pointer to bytes at any alignment
+ * @param[in] size The number of bytes in src
+ * @return The number of 1's in src
+ */
+inline uint64_t popcount_total_scalar(const uint8_t *src, size_t size) {
+    constexpr size_t word_size = sizeof(uint64_t);
+    constexpr size_t block_size = word_size * 16;
+    uint64_t total{0};
+    uint64_t ones{0};
+    uint64_t twos{0};
+    uint64_t fours{0};
+    uint64_t eights{0};
+    uint64_t twos_a, twos_b, fours_a, fours_b, eights_a, eights_b, sixteens;
+
+    size_t i{0};
+    for (; (i + block_size) <= size; i += block_size) {
+        const uint8_t *p = src + i;
+        carry_save_add(twos_a, ones, ones, load_word(p), load_word(p + 8));
+        carry_save_add(twos_b, ones, ones, load_word(p + 16),
+                       load_word(p + 24));
+        carry_save_add(fours_a, twos, twos, twos_a, twos_b);
+        carry_save_add(twos_a, ones, ones, load_word(p + 32),
+                       load_word(p + 40));
+        carry_save_add(twos_b, ones, ones, load_word(p + 48),
+                       load_word(p + 56));
+        carry_save_add(fours_b, twos, twos, twos_a, twos_b);
+        carry_save_add(eights_a, fours, fours, fours_a, fours_b);
+        carry_save_add(twos_a, ones, ones, load_word(p + 64),
+                       load_word(p + 72));
+        carry_save_add(twos_b, ones, ones, load_word(p + 80),
+                       load_word(p + 88));
+        carry_save_add(fours_a, twos, twos, twos_a, twos_b);
+        carry_save_add(twos_a, ones, ones, load_word(p + 96),
+                       load_word(p + 104));
+        carry_save_add(twos_b, ones, ones, load_word(p + 112),
+                       load_word(p + 120));
+        carry_save_add(fours_b, twos, twos, twos_a, twos_b);
+        carry_save_add(eights_b, fours, fours, fours_a, fours_b);
+        carry_save_add(sixteens, eights, eights, eights_a, eights_b);
+        total += popcount_word_swar(sixteens);
+    }
+
+    total = 16 * total + 8 * popcount_word_swar(eights) +
+            4 * popcount_word_swar(fours) + 2 * popcount_word_swar(twos) +
+            popcount_word_swar(ones);
+    for (; (i + word_size) <= size; i += word_size) {
+        total += popcount_word_swar(load_word(src + i));
+    }
+    for (; i < size; ++i) {
+        total += popcount_word_swar(src[i]);
+    }
+    return total;
+}
+
+/**
+ * Counts 1's of xs & ys word by word
+ * @param[in] xs A pointer to bytes at any alignment
+ * @param[in] ys A pointer to bytes at any alignment
+ * @param[in] size The number of bytes in xs and ys
+ * @return The number of 1's in xs & ys
+ */
+inline uint64_t popcount_and_scalar(const uint8_t *xs, const uint8_t *ys,
+                                    size_t size) {
+    constexpr size_t word_size = sizeof(uint64_t);
+    uint64_t total{0};
+    size_t i{0};
+    for (; (i + word_size) <= size; i += word_size) {
+        total += popcount_word_swar(load_word(xs + i) & load_word(ys + i));
+    }
+    for (; i < size; ++i) {
+        total += popcount_word_swar(static_cast<uint64_t>(xs[i] & ys[i]));
+    }
+    return total;
+}
+
+/**
+ * Counts 1's of each element. Signed integers are sign-extended to 64 bits
+ * as conversion to uint64_t does. Compiles to a libgcc call unless
+ * -mpopcnt is given.
+ * @tparam SourceType An integer type
+ * @tparam CountType The type of counts which the bindings return
+ * @param[in] src A pointer to elements
+ * @param[in] size The number of elements in src
+ * @param[out] dst A pointer to write the counts of src
+ */
+template <typename SourceType, typename CountType>
+void popcount_elements_scalar(const SourceType *src, size_t size,
+                              CountType *dst) {
+    for (size_t i{0}; i < size; ++i) {
+        dst[i] = static_cast<CountType>(__builtin_popcountll(src[i]));
+    }
+}
+
+#ifdef POPCOUNT_CORE_X86
+// Independent accumulators hide latency of the popcnt instruction
+__attribute__((target("popcnt"))) inline uint64_t
+popcount_total_popcnt(const uint8_t *src, size_t size) {
+    constexpr size_t word_size = sizeof(uint64_t);
+    constexpr size_t block_size = word_size * 4;
+    uint64_t totals[4]{0, 0, 0, 0};
+
+    size_t i{0};
+    for (; (i + block_size) <= size; i += block_size) {
+        totals[0] +=
+            static_cast<uint64_t>(__builtin_popcountll(load_word(src + i)));
+        totals[1] += static_cast<uint64_t>(
+            __builtin_popcountll(load_word(src + i + word_size)));
+        totals[2] += static_cast<uint64_t>(
+            __builtin_popcountll(load_word(src + i + word_size * 2)));
+        totals[3] += static_cast<uint64_t>(
+            __builtin_popcountll(load_word(src + i + word_size * 3)));
+    }
+
+    uint64_t total = totals[0] + totals[1] + totals[2] + totals[3];
+    for (; (i + word_size) <= size; i += word_size) {
+        total +=
+            static_cast<uint64_t>(__builtin_popcountll(load_word(src + i)));
+    }
+    for (; i < size; ++i) {
+        total += static_cast<uint64_t>(__builtin_popcount(src[i]));
+    }
+    return total;
+}
+
+__attribute__((target("popcnt"))) inline uint64_t
+popcount_and_popcnt(const uint8_t *xs, const uint8_t *ys, size_t size) {
+    constexpr size_t word_size = sizeof(uint64_t);
+    constexpr size_t block_size = word_size * 4;
+    uint64_t totals[4]{0, 0, 0, 0};
+
+    size_t i{0};
+    for (; (i + block_size) <= size; i += block_size) {
+        for (size_t lane{0}; lane < 4; ++lane) {
+            const auto offset = i + word_size * lane;
+            totals[lane] += static_cast<uint64_t>(__builtin_popcountll(
+                load_word(xs + offset) & load_word(ys + offset)));
+        }
+    }
+
+    uint64_t total = totals[0] + totals[1] + totals[2] + totals[3];
+    for (; (i + word_size) <= size; i += word_size) {
+        total += static_cast<uint64_t>(
+            __builtin_popcountll(load_word(xs + i) & load_word(ys + i)));
+    }
+    for (; i < size; ++i) {
+        total += static_cast<uint64_t>(__builtin_popcount(xs[i] & ys[i]));
+    }
+    return total;
+}
+
+// The same as popcount_elements_scalar() with the popcnt instruction
+template <typename SourceType, typename CountType>
+__attribute__((target("popcnt"))) void
+popcount_elements_popcnt(const SourceType *src, size_t size, CountType *dst) {
+    for (size_t i{0}; i < size; ++i) {
+        dst[i] = static_cast<CountType>(__builtin_popcountll(src[i]));
+    }
+}
+
+/**
+ * @param[in] bytes 32 bytes
+ * @return The number of 1's of each byte in bytes
+ */
+__attribute__((target("avx2"))) inline __m256i
+popcount_bytes_avx2(__m256i bytes) {
+    const __m256i lookup =
+        _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+                         1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i low = _mm256_and_si256(bytes, low_mask);
+    const __m256i high =
+        _mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_mask);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low),
+                           _mm256_shuffle_epi8(lookup, high));
+}
+
+/**
+ * Carry-save adder on 256-bit registers
+ * @param[out] high Carries of a + b + c
+ * @param[out] low Sums of a + b + c
+ */
+__attribute__((target("avx2"))) inline void
+carry_save_add_avx2(__m256i &high, __m256i &low, __m256i a, __m256i b,
+                    __m256i c) {
+    const __m256i u = _mm256_xor_si256(a, b);
+    high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+    low = _mm256_xor_si256(u, c);
+}
+
+// Returns 4 partial sums in 64-bit lanes
+__attribute__((target("avx2"))) inline __m256i
+popcount_lanes_avx2(__m256i v) {
+    return _mm256_sad_epu8(popcount_bytes_avx2(v), _mm256_setzero_si256());
+}
+
+// Harley-Seal popcount over 16 registers per iteration
+__attribute__((target("avx2,popcnt"))) inline uint64_t
+popcount_total_avx2(const uint8_t *src, size_t size) {
+    constexpr size_t block_size = sizeof(__m256i) * 16;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256();
+    __m256i twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256();
+    __m256i eights = _mm256_setzero_si256();
+    __m256i twos_a, twos_b, fours_a, fours_b, eights_a, eights_b, sixteens;
+
+    size_t i{0};
+    for (; (i + block_size) <= size; i += block_size) {
+        const auto *p = reinterpret_cast<const __m256i *>(src + i);
+        carry_save_add_avx2(twos_a, ones, ones, _mm256_loadu_si256(p),
+                            _mm256_loadu_si256(p + 1));
+        carry_save_add_avx2(twos_b, ones, ones, _mm256_loadu_si256(p + 2),
+                            _mm256_loadu_si256(p + 3));
+        carry_save_add_avx2(fours_a, twos, twos, twos_a, twos_b);
+        carry_save_add_avx2(twos_a, ones, ones, _mm256_loadu_si256(p + 4),
+                            _mm256_loadu_si256(p + 5));
+        carry_save_add_avx2(twos_b, ones, ones, _mm256_loadu_si256(p + 6),
+                            _mm256_loadu_si256(p + 7));
+        carry_save_add_avx2(fours_b, twos, twos, twos_a, twos_b);
+        carry_save_add_avx2(eights_a, fours, fours, fours_a, fours_b);
+        carry_save_add_avx2(twos_a, ones, ones, _mm256_loadu_si256(p + 8),
+                            _mm256_loadu_si256(p + 9));
+        carry_save_add_avx2(twos_b, ones, ones, _mm256_loadu_si256(p + 10),
+                            _mm256_loadu_si256(p + 11));
+        carry_save_add_avx2(fours_a, twos, twos, twos_a, twos_b);
+        carry_save_add_avx2(twos_a, ones, ones, _mm256_loadu_si256(p + 12),
+                            _mm256_loadu_si256(p + 13));
+        carry_save_add_avx2(twos_b, ones, ones, _mm256_loadu_si256(p + 14),
+                            _mm256_loadu_si256(p + 15));
+        carry_save_add_avx2(fours_b, twos, twos, twos_a, twos_b);
+        carry_save_add_avx2(eights_b, fours, fours, fours_a, fours_b);
+        carry_save_add_avx2(sixteens, eights, eights, eights_a, eights_b);
+        total = _mm256_add_epi64(total, popcount_lanes_avx2(sixteens));
+    }
+
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(
+        total, _mm256_slli_epi64(popcount_lanes_avx2(eights), 3));
+    total = _mm256_add_epi64(
+        total, _mm256_slli_epi64(popcount_lanes_avx2(fours), 2));
+    total = _mm256_add_epi64(
+        total, _mm256_slli_epi64(popcount_lanes_avx2(twos), 1));
+    total = _mm256_add_epi64(total, popcount_lanes_avx2(ones));
+
+    alignas(sizeof(__m256i)) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           popcount_total_popcnt(src + i, size - i);
+}
+
+// Codes are too short to run Harley-Seal
+__attribute__((target("avx2,popcnt"))) inline uint64_t
+popcount_and_avx2(const uint8_t *xs, const uint8_t *ys, size_t size) {
+    constexpr size_t width = sizeof(__m256i);
+    __m256i total = _mm256_setzero_si256();
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m256i both = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xs + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ys + i)));
+        total = _mm256_add_epi64(total, popcount_lanes_avx2(both));
+    }
+
+    alignas(sizeof(__m256i)) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), total);
+    // Avoid AVX-SSE transition penalties in callers comparing short rows
+    _mm256_zeroupper();
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           popcount_and_popcnt(xs + i, ys + i, size - i);
+}
+
+// Stores 32 counts of bytes as they are
+__attribute__((target("avx2"))) inline void store_counts_avx2(uint8_t *dst,
+                                                              __m256i counts) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), counts);
+}
+
+// Widens 32 counts of bytes to 32-bit integers
+__attribute__((target("avx2"))) inline void store_counts_avx2(int32_t *dst,
+                                                              __m256i counts) {
+    const __m128i low = _mm256_castsi256_si128(counts);
+    const __m128i high = _mm256_extracti128_si256(counts, 1);
+    auto *p = reinterpret_cast<__m256i *>(dst);
+    _mm256_storeu_si256(p, _mm256_cvtepu8_epi32(low));
+    _mm256_storeu_si256(p + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+    _mm256_storeu_si256(p + 2, _mm256_cvtepu8_epi32(high));
+    _mm256_storeu_si256(p + 3, _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+}
+
+/**
+ * Counts 1's of each byte with nibble look-up tables
+ * @tparam CountType uint8_t or int32_t
+ * @param[in] src A pointer to bytes
+ * @param[in] size The number of bytes in src
+ * @param[out] dst A pointer to write the counts of src
+ */
+template <typename CountType>
+__attribute__((target("avx2,popcnt"))) void
+popcount_uint8_avx2(const uint8_t *src, size_t size, CountType *dst) {
+    constexpr size_t width = sizeof(__m256i);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m256i xs =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        store_counts_avx2(dst + i, popcount_bytes_avx2(xs));
+    }
+    popcount_elements_popcnt(src + i, size - i, dst + i);
+}
+
+/**
+ * Counts 1's of each word with nibble look-up tables
+ * @param[in] src A pointer to words
+ * @param[in] size The number of words in src
+ * @param[out] dst A pointer to write the counts of src
+ */
+__attribute__((target("avx2,popcnt"))) inline void
+popcount_uint64_avx2(const uint64_t *src, size_t size, uint8_t *dst) {
+    // Four 256-bit registers make 16 counts
+    constexpr size_t width = sizeof(__m256i) / sizeof(uint64_t) * 4;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m128i order = _mm_setr_epi8(0, 2, 8, 10, 1, 3, 9, 11, 4, 6, 12, 14,
+                                        5, 7, 13, 15);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const auto *p = reinterpret_cast<const __m256i *>(src + i);
+        // Sum bytes in each 64-bit lane and each sum is less than 256
+        const __m256i s0 =
+            _mm256_sad_epu8(popcount_bytes_avx2(_mm256_loadu_si256(p)), zero);
+        const __m256i s1 = _mm256_sad_epu8(
+            popcount_bytes_avx2(_mm256_loadu_si256(p + 1)), zero);
+        const __m256i s2 = _mm256_sad_epu8(
+            popcount_bytes_avx2(_mm256_loadu_si256(p + 2)), zero);
+        const __m256i s3 = _mm256_sad_epu8(
+            popcount_bytes_avx2(_mm256_loadu_si256(p + 3)), zero);
+        // Narrow 64-bit lanes to bytes and restore the order of elements
+        const __m256i s01 = _mm256_or_si256(s0, _mm256_slli_epi64(s1, 32));
+        const __m256i s23 = _mm256_or_si256(s2, _mm256_slli_epi64(s3, 32));
+        const __m256i words = _mm256_packus_epi32(s01, s23);
+        const __m256i bytes = _mm256_packus_epi16(words, zero);
+        const __m256i low = _mm256_permute4x64_epi64(bytes, 0x08);
+        const __m128i counts =
+            _mm_shuffle_epi8(_mm256_castsi256_si128(low), order);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), counts);
+    }
+    popcount_elements_popcnt(src + i, size - i, dst + i);
+}
+
+#define POPCOUNT_CORE_TARGET_AVX512                                            \
+    __attribute__((                                                            \
+        target("avx512f,avx512bw,avx512vpopcntdq,avx512bitalg,popcnt")))
+
+POPCOUNT_CORE_TARGET_AVX512 inline uint64_t
+popcount_total_avx512(const uint8_t *src, size_t size) {
+    constexpr size_t width = sizeof(__m512i);
+    // Two accumulators hide latency of VPOPCNTQ
+    __m512i total_a = _mm512_setzero_si512();
+    __m512i total_b = _mm512_setzero_si512();
+    size_t i{0};
+    for (; (i + width * 2) <= size; i += width * 2) {
+        total_a = _mm512_add_epi64(
+            total_a, _mm512_popcnt_epi64(_mm512_loadu_si512(src + i)));
+        total_b = _mm512_add_epi64(
+            total_b, _mm512_popcnt_epi64(_mm512_loadu_si512(src + i + width)));
+    }
+    for (; (i + width) <= size; i += width) {
+        total_a = _mm512_add_epi64(
+            total_a, _mm512_popcnt_epi64(_mm512_loadu_si512(src + i)));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask64>((1ull << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi8(mask, src + i);
+        total_b = _mm512_add_epi64(total_b, _mm512_popcnt_epi64(xs));
+    }
+
+    alignas(sizeof(__m512i)) uint64_t lanes[8];
+    _mm512_store_si512(lanes, _mm512_add_epi64(total_a, total_b));
+    uint64_t total{0};
+    for (const auto lane : lanes) {
+        total += lane;
+    }
+    return total;
+}
+
+POPCOUNT_CORE_TARGET_AVX512 inline uint64_t
+popcount_and_avx512(const uint8_t *xs, const uint8_t *ys, size_t size) {
+    constexpr size_t width = sizeof(__m512i);
+    __m512i total = _mm512_setzero_si512();
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i both = _mm512_and_si512(_mm512_loadu_si512(xs + i),
+                                              _mm512_loadu_si512(ys + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(both));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask64>((1ull << (size - i)) - 1);
+        const __m512i both =
+            _mm512_and_si512(_mm512_maskz_loadu_epi8(mask, xs + i),
+                             _mm512_maskz_loadu_epi8(mask, ys + i));
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(both));
+    }
+
+    alignas(sizeof(__m512i)) uint64_t lanes[8];
+    _mm512_store_si512(lanes, total);
+    uint64_t sum{0};
+    for (const auto lane : lanes) {
+        sum += lane;
+    }
+    return sum;
+}
+
+// Stores counts of bytes which a mask selects as they are
+POPCOUNT_CORE_TARGET_AVX512 inline void
+store_counts_avx512(uint8_t *dst, __m512i counts, __mmask64 mask) {
+    _mm512_mask_storeu_epi8(dst, mask, counts);
+}
+
+// Widens counts of bytes which a mask selects to 32-bit integers.
+// Masked intrinsics avoid undefined registers which GCC warns about.
+POPCOUNT_CORE_TARGET_AVX512 inline void
+store_counts_avx512(int32_t *dst, __m512i counts, __mmask64 mask) {
+    const __m128i quarters[4]{_mm512_maskz_extracti32x4_epi32(0xf, counts, 0),
+                              _mm512_maskz_extracti32x4_epi32(0xf, counts, 1),
+                              _mm512_maskz_extracti32x4_epi32(0xf, counts, 2),
+                              _mm512_maskz_extracti32x4_epi32(0xf, counts, 3)};
+    for (size_t quarter{0}; quarter < 4; ++quarter) {
+        _mm512_mask_storeu_epi32(
+            dst + quarter * 16, static_cast<__mmask16>(mask >> (quarter * 16)),
+            _mm512_maskz_cvtepu8_epi32(0xffff, quarters[quarter]));
+    }
+}
+
+/**
+ * Counts 1's of 64 bytes at once with BITALG and masks tails
+ * @tparam CountType uint8_t or int32_t
+ * @param[in] src A pointer to bytes
+ * @param[in] size The number of bytes in src
+ * @param[out] dst A pointer to write the counts of src
+ */
+template <typename CountType>
+POPCOUNT_CORE_TARGET_AVX512 void
+popcount_uint8_avx512(const uint8_t *src, size_t size, CountType *dst) {
+    constexpr size_t width = sizeof(__m512i);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        store_counts_avx512(dst + i, _mm512_popcnt_epi8(xs), ~__mmask64{0});
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask64>((1ull << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi8(mask, src + i);
+        store_counts_avx512(dst + i, _mm512_popcnt_epi8(xs), mask);
+    }
+}
+
+/**
+ * Counts 1's of each word with VPOPCNTQ
+ * @param[in] src A pointer to words
+ * @param[in] size The number of words in src
+ * @param[out] dst A pointer to write the counts of src
+ */
+POPCOUNT_CORE_TARGET_AVX512 inline void
+popcount_uint64_avx512(const uint64_t *src, size_t size, uint8_t *dst) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(uint64_t);
+    size_t i{0};
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        _mm512_mask_cvtepi64_storeu_epi8(dst + i, 0xff,
+                                         _mm512_popcnt_epi64(xs));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask8>((1u << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi64(mask, src + i);
+        _mm512_mask_cvtepi64_storeu_epi8(dst + i, mask,
+                                         _mm512_popcnt_epi64(xs));
+    }
+}
+#undef POPCOUNT_CORE_TARGET_AVX512
+#endif // POPCOUNT_CORE_X86
+
+/// Counts 1's of each word into a byte
+using WordKernel = void (*)(const uint64_t *, size_t, uint8_t *);
+
+/**
+ * @param[in] variant A kernel variant which the running CPU supports
+ * @return The kernel of the variant which counts 1's of words
+ */
+inline WordKernel popcount_uint64_kernel(KernelVariant variant) {
+    switch (variant) {
+#ifdef POPCOUNT_CORE_X86
+    case KernelVariant::Popcnt:
+        return popcount_elements_popcnt<uint64_t, uint8_t>;
+    case KernelVariant::Avx2:
+        return popcount_uint64_avx2;
+    case KernelVariant::Avx512:
+        return popcount_uint64_avx512;
+#endif // POPCOUNT_CORE_X86
+    default:
+        return popcount_elements_scalar<uint64_t, uint8_t>;
+    }
+}
+} // namespace popcount_core
+
+#endif // POPCOUNT_CORE_H
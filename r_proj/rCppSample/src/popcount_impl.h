@@ -2,6 +2,7 @@
 #define SRC_POPCOUNT_IMPL_H
 
 #include "popcount.h"
+#include "popcount_kernel.h"
 #include <type_traits>
 
 namespace {
@@ -31,6 +32,34 @@ inline int get_na_int_value() {
     return NA_INTEGER;
 }
 #endif // UNIT_TEST_CPP
+
+// Allocate vectors which kernels overwrite without filling them
+#ifdef UNIT_TEST_CPP
+template <typename T, typename U> inline T make_uninitialized_vector(U size) {
+    return T(size);
+}
+#else  // UNIT_TEST_CPP
+template <typename T, typename U> inline T make_uninitialized_vector(U size) {
+    return T(Rcpp::no_init(size));
+}
+#endif // UNIT_TEST_CPP
+
+// Pass vectors to kernels as pointers
+#ifdef UNIT_TEST_CPP
+template <typename T> inline auto get_data_pointer(T &xs) {
+    return xs.data();
+}
+#else  // UNIT_TEST_CPP
+// Iterators of Rcpp vectors are pointers
+template <typename T> inline auto get_data_pointer(T &xs) {
+    return xs.begin();
+}
+#endif // UNIT_TEST_CPP
+
+// bit64 stores int64 in the bits of doubles
+template <typename T> inline auto get_integer64_pointer(T &xs) {
+    return reinterpret_cast<const int64_t *>(get_data_pointer(xs));
+}
 } // namespace
 
 #endif // SRC_POPCOUNT_IMPL_H
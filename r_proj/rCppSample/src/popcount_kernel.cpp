@@ -0,0 +1,512 @@
+#include "popcount_kernel.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POPCOUNT_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#ifndef __GNUC__
+#error Use alternatives of __attribute__((target)) and __builtin_popcount
+#endif
+
+namespace rCppSample {
+namespace {
+using popcount_core::KernelDispatch;
+using popcount_core::popcount_elements_scalar;
+using popcount_core::popcount_total_scalar;
+using popcount_core::ThreadPool;
+#ifdef POPCOUNT_KERNEL_X86
+using popcount_core::popcount_bytes_avx2;
+using popcount_core::popcount_elements_popcnt;
+using popcount_core::popcount_total_avx2;
+using popcount_core::popcount_total_avx512;
+using popcount_core::popcount_total_popcnt;
+using popcount_core::popcount_uint8_avx2;
+using popcount_core::popcount_uint8_avx512;
+#endif // POPCOUNT_KERNEL_X86
+
+// Set this environment variable to force a kernel variant
+constexpr const char *Kernel_Variant_Env = "RCPPSAMPLE_KERNEL";
+
+struct KernelSet {
+    void (*popcount_raw)(const uint8_t *, size_t, int *);
+    void (*popcount_raw_compact)(const uint8_t *, size_t, uint8_t *);
+    void (*popcount_integer)(const int *, size_t, int *);
+    void (*popcount_integer64)(const int64_t *, size_t, int *);
+    size_t (*popcount_double)(const double *, size_t, int *);
+    uint64_t (*popcount_total_raw)(const uint8_t *, size_t);
+};
+
+// Count NAs in a chunk which popcount_total_raw has just read
+constexpr size_t Total_Chunk_Size = 1024;
+
+void popcount_scalar_integer(const int *src, size_t size, int *dst) {
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        dst[i] = (x == Kernel_Na_Integer)
+                     ? Kernel_Na_Integer
+                     : __builtin_popcount(static_cast<unsigned int>(x));
+    }
+}
+
+void popcount_scalar_integer64(const int64_t *src, size_t size, int *dst) {
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        dst[i] = (x == Kernel_Na_Integer64)
+                     ? Kernel_Na_Integer
+                     : __builtin_popcountll(static_cast<uint64_t>(x));
+    }
+}
+
+// Out of (INT_MIN, INT_MAX] as.integer() warns and returns NA
+constexpr double Double_Int_Min = static_cast<double>(Kernel_Na_Integer);
+constexpr double Double_Int_Max_Plus_1 = -Double_Int_Min;
+
+size_t popcount_scalar_double(const double *src, size_t size, int *dst) {
+    size_t out_of_range = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        // False for NaNs
+        const bool in_range =
+            (x > Double_Int_Min) && (x < Double_Int_Max_Plus_1);
+        const auto value = static_cast<unsigned int>(
+            static_cast<int>(in_range ? x : 0.0));
+        dst[i] = in_range ? __builtin_popcount(value) : Kernel_Na_Integer;
+        out_of_range += (!in_range && !std::isnan(x));
+    }
+    return out_of_range;
+}
+
+#ifdef POPCOUNT_KERNEL_X86
+__attribute__((target("popcnt"))) void
+popcount_popcnt_integer(const int *src, size_t size, int *dst) {
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        dst[i] = (x == Kernel_Na_Integer)
+                     ? Kernel_Na_Integer
+                     : __builtin_popcount(static_cast<unsigned int>(x));
+    }
+}
+
+__attribute__((target("popcnt"))) void
+popcount_popcnt_integer64(const int64_t *src, size_t size, int *dst) {
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        dst[i] = (x == Kernel_Na_Integer64)
+                     ? Kernel_Na_Integer
+                     : __builtin_popcountll(static_cast<uint64_t>(x));
+    }
+}
+
+__attribute__((target("popcnt"))) size_t
+popcount_popcnt_double(const double *src, size_t size, int *dst) {
+    size_t out_of_range = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const auto x = src[i];
+        const bool in_range =
+            (x > Double_Int_Min) && (x < Double_Int_Max_Plus_1);
+        const auto value = static_cast<unsigned int>(
+            static_cast<int>(in_range ? x : 0.0));
+        dst[i] = in_range ? __builtin_popcount(value) : Kernel_Na_Integer;
+        out_of_range += (!in_range && !std::isnan(x));
+    }
+    return out_of_range;
+}
+
+__attribute__((target("avx2,popcnt"))) void
+popcount_avx2_integer(const int *src, size_t size, int *dst) {
+    constexpr size_t width = sizeof(__m256i) / sizeof(int);
+    const __m256i na = _mm256_set1_epi32(Kernel_Na_Integer);
+    const __m256i ones_8 = _mm256_set1_epi8(1);
+    const __m256i ones_16 = _mm256_set1_epi16(1);
+    size_t i = 0;
+    for (; (i + width) <= size; i += width) {
+        const __m256i xs =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        // Sum counts of 4 bytes to a 32-bit integer
+        const __m256i counts = _mm256_madd_epi16(
+            _mm256_maddubs_epi16(popcount_bytes_avx2(xs), ones_8), ones_16);
+        // Blend NAs without branches
+        const __m256i is_na = _mm256_cmpeq_epi32(xs, na);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_blendv_epi8(counts, na, is_na));
+    }
+    popcount_popcnt_integer(src + i, size - i, dst + i);
+}
+
+__attribute__((target("avx2,popcnt"))) void
+popcount_avx2_integer64(const int64_t *src, size_t size, int *dst) {
+    constexpr size_t width = sizeof(__m256i) / sizeof(int64_t);
+    const __m256i na = _mm256_set1_epi64x(Kernel_Na_Integer64);
+    // Low 32 bits of each 64-bit lane are NA_INTEGER
+    const __m256i na_integer = _mm256_set1_epi32(Kernel_Na_Integer);
+    const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    size_t i = 0;
+    for (; (i + width) <= size; i += width) {
+        const __m256i xs =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        // Sum counts of 8 bytes to a 64-bit integer
+        const __m256i counts = _mm256_sad_epu8(popcount_bytes_avx2(xs),
+                                               _mm256_setzero_si256());
+        const __m256i is_na = _mm256_cmpeq_epi64(xs, na);
+        const __m256i blended = _mm256_permutevar8x32_epi32(
+            _mm256_blendv_epi8(counts, na_integer, is_na), low_halves);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm256_castsi256_si128(blended));
+    }
+    popcount_popcnt_integer64(src + i, size - i, dst + i);
+}
+
+#define POPCOUNT_TARGET_AVX512                                                 \
+    __attribute__((                                                            \
+        target("avx512f,avx512bw,avx512vpopcntdq,avx512bitalg,popcnt")))
+
+POPCOUNT_TARGET_AVX512 void popcount_avx512_integer(const int *src,
+                                                    size_t size, int *dst) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(int);
+    const __m512i na = _mm512_set1_epi32(Kernel_Na_Integer);
+    size_t i = 0;
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        const __mmask16 is_na = _mm512_cmpeq_epi32_mask(xs, na);
+        _mm512_storeu_si512(
+            dst + i, _mm512_mask_mov_epi32(_mm512_popcnt_epi32(xs), is_na, na));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask16>((1u << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi32(mask, src + i);
+        const __mmask16 is_na = _mm512_cmpeq_epi32_mask(xs, na);
+        _mm512_mask_storeu_epi32(
+            dst + i, mask,
+            _mm512_mask_mov_epi32(_mm512_popcnt_epi32(xs), is_na, na));
+    }
+}
+
+POPCOUNT_TARGET_AVX512 void
+popcount_avx512_integer64(const int64_t *src, size_t size, int *dst) {
+    constexpr size_t width = sizeof(__m512i) / sizeof(int64_t);
+    const __m512i na = _mm512_set1_epi64(Kernel_Na_Integer64);
+    // Truncating to 32 bits leaves NA_INTEGER
+    const __m512i na_integer = _mm512_set1_epi64(Kernel_Na_Integer);
+    size_t i = 0;
+    for (; (i + width) <= size; i += width) {
+        const __m512i xs = _mm512_loadu_si512(src + i);
+        const __mmask8 is_na = _mm512_cmpeq_epi64_mask(xs, na);
+        const __m512i counts =
+            _mm512_mask_mov_epi64(_mm512_popcnt_epi64(xs), is_na, na_integer);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm512_maskz_cvtepi64_epi32(0xff, counts));
+    }
+
+    if (i < size) {
+        const auto mask = static_cast<__mmask8>((1u << (size - i)) - 1);
+        const __m512i xs = _mm512_maskz_loadu_epi64(mask, src + i);
+        const __mmask8 is_na = _mm512_cmpeq_epi64_mask(xs, na);
+        const __m512i counts =
+            _mm512_mask_mov_epi64(_mm512_popcnt_epi64(xs), is_na, na_integer);
+        _mm512_mask_cvtepi64_storeu_epi32(dst + i, mask, counts);
+    }
+}
+#undef POPCOUNT_TARGET_AVX512
+#endif // POPCOUNT_KERNEL_X86
+
+KernelDispatch<KernelSet> &kernel_dispatch() {
+    static const KernelDispatch<KernelSet>::Table kernel_sets{
+        KernelSet{popcount_elements_scalar<uint8_t, int>,
+                  popcount_elements_scalar<uint8_t, uint8_t>,
+                  popcount_scalar_integer, popcount_scalar_integer64,
+                  popcount_scalar_double, popcount_total_scalar},
+#ifdef POPCOUNT_KERNEL_X86
+        KernelSet{popcount_elements_popcnt<uint8_t, int>,
+                  popcount_elements_popcnt<uint8_t, uint8_t>,
+                  popcount_popcnt_integer, popcount_popcnt_integer64,
+                  popcount_popcnt_double, popcount_total_popcnt},
+        // Conversion of doubles dominates counting their 1's
+        KernelSet{popcount_uint8_avx2<int>, popcount_uint8_avx2<uint8_t>,
+                  popcount_avx2_integer, popcount_avx2_integer64,
+                  popcount_popcnt_double, popcount_total_avx2},
+        KernelSet{popcount_uint8_avx512<int>, popcount_uint8_avx512<uint8_t>,
+                  popcount_avx512_integer, popcount_avx512_integer64,
+                  popcount_popcnt_double, popcount_total_avx512},
+#endif // POPCOUNT_KERNEL_X86
+    };
+    // Select a variant once at loading the package
+    static KernelDispatch<KernelSet> dispatch{kernel_sets, Kernel_Variant_Env};
+    return dispatch;
+}
+
+const KernelSet &current_kernel_set() {
+    return kernel_dispatch().current();
+}
+
+// Chunks of inputs and outputs fit in L2 cache
+constexpr size_t Parallel_Chunk_Bytes = 1 << 16;
+// Waking threads costs more than counting smaller inputs
+constexpr size_t Parallel_Min_Bytes = 1 << 20;
+
+bool is_parallel(size_t size_in_bytes, size_t threads) {
+    return (threads != 1) && (size_in_bytes >= Parallel_Min_Bytes) &&
+           (ThreadPool::instance().threads_to_use(threads) > 1);
+}
+
+template <typename T, typename U>
+void popcount_parallel(const T *src, size_t size, U *dst, size_t threads) {
+    if (!is_parallel(size * sizeof(T), threads)) {
+        popcount_kernel(src, size, dst);
+        return;
+    }
+
+    // Outputs can be larger than raw inputs
+    constexpr size_t chunk_size =
+        Parallel_Chunk_Bytes / std::max(sizeof(T), sizeof(U));
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    ThreadPool::instance().run(n_chunks, threads, [=](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        popcount_kernel(src + offset, std::min(chunk_size, size - offset),
+                        dst + offset);
+    });
+}
+
+// Count 1's of non-NA elements and NAs of int or int64_t.
+// An NA has one 1 (the sign bit).
+template <typename T>
+uint64_t popcount_total_na(const T *src, size_t size, T na, size_t &na_count) {
+    const auto &kernel_set = current_kernel_set();
+    uint64_t total = 0;
+    na_count = 0;
+    for (size_t i = 0; i < size; i += Total_Chunk_Size) {
+        const auto chunk_size = std::min(Total_Chunk_Size, size - i);
+        const auto chunk = src + i;
+        total += kernel_set.popcount_total_raw(
+            reinterpret_cast<const uint8_t *>(chunk), chunk_size * sizeof(T));
+        // The chunk is still in L1 cache
+        for (size_t j = 0; j < chunk_size; ++j) {
+            na_count += (chunk[j] == na);
+        }
+    }
+    return total - na_count;
+}
+
+template <typename T>
+uint64_t popcount_total_na_parallel(const T *src, size_t size,
+                                    size_t &na_count, size_t threads) {
+    if (!is_parallel(size * sizeof(T), threads)) {
+        return popcount_total_kernel(src, size, na_count);
+    }
+
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(T);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> totals(n_chunks, 0);
+    std::vector<size_t> na_counts(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        totals.at(chunk_index) = popcount_total_kernel(
+            src + offset, std::min(chunk_size, size - offset),
+            na_counts.at(chunk_index));
+    });
+
+    uint64_t total = 0;
+    na_count = 0;
+    for (size_t index = 0; index < n_chunks; ++index) {
+        total += totals.at(index);
+        na_count += na_counts.at(index);
+    }
+    return total;
+}
+} // namespace
+
+void popcount_kernel(const uint8_t *src, size_t size, int *dst) {
+    current_kernel_set().popcount_raw(src, size, dst);
+}
+
+void popcount_kernel(const uint8_t *src, size_t size, uint8_t *dst) {
+    current_kernel_set().popcount_raw_compact(src, size, dst);
+}
+
+void popcount_kernel(const int *src, size_t size, int *dst) {
+    current_kernel_set().popcount_integer(src, size, dst);
+}
+
+uint64_t popcount_total_kernel(const uint8_t *src, size_t size) {
+    return current_kernel_set().popcount_total_raw(src, size);
+}
+
+void popcount_kernel(const int64_t *src, size_t size, int *dst) {
+    current_kernel_set().popcount_integer64(src, size, dst);
+}
+
+size_t popcount_kernel(const double *src, size_t size, int *dst) {
+    return current_kernel_set().popcount_double(src, size, dst);
+}
+
+uint64_t popcount_total_kernel(const int *src, size_t size,
+                               size_t &na_count) {
+    return popcount_total_na(src, size, Kernel_Na_Integer, na_count);
+}
+
+uint64_t popcount_total_kernel(const int64_t *src, size_t size,
+                               size_t &na_count) {
+    return popcount_total_na(src, size, Kernel_Na_Integer64, na_count);
+}
+
+void popcount_kernel(const uint8_t *src, size_t size, int *dst,
+                     size_t threads) {
+    popcount_parallel(src, size, dst, threads);
+}
+
+void popcount_kernel(const uint8_t *src, size_t size, uint8_t *dst,
+                     size_t threads) {
+    popcount_parallel(src, size, dst, threads);
+}
+
+void popcount_kernel(const int *src, size_t size, int *dst, size_t threads) {
+    popcount_parallel(src, size, dst, threads);
+}
+
+void popcount_kernel(const int64_t *src, size_t size, int *dst,
+                     size_t threads) {
+    popcount_parallel(src, size, dst, threads);
+}
+
+size_t popcount_kernel(const double *src, size_t size, int *dst,
+                       size_t threads) {
+    if (!is_parallel(size * sizeof(double), threads)) {
+        return popcount_kernel(src, size, dst);
+    }
+
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes / sizeof(double);
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    std::vector<size_t> out_of_range(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        out_of_range.at(chunk_index) = popcount_kernel(
+            src + offset, std::min(chunk_size, size - offset), dst + offset);
+    });
+
+    size_t total = 0;
+    for (const auto count : out_of_range) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t popcount_total_kernel(const uint8_t *src, size_t size,
+                               size_t threads) {
+    if (!is_parallel(size, threads)) {
+        return popcount_total_kernel(src, size);
+    }
+
+    // Sum partial totals in order to get the same result every time
+    constexpr size_t chunk_size = Parallel_Chunk_Bytes;
+    const auto n_chunks = (size + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> totals(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto offset = chunk_index * chunk_size;
+        totals.at(chunk_index) = popcount_total_kernel(
+            src + offset, std::min(chunk_size, size - offset));
+    });
+
+    uint64_t total = 0;
+    for (const auto partial : totals) {
+        total += partial;
+    }
+    return total;
+}
+
+uint64_t popcount_total_kernel(const int *src, size_t size, size_t &na_count,
+                               size_t threads) {
+    return popcount_total_na_parallel(src, size, na_count, threads);
+}
+
+uint64_t popcount_total_kernel(const int64_t *src, size_t size,
+                               size_t &na_count, size_t threads) {
+    return popcount_total_na_parallel(src, size, na_count, threads);
+}
+
+size_t popcount_many_kernel(const std::vector<ManyVector> &vectors,
+                            size_t threads) {
+    const auto count_range = [&](size_t index, size_t begin, size_t end) {
+        const auto &vector = vectors.at(index);
+        return vector.kernel(static_cast<const uint8_t *>(vector.src) +
+                                 begin * vector.element_size,
+                             end - begin, vector.dst + begin);
+    };
+
+    size_t total_bytes = 0;
+    for (const auto &vector : vectors) {
+        total_bytes += vector.size * vector.element_size;
+    }
+    size_t out_of_range = 0;
+    if (!is_parallel(total_bytes, threads)) {
+        for (size_t index = 0; index < vectors.size(); ++index) {
+            out_of_range += count_range(index, 0, vectors[index].size);
+        }
+        return out_of_range;
+    }
+
+    // A chunk starts at an element of a vector and ends at the start of
+    // the next chunk. Chunks group small vectors and split large vectors.
+    struct Position {
+        size_t index;  // The index of a vector
+        size_t offset; // The index of an element in the vector
+    };
+    std::vector<Position> starts;
+    size_t filled = 0;
+    for (size_t index = 0; index < vectors.size(); ++index) {
+        const auto &vector = vectors[index];
+        size_t offset = 0;
+        while (offset < vector.size) {
+            if (filled == 0) {
+                starts.push_back(Position{index, offset});
+            }
+            const auto room =
+                (Parallel_Chunk_Bytes - filled + vector.element_size - 1) /
+                vector.element_size;
+            const auto n_elements = std::min(room, vector.size - offset);
+            offset += n_elements;
+            filled += n_elements * vector.element_size;
+            if (filled >= Parallel_Chunk_Bytes) {
+                filled = 0;
+            }
+        }
+    }
+    starts.push_back(Position{vectors.size(), 0});
+
+    const auto n_chunks = starts.size() - 1;
+    std::vector<size_t> chunk_out_of_range(n_chunks, 0);
+    ThreadPool::instance().run(n_chunks, threads, [&](size_t chunk_index) {
+        const auto first = starts.at(chunk_index);
+        const auto last = starts.at(chunk_index + 1);
+        for (auto index = first.index;
+             (index <= last.index) && (index < vectors.size()); ++index) {
+            const auto begin = (index == first.index) ? first.offset : 0;
+            const auto end =
+                (index == last.index) ? last.offset : vectors[index].size;
+            if (begin < end) {
+                chunk_out_of_range.at(chunk_index) +=
+                    count_range(index, begin, end);
+            }
+        }
+    });
+
+    for (const auto count : chunk_out_of_range) {
+        out_of_range += count;
+    }
+    return out_of_range;
+}
+
+KernelVariant get_kernel_variant() {
+    return kernel_dispatch().variant();
+}
+
+void set_kernel_variant(KernelVariant variant) {
+    kernel_dispatch().set_variant(variant);
+}
+} // namespace rCppSample
@@ -0,0 +1,110 @@
+#ifndef SRC_POPCOUNT_KERNEL_H
+#define SRC_POPCOUNT_KERNEL_H
+
+#include "popcount_core.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace rCppSample {
+// Equal to NA_INTEGER without R headers
+constexpr int Kernel_Na_Integer = std::numeric_limits<int>::min();
+// Equal to NA_integer64_ of bit64 which stores int64 in doubles
+constexpr int64_t Kernel_Na_Integer64 = std::numeric_limits<int64_t>::min();
+
+// Instruction sets which popcount kernels are built for
+using KernelVariant = popcount_core::KernelVariant;
+
+// Write the number of 1's of each raw element in src to dst
+extern void popcount_kernel(const uint8_t *src, size_t size, int *dst);
+
+// Write the number of 1's of each raw element in src to a byte of dst
+extern void popcount_kernel(const uint8_t *src, size_t size, uint8_t *dst);
+
+// Write the number of 1's of each integer element in src to dst
+// and keep NAs
+extern void popcount_kernel(const int *src, size_t size, int *dst);
+
+// Write the number of 1's of each int64 element in src to dst
+// and keep NAs of integer64
+extern void popcount_kernel(const int64_t *src, size_t size, int *dst);
+
+// Write the number of 1's of each double element in src truncated to an
+// integer to dst as as.integer() does, write NAs for NaNs and
+// out-of-range elements and return the number of out-of-range elements
+extern size_t popcount_kernel(const double *src, size_t size, int *dst);
+
+// Return the number of 1's of all raw elements in src
+extern uint64_t popcount_total_kernel(const uint8_t *src, size_t size);
+
+// Return the number of 1's of all non-NA integer elements in src
+// and write the number of NAs to na_count
+extern uint64_t popcount_total_kernel(const int *src, size_t size,
+                                      size_t &na_count);
+extern uint64_t popcount_total_kernel(const int64_t *src, size_t size,
+                                      size_t &na_count);
+
+// Count chunks of src on a thread pool and small vectors serially.
+// threads = 0 means all cores.
+extern void popcount_kernel(const uint8_t *src, size_t size, int *dst,
+                            size_t threads);
+extern void popcount_kernel(const uint8_t *src, size_t size, uint8_t *dst,
+                            size_t threads);
+extern void popcount_kernel(const int *src, size_t size, int *dst,
+                            size_t threads);
+extern void popcount_kernel(const int64_t *src, size_t size, int *dst,
+                            size_t threads);
+extern size_t popcount_kernel(const double *src, size_t size, int *dst,
+                              size_t threads);
+extern uint64_t popcount_total_kernel(const uint8_t *src, size_t size,
+                                      size_t threads);
+extern uint64_t popcount_total_kernel(const int *src, size_t size,
+                                      size_t &na_count, size_t threads);
+extern uint64_t popcount_total_kernel(const int64_t *src, size_t size,
+                                      size_t &na_count, size_t threads);
+
+// Count a vector which ManyVector points to and return the number of
+// out-of-range double elements or 0 for other types
+using ManyKernel = size_t (*)(const void *src, size_t size, int *dst);
+
+template <typename T>
+size_t popcount_many_element(const void *src, size_t size, int *dst) {
+    popcount_kernel(static_cast<const T *>(src), size, dst);
+    return 0;
+}
+
+template <>
+inline size_t popcount_many_element<double>(const void *src, size_t size,
+                                            int *dst) {
+    return popcount_kernel(static_cast<const double *>(src), size, dst);
+}
+
+// A vector of elements and a vector to write their counts
+struct ManyVector {
+    ManyKernel kernel;   // popcount_many_element() for the element type
+    const void *src;     // The first element
+    size_t size;         // The number of elements
+    size_t element_size; // The size of an element in bytes
+    int *dst;            // A vector to write size counts
+};
+
+// Count vectors in one call and return the number of out-of-range double
+// elements. Chunks group small vectors and split large vectors on a
+// thread pool.
+extern size_t popcount_many_kernel(const std::vector<ManyVector> &vectors,
+                                   size_t threads);
+
+// parse_kernel_variant() accepts "auto" for the best variant
+using popcount_core::detect_kernel_variant;
+using popcount_core::is_kernel_variant_supported;
+using popcount_core::kernel_variant_name;
+using popcount_core::parse_kernel_variant;
+using popcount_core::supported_kernel_variants;
+extern KernelVariant get_kernel_variant();
+// Throw std::invalid_argument if the running CPU cannot execute the variant
+extern void set_kernel_variant(KernelVariant variant);
+} // namespace rCppSample
+
+#endif // SRC_POPCOUNT_KERNEL_H
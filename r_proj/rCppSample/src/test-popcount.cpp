@@ -1,5 +1,6 @@
 #include "test_popcount.h"
 #include <algorithm>
+#include <cmath>
 #include <testthat.h>
 
 #define ASSERT_IS_EQUAL(x, y)                                                  \
@@ -151,3 +152,42 @@ context("PopcountCpp") {
         expect_true(are_equal(actual, expected));
     }
 }
+
+context("PopcountKernel") {
+    test_that("AllVariants") {
+        const rCppSample::RawVector arg_raw{0, 1, 2, 3, 6, 7, 254, 255};
+        const rCppSample::IntegerVector expected_raw{0, 1, 1, 2, 2, 3, 7, 8};
+        const rCppSample::IntegerVector arg_integer{
+            2, rCppSample::NaInteger, 14, -1, 0x7fffffff};
+        const rCppSample::IntegerVector expected_integer{
+            1, rCppSample::NaInteger, 3, 32, 31};
+
+        for (const auto &name : rCppSample::supported_kernel_variants()) {
+            set_kernel_variant_cpp(name);
+            expect_true(get_kernel_variant_cpp() == name);
+            expect_true(are_equal(popcount_cpp_raw(arg_raw), expected_raw));
+            expect_true(
+                are_equal(popcount_cpp_integer(arg_integer), expected_integer));
+        }
+        set_kernel_variant_cpp("auto");
+    }
+
+    test_that("Totals") {
+        const rCppSample::RawVector arg_raw{0, 1, 2, 3, 6, 7, 254, 255};
+        const rCppSample::IntegerVector arg_integer{
+            2, rCppSample::NaInteger, 14, -1, 0x7fffffff};
+
+        for (const auto &name : rCppSample::supported_kernel_variants()) {
+            set_kernel_variant_cpp(name);
+            expect_true(popcount_total_cpp_raw(arg_raw) == 24.0);
+            expect_true(popcount_total_cpp_integer(arg_integer, true) == 67.0);
+            expect_true(
+                std::isnan(popcount_total_cpp_integer(arg_integer, false)));
+        }
+        set_kernel_variant_cpp("auto");
+    }
+
+    test_that("UnknownVariant") {
+        expect_error_as(set_kernel_variant_cpp("sse2"), std::invalid_argument);
+    }
+}
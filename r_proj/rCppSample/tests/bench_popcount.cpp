@@ -0,0 +1,283 @@
+#include "popcount.h"
+#include "popcount_kernel.h"
+#include "popcount_perf.h"
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+// Kernel variants in the order of rCppSample::KernelVariant
+const std::vector<int64_t> Variants{0, 1, 2, 3};
+// The numbers of elements from L1-resident vectors to larger than LLC
+const std::vector<int64_t> Sizes{16, 1 << 12, 1 << 18, 1 << 24};
+// 0 for vectors on cache lines and 1 for vectors one element after them
+const std::vector<int64_t> Offsets{0, 1};
+// Short vectors whose calls cost more than counting them
+const std::vector<int64_t> Latency_Sizes{1, 8, 63, 64, 256};
+constexpr uintptr_t Cache_Line_Size = 64;
+
+// Random bits in an integer which are NA at a negligible probability
+template <typename T> T random_element(std::mt19937_64 &engine) {
+    const uint64_t bits = engine();
+    T element;
+    std::memcpy(&element, &bits, sizeof(element));
+    return element;
+}
+
+// Doubles which as.integer() converts without NAs
+template <> double random_element<double>(std::mt19937_64 &engine) {
+    std::uniform_real_distribution<double> distribution(-2147483647.0,
+                                                        2147483647.0);
+    return distribution(engine);
+}
+
+template <typename T> std::vector<T> make_vector(size_t size) {
+    std::mt19937_64 engine(size);
+    std::vector<T> xs(size);
+    for (auto &x : xs) {
+        x = random_element<T>(engine);
+    }
+    return xs;
+}
+
+// Elements on a cache line or one element after it
+template <typename T> class Buffer {
+  public:
+    Buffer(size_t size, size_t offset)
+        : storage_(size * sizeof(T) + Cache_Line_Size * 2) {
+        const auto address = reinterpret_cast<uintptr_t>(storage_.data());
+        const auto aligned =
+            (address + Cache_Line_Size - 1) & ~(Cache_Line_Size - 1);
+        data_ = reinterpret_cast<T *>(storage_.data() + (aligned - address) +
+                                      offset * sizeof(T));
+        const auto xs = make_vector<T>(size);
+        std::memcpy(data_, xs.data(), size * sizeof(T));
+    }
+
+    const T *data() const {
+        return data_;
+    }
+
+  private:
+    std::vector<uint8_t> storage_;
+    T *data_;
+};
+
+// Skip variants which the running CPU cannot execute
+bool select_variant(benchmark::State &state, int64_t index) {
+    const auto variant = static_cast<rCppSample::KernelVariant>(index);
+    if (!rCppSample::is_kernel_variant_supported(variant)) {
+        state.SkipWithError("Unsupported kernel variant");
+        return false;
+    }
+    rCppSample::set_kernel_variant(variant);
+    state.SetLabel(rCppSample::kernel_variant_name(variant));
+    return true;
+}
+
+// Exported functions run the best variant
+void select_best_variant(benchmark::State &state) {
+    const auto variant = rCppSample::detect_kernel_variant();
+    select_variant(state, static_cast<int64_t>(variant));
+}
+
+// Report elements/second and bytes/second
+void set_processed(benchmark::State &state, size_t size,
+                   size_t element_size) {
+    const auto iterations = static_cast<int64_t>(state.iterations());
+    state.SetItemsProcessed(iterations * static_cast<int64_t>(size));
+    state.SetBytesProcessed(iterations *
+                            static_cast<int64_t>(size * element_size));
+}
+
+// Report cycles/byte, IPC and misses per iteration of hardware counters
+// and nothing on hosts without counters such as containers
+void set_perf_counters(benchmark::State &state,
+                       const popcount_core::PerfSample &sample,
+                       size_t n_bytes) {
+    using popcount_core::PerfEvent;
+    const auto iterations = static_cast<size_t>(state.iterations());
+    if (sample.available(PerfEvent::Cycles) && (n_bytes > 0)) {
+        state.counters["cycles/byte"] =
+            sample.cycles_per_byte(n_bytes * iterations);
+    }
+    if (sample.available(PerfEvent::Cycles) &&
+        sample.available(PerfEvent::Instructions)) {
+        state.counters["IPC"] = sample.ipc();
+    }
+    if (sample.available(PerfEvent::LlcMisses)) {
+        state.counters["LLC-misses"] =
+            benchmark::Counter(sample.value(PerfEvent::LlcMisses),
+                               benchmark::Counter::kAvgIterations);
+    }
+    if (sample.available(PerfEvent::BranchMisses)) {
+        state.counters["branch-misses"] =
+            benchmark::Counter(sample.value(PerfEvent::BranchMisses),
+                               benchmark::Counter::kAvgIterations);
+    }
+}
+
+void kernel_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"variant", "size", "offset"})
+        ->ArgsProduct({Variants, Sizes, Offsets})
+        ->Unit(benchmark::kMicrosecond);
+}
+
+// Exported functions take vectors which R allocates at its own offsets
+void export_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size"})
+        ->ArgsProduct({Sizes})
+        ->Unit(benchmark::kMicrosecond);
+}
+
+// Latency per call of exported functions in nanoseconds, excluding
+// conversion of R objects which README.Rmd measures with microbenchmark
+void latency_args(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size"})
+        ->ArgsProduct({Latency_Sizes})
+        ->Unit(benchmark::kNanosecond);
+}
+} // namespace
+
+// T is the type of elements and U is the type of counts
+template <typename T, typename U>
+void BM_PopcountKernel(benchmark::State &state) {
+    if (!select_variant(state, state.range(0))) {
+        return;
+    }
+    const auto size = static_cast<size_t>(state.range(1));
+    const Buffer<T> src(size, static_cast<size_t>(state.range(2)));
+    std::vector<U> dst(size);
+    popcount_core::PerfCounters counters;
+    counters.start();
+    for (auto _ : state) {
+        rCppSample::popcount_kernel(src.data(), size, dst.data());
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    const auto sample = counters.stop();
+    set_processed(state, size, sizeof(T));
+    set_perf_counters(state, sample, size * sizeof(T));
+}
+
+void BM_PopcountTotalKernelRaw(benchmark::State &state) {
+    if (!select_variant(state, state.range(0))) {
+        return;
+    }
+    const auto size = static_cast<size_t>(state.range(1));
+    const Buffer<uint8_t> src(size, static_cast<size_t>(state.range(2)));
+    popcount_core::PerfCounters counters;
+    counters.start();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            rCppSample::popcount_total_kernel(src.data(), size));
+    }
+    const auto sample = counters.stop();
+    set_processed(state, size, sizeof(uint8_t));
+    set_perf_counters(state, sample, size * sizeof(uint8_t));
+}
+
+template <typename T> void BM_PopcountTotalKernelNa(benchmark::State &state) {
+    if (!select_variant(state, state.range(0))) {
+        return;
+    }
+    const auto size = static_cast<size_t>(state.range(1));
+    const Buffer<T> src(size, static_cast<size_t>(state.range(2)));
+    popcount_core::PerfCounters counters;
+    counters.start();
+    for (auto _ : state) {
+        size_t na_count = 0;
+        benchmark::DoNotOptimize(
+            rCppSample::popcount_total_kernel(src.data(), size, na_count));
+        benchmark::DoNotOptimize(na_count);
+    }
+    const auto sample = counters.stop();
+    set_processed(state, size, sizeof(T));
+    set_perf_counters(state, sample, size * sizeof(T));
+}
+
+// T is the type of elements and F is an exported function
+template <typename T, typename F>
+void run_exported(benchmark::State &state, F function) {
+    select_best_variant(state);
+    const auto size = static_cast<size_t>(state.range(0));
+    const auto xs = make_vector<T>(size);
+    for (auto _ : state) {
+        auto counts = function(xs);
+        benchmark::DoNotOptimize(counts);
+    }
+    set_processed(state, size, sizeof(T));
+}
+
+void BM_PopcountCppRaw(benchmark::State &state) {
+    run_exported<uint8_t>(state, [](rCppSample::ArgRawVector xs) {
+        return popcount_cpp_raw(xs);
+    });
+}
+
+void BM_PopcountCompactCppRaw(benchmark::State &state) {
+    run_exported<uint8_t>(state, [](rCppSample::ArgRawVector xs) {
+        return popcount_compact_cpp_raw(xs);
+    });
+}
+
+void BM_PopcountCppInteger(benchmark::State &state) {
+    run_exported<int>(state, [](rCppSample::ArgIntegerVector xs) {
+        return popcount_cpp_integer(xs);
+    });
+}
+
+void BM_PopcountCppDouble(benchmark::State &state) {
+    run_exported<double>(state, [](rCppSample::ArgNumericVector xs) {
+        return popcount_cpp_double(xs);
+    });
+}
+
+void BM_PopcountCppInteger64(benchmark::State &state) {
+    run_exported<double>(state, [](rCppSample::ArgNumericVector xs) {
+        return popcount_cpp_integer64(xs);
+    });
+}
+
+void BM_PopcountTotalCppRaw(benchmark::State &state) {
+    run_exported<uint8_t>(state, [](rCppSample::ArgRawVector xs) {
+        return popcount_total_cpp_raw(xs);
+    });
+}
+
+void BM_PopcountTotalCppInteger(benchmark::State &state) {
+    run_exported<int>(state, [](rCppSample::ArgIntegerVector xs) {
+        return popcount_total_cpp_integer(xs, false);
+    });
+}
+
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint8_t, int)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, uint8_t, uint8_t)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int, int)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, int64_t, int)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountKernel, double, int)->Apply(kernel_args);
+BENCHMARK(BM_PopcountTotalKernelRaw)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalKernelNa, int)->Apply(kernel_args);
+BENCHMARK_TEMPLATE(BM_PopcountTotalKernelNa, int64_t)->Apply(kernel_args);
+
+BENCHMARK(BM_PopcountCppRaw)->Apply(export_args);
+BENCHMARK(BM_PopcountCompactCppRaw)->Apply(export_args);
+BENCHMARK(BM_PopcountCppInteger)->Apply(export_args);
+BENCHMARK(BM_PopcountCppDouble)->Apply(export_args);
+BENCHMARK(BM_PopcountCppInteger64)->Apply(export_args);
+BENCHMARK(BM_PopcountTotalCppRaw)->Apply(export_args);
+BENCHMARK(BM_PopcountTotalCppInteger)->Apply(export_args);
+
+BENCHMARK(BM_PopcountCppRaw)
+    ->Name("BM_PopcountLatencyCppRaw")
+    ->Apply(latency_args);
+BENCHMARK(BM_PopcountCppInteger)
+    ->Name("BM_PopcountLatencyCppInteger")
+    ->Apply(latency_args);
+BENCHMARK(BM_PopcountCppInteger64)
+    ->Name("BM_PopcountLatencyCppInteger64")
+    ->Apply(latency_args);
+
+BENCHMARK_MAIN();
@@ -1,9 +1,14 @@
 #include "test_popcount.h"
+#include "popcount_stats.h"
+#include "rank_select.h"
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <gtest/gtest.h>
 #include <limits>
+#include <stdexcept>
+#include <vector>
 #define R_INTERFACE_PTRS
 #include <Rembedded.h>
 #include <Rinterface.h>
@@ -258,6 +263,15 @@ TEST_F(TestPopcount, RawValues) {
     EXPECT_TRUE(are_equal(expected, actual));
 }
 
+TEST_F(TestPopcount, CompactRawValues) {
+    // Counts of raw elements are raw elements as well
+    const rCppSample::RawVector arg{0, 1, 2, 3, 6, 7, 254, 255};
+    const rCppSample::RawVector expected{0, 1, 1, 2, 2, 3, 7, 8};
+    const auto actual = popcount_compact_cpp_raw(arg);
+    EXPECT_TRUE(are_equal(expected, actual));
+    EXPECT_EQ(0, popcount_compact_cpp_raw(rCppSample::RawVector{}).size());
+}
+
 TEST_F(TestPopcount, IntegerValues) {
     // Check some non-negative int32 values
     using VectorType = rCppSample::IntegerVector;
@@ -291,6 +305,63 @@ TEST_F(TestPopcount, NegativeIntegerValues) {
     EXPECT_TRUE(are_equal(expected, actual));
 }
 
+TEST_F(TestPopcount, LogicalValues) {
+    // TRUE, FALSE and NA
+    const rCppSample::LogicalVector arg{1, 0, rCppSample::NaInteger, 1};
+    const rCppSample::IntegerVector expected{1, 0, rCppSample::NaInteger, 1};
+    EXPECT_TRUE(are_equal(expected, popcount_cpp_logical(arg)));
+    EXPECT_EQ(2.0, popcount_total_cpp_logical(arg, true));
+    EXPECT_TRUE(std::isnan(popcount_total_cpp_logical(arg, false)));
+}
+
+TEST_F(TestPopcount, DoubleValues) {
+    // Truncate as as.integer() does and NAs out of (INT_MIN, INT_MAX]
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    const auto inf = std::numeric_limits<double>::infinity();
+    const rCppSample::NumericVector arg{
+        7.1,         7.9,          8.0, -7.1, -0.5,         1e+50,
+        2147483647.9, 2147483648.0, -2147483647.9, -2147483648.0, nan, inf};
+    const rCppSample::IntegerVector expected{
+        3,  3,  1, 30, 0, rCppSample::NaInteger, 31, rCppSample::NaInteger,
+        2,  rCppSample::NaInteger, rCppSample::NaInteger,
+        rCppSample::NaInteger};
+    EXPECT_TRUE(are_equal(expected, popcount_cpp_double(arg)));
+}
+
+TEST_F(TestPopcount, Integer64Values) {
+    // Doubles hold bits of int64 values
+    const std::vector<int64_t> values{0, 1, -1, 0x7fffffffffffffffll,
+                                      rCppSample::Kernel_Na_Integer64,
+                                      0x100000000ll};
+    rCppSample::NumericVector arg(values.size());
+    std::memcpy(get_data_pointer(arg), values.data(),
+                sizeof(int64_t) * values.size());
+    const rCppSample::IntegerVector expected{0, 1, 64, 63,
+                                             rCppSample::NaInteger, 1};
+    EXPECT_TRUE(are_equal(expected, popcount_cpp_integer64(arg)));
+    EXPECT_EQ(129.0, popcount_total_cpp_integer64(arg, true));
+    EXPECT_TRUE(std::isnan(popcount_total_cpp_integer64(arg, false)));
+}
+
+TEST_F(TestPopcount, Into) {
+    // Write into a preallocated vector and check its size
+    const rCppSample::IntegerVector arg{2, rCppSample::NaInteger, 14, -1};
+    const rCppSample::IntegerVector expected{1, rCppSample::NaInteger, 3, 32};
+    rCppSample::IntegerVector actual(arg.size(), 0);
+    popcount_into_cpp_integer(arg, actual);
+    EXPECT_TRUE(are_equal(expected, actual));
+
+    const rCppSample::RawVector arg_raw{0, 7, 255};
+    rCppSample::IntegerVector actual_raw(arg_raw.size(), -1);
+    popcount_into_cpp_raw(arg_raw, actual_raw);
+    const rCppSample::IntegerVector expected_raw{0, 3, 8};
+    EXPECT_TRUE(are_equal(expected_raw, actual_raw));
+
+    rCppSample::IntegerVector short_out(arg_raw.size() - 1, 0);
+    EXPECT_THROW(popcount_into_cpp_raw(arg_raw, short_out),
+                 std::invalid_argument);
+}
+
 TEST_F(TestPopcount, FullRawValues) {
     // Check all uint8 values
     using ArgVectorType = rCppSample::RawVector;
@@ -325,6 +396,440 @@ TEST_F(TestPopcount, FullRawValues) {
     EXPECT_TRUE(are_equal(expected, actual));
 }
 
+TEST_F(TestPopcount, Stats) {
+    // Only calls which read 64 KiB or more are timed
+    reset_stats_cpp();
+    const rCppSample::RawVector arg_raw(popcount_core::Stats_Timed_Bytes, 3);
+    const rCppSample::IntegerVector arg_integer{1, 2, rCppSample::NaInteger};
+    popcount_cpp_raw(arg_raw);
+    popcount_cpp_integer(arg_integer);
+    EXPECT_EQ(2.0, popcount_total_cpp_integer(arg_integer, true));
+    record_stats_copy_cpp();
+
+    const auto actual = popcount_core::get_stats();
+    if (!popcount_core::Stats_Enabled) {
+        EXPECT_EQ(0, actual.calls);
+        return;
+    }
+    const auto variant =
+        static_cast<size_t>(rCppSample::get_kernel_variant());
+    EXPECT_EQ(3, actual.calls);
+    EXPECT_EQ(arg_raw.size() + arg_integer.size() * sizeof(int) * 2,
+              actual.bytes);
+    EXPECT_EQ(1, actual.copies);
+    EXPECT_EQ(1, actual.timed_calls);
+    EXPECT_EQ(3, actual.variant_calls.at(variant));
+
+    reset_stats_cpp();
+    EXPECT_EQ(0, popcount_core::get_stats().calls);
+}
+
+class TestPopcountKernel : public ::testing::Test {
+  protected:
+    void TearDown() override {
+        rCppSample::set_kernel_variant(rCppSample::detect_kernel_variant());
+    }
+};
+
+TEST_F(TestPopcountKernel, NaInteger) {
+    EXPECT_EQ(get_na_int_value(), rCppSample::Kernel_Na_Integer);
+}
+
+TEST_F(TestPopcountKernel, VariantNames) {
+    using rCppSample::KernelVariant;
+    for (const auto &variant : {KernelVariant::Scalar, KernelVariant::Popcnt,
+                                KernelVariant::Avx2, KernelVariant::Avx512}) {
+        const auto name = rCppSample::kernel_variant_name(variant);
+        EXPECT_EQ(variant, rCppSample::parse_kernel_variant(name));
+    }
+
+    EXPECT_EQ(rCppSample::detect_kernel_variant(),
+              rCppSample::parse_kernel_variant("auto"));
+    ASSERT_THROW(rCppSample::parse_kernel_variant("sse2"),
+                 std::invalid_argument);
+
+    const auto names = rCppSample::supported_kernel_variants();
+    ASSERT_FALSE(names.empty());
+    EXPECT_EQ("scalar", names.front());
+    EXPECT_EQ(names.back(), get_kernel_variant_cpp());
+}
+
+TEST_F(TestPopcountKernel, AllVariants) {
+    // Sizes around SIMD register widths to run tails
+    const std::vector<size_t> sizes{0,  1,  7,  8,  15,  16,  17,  31,  32,
+                                    33, 63, 64, 65, 127, 128, 129, 1000};
+    constexpr size_t max_size = 1000;
+    std::vector<uint8_t> arg_raw(max_size);
+    std::vector<int> arg_integer(max_size);
+    std::vector<int> expected_raw(max_size);
+    std::vector<uint8_t> expected_compact(max_size);
+    std::vector<int> expected_integer(max_size);
+    for (size_t index = 0; index < max_size; ++index) {
+        const auto value = static_cast<uint32_t>(index * 0x9e3779b9u);
+        arg_raw.at(index) = static_cast<uint8_t>(value);
+        arg_integer.at(index) =
+            (index % 7) ? static_cast<int>(value) : rCppSample::NaInteger;
+        expected_raw.at(index) = __builtin_popcount(arg_raw.at(index) & 0xffu);
+        expected_compact.at(index) =
+            static_cast<uint8_t>(expected_raw.at(index));
+        expected_integer.at(index) =
+            (index % 7) ? __builtin_popcount(value) : rCppSample::NaInteger;
+    }
+
+    for (const auto &name : rCppSample::supported_kernel_variants()) {
+        set_kernel_variant_cpp(name);
+        ASSERT_EQ(name, get_kernel_variant_cpp());
+
+        for (const auto size : sizes) {
+            // Check that kernels do not write past the end
+            constexpr int guard = -2;
+            std::vector<int> actual(size + 1, guard);
+            rCppSample::popcount_kernel(arg_raw.data(), size, actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_raw.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+
+            std::fill(actual.begin(), actual.end(), guard);
+            rCppSample::popcount_kernel(arg_integer.data(), size,
+                                        actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_integer.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+
+            constexpr uint8_t compact_guard = 0xee;
+            std::vector<uint8_t> compact(size + 1, compact_guard);
+            rCppSample::popcount_kernel(arg_raw.data(), size, compact.data());
+            EXPECT_TRUE(std::equal(compact.begin(), compact.begin() + size,
+                                   expected_compact.begin()));
+            EXPECT_EQ(compact_guard, compact.at(size));
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, IntegerEdges) {
+    // SIMD kernels blend NAs into lanes of the other values
+    const std::vector<int> values{0,
+                                  1,
+                                  -1,
+                                  rCppSample::NaInteger,
+                                  rCppSample::NaInteger + 1,
+                                  std::numeric_limits<int>::max(),
+                                  0x0f0f0f0f};
+    const std::vector<int> expected_values{
+        0, 1, 32, rCppSample::NaInteger, 2, 31, 16};
+    constexpr size_t size = 67;
+    std::vector<int> arg(size);
+    std::vector<int> expected(size);
+    for (size_t index = 0; index < size; ++index) {
+        arg.at(index) = values.at(index % values.size());
+        expected.at(index) = expected_values.at(index % values.size());
+    }
+
+    for (const auto &name : rCppSample::supported_kernel_variants()) {
+        set_kernel_variant_cpp(name);
+        std::vector<int> actual(size);
+        rCppSample::popcount_kernel(arg.data(), size, actual.data());
+        EXPECT_EQ(expected, actual);
+    }
+}
+
+TEST_F(TestPopcountKernel, Integer64AndDouble) {
+    const std::vector<size_t> sizes{0, 1, 3, 4, 5, 7, 8, 9, 17, 100};
+    constexpr size_t max_size = 100;
+    std::vector<int64_t> arg_integer64(max_size);
+    std::vector<double> arg_double(max_size);
+    std::vector<int> expected_integer64(max_size);
+    std::vector<int> expected_double(max_size);
+    for (size_t index = 0; index < max_size; ++index) {
+        const auto value = static_cast<uint64_t>(index * 0x9e3779b97f4a7c15ull);
+        const bool is_na = (index % 7) == 0;
+        arg_integer64.at(index) = is_na ? rCppSample::Kernel_Na_Integer64
+                                        : static_cast<int64_t>(value);
+        expected_integer64.at(index) =
+            is_na ? rCppSample::NaInteger : __builtin_popcountll(value);
+        const auto integer = static_cast<int>(value >> 33) - (1 << 29);
+        arg_double.at(index) = is_na ? 1e+10 : (integer + 0.5);
+        expected_double.at(index) =
+            is_na ? rCppSample::NaInteger
+                  : __builtin_popcount(static_cast<uint32_t>(
+                        (integer < 0) ? (integer + 1) : integer));
+    }
+
+    for (const auto &name : rCppSample::supported_kernel_variants()) {
+        set_kernel_variant_cpp(name);
+        for (const auto size : sizes) {
+            // Check that kernels do not write past the end
+            constexpr int guard = -2;
+            std::vector<int> actual(size + 1, guard);
+            rCppSample::popcount_kernel(arg_integer64.data(), size,
+                                        actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_integer64.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+
+            std::fill(actual.begin(), actual.end(), guard);
+            const auto out_of_range = rCppSample::popcount_kernel(
+                arg_double.data(), size, actual.data());
+            EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + size,
+                                   expected_double.begin()));
+            EXPECT_EQ(guard, actual.at(size));
+            EXPECT_EQ((size + 6) / 7, out_of_range);
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Total) {
+    // Sizes around chunks of integers to run tails
+    const std::vector<size_t> sizes{0,  1,  7,    8,    31,   32,   33,  63,
+                                    64, 65, 1023, 1024, 1025, 2048, 3000};
+    constexpr size_t max_size = 3000;
+    constexpr size_t max_offset = 8;
+    std::vector<uint8_t> arg_raw(max_size + max_offset);
+    std::vector<int> arg_integer(max_size);
+    for (size_t index = 0; index < arg_raw.size(); ++index) {
+        const auto value = static_cast<uint32_t>(index * 0x9e3779b9u);
+        arg_raw.at(index) = static_cast<uint8_t>(value);
+        if (index < max_size) {
+            arg_integer.at(index) =
+                (index % 7) ? static_cast<int>(value) : rCppSample::NaInteger;
+        }
+    }
+
+    for (const auto &name : rCppSample::supported_kernel_variants()) {
+        set_kernel_variant_cpp(name);
+        for (const auto size : sizes) {
+            // Unaligned heads
+            for (size_t offset = 0; offset < max_offset; ++offset) {
+                const auto src = arg_raw.data() + offset;
+                uint64_t expected = 0;
+                for (size_t index = 0; index < size; ++index) {
+                    expected += __builtin_popcount(src[index]);
+                }
+                EXPECT_EQ(expected,
+                          rCppSample::popcount_total_kernel(src, size));
+            }
+
+            uint64_t expected = 0;
+            size_t expected_na_count = 0;
+            for (size_t index = 0; index < size; ++index) {
+                const auto value = arg_integer.at(index);
+                if (value == rCppSample::NaInteger) {
+                    ++expected_na_count;
+                } else {
+                    expected +=
+                        __builtin_popcount(static_cast<uint32_t>(value));
+                }
+            }
+            size_t na_count = 0;
+            EXPECT_EQ(expected, rCppSample::popcount_total_kernel(
+                                    arg_integer.data(), size, na_count));
+            EXPECT_EQ(expected_na_count, na_count);
+        }
+    }
+}
+
+TEST_F(TestPopcountKernel, Threads) {
+    // Larger than the threshold to count on threads
+    constexpr size_t size = (1 << 20) + 3;
+    std::vector<uint8_t> arg_raw(size);
+    std::vector<int> arg_integer(size);
+    std::vector<int64_t> arg_integer64(size);
+    std::vector<double> arg_double(size);
+    for (size_t index = 0; index < size; ++index) {
+        const auto value = static_cast<uint32_t>(index * 0x9e3779b9u);
+        arg_raw.at(index) = static_cast<uint8_t>(value);
+        arg_integer.at(index) =
+            (index % 7) ? static_cast<int>(value) : rCppSample::NaInteger;
+        arg_integer64.at(index) =
+            (index % 7) ? (static_cast<int64_t>(value) << 31)
+                        : rCppSample::Kernel_Na_Integer64;
+        arg_double.at(index) = (index % 7) ? (value * 0.25) : 1e+10;
+    }
+
+    std::vector<int> expected_integer64(size);
+    std::vector<int> expected_double(size);
+    rCppSample::popcount_kernel(arg_integer64.data(), size,
+                                expected_integer64.data());
+    const auto expected_out_of_range = rCppSample::popcount_kernel(
+        arg_double.data(), size, expected_double.data());
+    size_t expected_na_count_integer64 = 0;
+    const auto expected_total_integer64 = rCppSample::popcount_total_kernel(
+        arg_integer64.data(), size, expected_na_count_integer64);
+
+    std::vector<int> expected_raw(size);
+    std::vector<int> expected_integer(size);
+    rCppSample::popcount_kernel(arg_raw.data(), size, expected_raw.data());
+    rCppSample::popcount_kernel(arg_integer.data(), size,
+                                expected_integer.data());
+    const auto expected_total_raw =
+        rCppSample::popcount_total_kernel(arg_raw.data(), size);
+    size_t expected_na_count = 0;
+    const auto expected_total_integer = rCppSample::popcount_total_kernel(
+        arg_integer.data(), size, expected_na_count);
+
+    for (const size_t threads : {0, 1, 2, 3}) {
+        std::vector<int> actual(size);
+        rCppSample::popcount_kernel(arg_raw.data(), size, actual.data(),
+                                    threads);
+        EXPECT_EQ(expected_raw, actual);
+        std::vector<uint8_t> compact(size);
+        rCppSample::popcount_kernel(arg_raw.data(), size, compact.data(),
+                                    threads);
+        EXPECT_TRUE(std::equal(compact.begin(), compact.end(),
+                               expected_raw.begin()));
+        rCppSample::popcount_kernel(arg_integer.data(), size, actual.data(),
+                                    threads);
+        EXPECT_EQ(expected_integer, actual);
+
+        EXPECT_EQ(expected_total_raw, rCppSample::popcount_total_kernel(
+                                          arg_raw.data(), size, threads));
+        size_t na_count = 0;
+        EXPECT_EQ(expected_total_integer,
+                  rCppSample::popcount_total_kernel(arg_integer.data(), size,
+                                                    na_count, threads));
+        EXPECT_EQ(expected_na_count, na_count);
+
+        rCppSample::popcount_kernel(arg_integer64.data(), size, actual.data(),
+                                    threads);
+        EXPECT_EQ(expected_integer64, actual);
+        EXPECT_EQ(expected_out_of_range,
+                  rCppSample::popcount_kernel(arg_double.data(), size,
+                                              actual.data(), threads));
+        EXPECT_EQ(expected_double, actual);
+        EXPECT_EQ(expected_total_integer64,
+                  rCppSample::popcount_total_kernel(arg_integer64.data(), size,
+                                                    na_count, threads));
+        EXPECT_EQ(expected_na_count_integer64, na_count);
+    }
+}
+
+TEST_F(TestPopcountKernel, Many) {
+    // Small vectors share chunks and large ones span chunks
+    const std::vector<size_t> sizes{0, 1, 63, 64, 65, 1000, 70000, 0, 3,
+                                    (1 << 20) + 5};
+    std::vector<std::vector<uint8_t>> raws;
+    std::vector<std::vector<int>> integers;
+    std::vector<std::vector<int64_t>> integer64s;
+    std::vector<std::vector<double>> doubles;
+    for (const auto size : sizes) {
+        raws.emplace_back(size);
+        integers.emplace_back(size);
+        integer64s.emplace_back(size);
+        doubles.emplace_back(size);
+        for (size_t index = 0; index < size; ++index) {
+            const auto value = static_cast<uint32_t>((index + size) *
+                                                     0x9e3779b9u);
+            raws.back().at(index) = static_cast<uint8_t>(value);
+            integers.back().at(index) =
+                (index % 7) ? static_cast<int>(value) : rCppSample::NaInteger;
+            integer64s.back().at(index) = static_cast<int64_t>(value) << 31;
+            doubles.back().at(index) = (index % 5) ? (value * 0.25) : 1e+10;
+        }
+    }
+
+    // Mix types in the order of sizes
+    std::vector<std::vector<int>> expected(sizes.size());
+    size_t expected_out_of_range = 0;
+    std::vector<rCppSample::ManyVector> vectors;
+    std::vector<std::vector<int>> actual(sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        const auto size = sizes.at(i);
+        expected.at(i).resize(size);
+        actual.at(i).resize(size);
+        auto dst = actual.at(i).data();
+        switch (i % 4) {
+        case 0:
+            rCppSample::popcount_kernel(raws.at(i).data(), size,
+                                        expected.at(i).data());
+            vectors.push_back(rCppSample::ManyVector{
+                rCppSample::popcount_many_element<uint8_t>, raws.at(i).data(),
+                size, sizeof(uint8_t), dst});
+            break;
+        case 1:
+            rCppSample::popcount_kernel(integers.at(i).data(), size,
+                                        expected.at(i).data());
+            vectors.push_back(rCppSample::ManyVector{
+                rCppSample::popcount_many_element<int>, integers.at(i).data(),
+                size, sizeof(int), dst});
+            break;
+        case 2:
+            rCppSample::popcount_kernel(integer64s.at(i).data(), size,
+                                        expected.at(i).data());
+            vectors.push_back(rCppSample::ManyVector{
+                rCppSample::popcount_many_element<int64_t>,
+                integer64s.at(i).data(), size, sizeof(int64_t), dst});
+            break;
+        default:
+            expected_out_of_range += rCppSample::popcount_kernel(
+                doubles.at(i).data(), size, expected.at(i).data());
+            vectors.push_back(rCppSample::ManyVector{
+                rCppSample::popcount_many_element<double>,
+                doubles.at(i).data(), size, sizeof(double), dst});
+            break;
+        }
+    }
+    ASSERT_LT(0, expected_out_of_range);
+
+    for (const size_t threads : {0, 1, 2, 3}) {
+        for (auto &counts : actual) {
+            std::fill(counts.begin(), counts.end(), -1);
+        }
+        EXPECT_EQ(expected_out_of_range,
+                  rCppSample::popcount_many_kernel(vectors, threads));
+        EXPECT_EQ(expected, actual);
+    }
+
+    EXPECT_EQ(0, rCppSample::popcount_many_kernel({}, 2));
+}
+
+class TestRankSelectBitvector : public ::testing::Test {};
+
+TEST_F(TestRankSelectBitvector, RankSelect) {
+    for (const size_t size : {0, 1, 63, 64, 513, 2047, 2048, 2049, 100003}) {
+        for (const uint32_t density : {0u, 1u, 128u, 255u, 256u}) {
+            // Bits after size must be ignored
+            std::vector<uint8_t> bytes(size / 8 + 1, 0xff);
+            std::vector<size_t> positions;
+            for (size_t index = 0; index < size; ++index) {
+                const auto hash = (index * 2654435761u) >> 13;
+                const uint8_t mask = static_cast<uint8_t>(1u << (index % 8));
+                if ((hash & 0xffu) < density) {
+                    positions.push_back(index);
+                } else {
+                    bytes.at(index / 8) &= static_cast<uint8_t>(~mask);
+                }
+            }
+
+            // Every variant counts 1's of words to build directories
+            for (const auto &name : rCppSample::supported_kernel_variants()) {
+                const popcount_core::RankSelectBitvector bitvector(
+                    bytes.data(), size, rCppSample::parse_kernel_variant(name));
+                ASSERT_EQ(size, bitvector.size());
+                ASSERT_EQ(positions.size(), bitvector.count());
+                size_t rank = 0;
+                for (size_t index = 0; index <= size; ++index) {
+                    ASSERT_EQ(rank, bitvector.rank(index));
+                    if ((rank < positions.size()) &&
+                        (positions[rank] == index)) {
+                        ASSERT_TRUE(bitvector.get(index));
+                        ++rank;
+                    } else if (index < size) {
+                        ASSERT_FALSE(bitvector.get(index));
+                    }
+                }
+                for (size_t nth = 0; nth < positions.size(); ++nth) {
+                    ASSERT_EQ(positions[nth], bitvector.select(nth));
+                }
+
+                EXPECT_THROW(bitvector.rank(size + 1), std::out_of_range);
+                EXPECT_THROW(bitvector.select(positions.size()),
+                             std::out_of_range);
+                EXPECT_THROW(bitvector.get(size), std::out_of_range);
+            }
+        }
+    }
+}
+
 namespace {
 const std::string R_CODE{"library(rCppSample)"};
 RcodeFeeder code_feeder(R_CODE);